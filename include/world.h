@@ -40,6 +40,15 @@ extern "C" {
 typedef uint64_t world_sequence;
 typedef uint16_t world_key_size;
 typedef uint16_t world_data_size;
+typedef uint32_t world_extended_data_size;
+
+#define WORLD_MAX_KEY_SIZE UINT16_MAX
+#define WORLD_MAX_DATA_SIZE UINT32_MAX
+#define WORLD_MAX_PINS 32
+#define WORLD_MAX_SNAPSHOT_PARTITIONS 256
+#define WORLD_MAX_BUCKETS ((size_t)1 << 40)
+#define WORLD_MIN_LOAD_FACTOR 0.01f
+#define WORLD_ORIGIN_EXPIRY_RESOLUTION_MSEC 10
 
 enum world_error {
   world_error_ok               = 0,
@@ -47,6 +56,26 @@ enum world_error {
   world_error_no_such_key      = 2,
   world_error_key_exists       = 3,
   world_error_system           = 4,
+  world_error_busy             = 5,
+};
+
+enum world_hash_function {
+  world_hash_function_murmur1 = 0,
+  world_hash_function_xxh64   = 1,
+  world_hash_function_siphash = 2,
+};
+
+enum world_operation {
+  world_operation_set     = 0,
+  world_operation_add     = 1,
+  world_operation_replace = 2,
+  world_operation_delete  = 3,
+};
+
+enum world_update {
+  world_update_none   = 0,
+  world_update_set    = 1,
+  world_update_delete = 2,
 };
 
 enum world_log_level {
@@ -63,6 +92,105 @@ struct world_buffer {
   size_t size;
 };
 
+/**
+ * @brief A structure represents one of writing in a batch.
+ *
+ * @see world_origin_write_batch()
+ */
+struct world_write {
+  /**
+   * @brief An operation, which is one of set, add, replace and delete.
+   */
+  enum world_operation operation;
+
+  /**
+   * @brief A key.
+   */
+  struct world_buffer key;
+
+  /**
+   * @brief A data, which is ignored by delete.
+   */
+  struct world_buffer data;
+
+  /**
+   * @brief The result of the writing, which is filled by the call.
+   */
+  enum world_error error;
+};
+
+/**
+ * @brief A structure represents one of reading in a batch.
+ *
+ * @see world_origin_get_many(), world_replica_get_many()
+ */
+struct world_read {
+  /**
+   * @brief A key.
+   */
+  struct world_buffer key;
+
+  /**
+   * @brief The data associated with the key, which is filled by the call.
+   */
+  struct world_buffer data;
+
+  /**
+   * @brief The result of the reading, which is filled by the call.
+   */
+  enum world_error error;
+};
+
+/**
+ * @brief A structure represents a pinned data.
+ *
+ * @see world_origin_get_pinned(), world_origin_release(),
+ * world_replica_get_pinned(), world_replica_release()
+ */
+struct world_pin {
+  /**
+   * @brief The pinned data, which is filled by the call.
+   */
+  struct world_buffer data;
+
+  /**
+   * @brief Used internally.
+   */
+  size_t slot;
+};
+
+/**
+ * @brief A structure represents memory usage of a dataset.
+ *
+ * @see world_origin_memory(), world_replica_memory()
+ */
+struct world_memory {
+  /**
+   * @brief Bytes allocated from the system for entries, including free space
+   * kept for later use. Space is returned to the system in 64 KiB chunks, once
+   * every entry in a chunk has been freed.
+   */
+  size_t held;
+
+  /**
+   * @brief Bytes occupied by entries currently allocated.
+   */
+  size_t live;
+
+  /**
+   * @brief Bytes of the newest versions of keys.
+   */
+  size_t dataset;
+
+  /**
+   * @brief Bytes of stale versions and deletions not reclaimed yet.
+   *
+   * They are kept while replicas have not received them or snapshots may
+   * still see them. The log consists of the same entries.
+   */
+  size_t stale;
+};
+
 /**
  * @brief A structure represents a configuration for world_origin_open().
  *
@@ -106,6 +234,78 @@ struct world_originconf {
    */
   bool auto_transmission;
 
+  /**
+   * @brief A hash function for the dataset.
+   *
+   * - `world_hash_function_xxh64` is a fast 64-bit function.
+   * - `world_hash_function_siphash` is a keyed 64-bit function (SipHash-2-4)
+   *   with a random seed, which resists hash flooding by adversarial keys.
+   * - `world_hash_function_murmur1` is the 32-bit function used by earlier
+   *   versions.
+   *
+   * The default value is `world_hash_function_xxh64`.
+   */
+  enum world_hash_function hash_function;
+
+  /**
+   * @brief An expected number of keys in the dataset.
+   *
+   * Buckets for the number of keys are built in advance, so that loading the
+   * dataset does not have to grow the hashtable.
+   *
+   * The value should not exceed WORLD_MAX_BUCKETS times max_load_factor.
+   *
+   * The default value is 0.
+   */
+  size_t expected_cardinality;
+
+  /**
+   * @brief A maximum ratio of keys to buckets.
+   *
+   * Once the ratio exceeds the value, the number of buckets is doubled.
+   *
+   * The value should be at least WORLD_MIN_LOAD_FACTOR.
+   *
+   * The default value is 1.0.
+   */
+  float max_load_factor;
+
+  /**
+   * @brief A maximum number of bytes of the newest versions of keys, i.e.
+   * world_memory.dataset.
+   *
+   * Stale versions and deletions not reclaimed yet are not counted, since they
+   * are reclaimed once replicas have received them rather than by evictions.
+   *
+   * Once the dataset exceeds the value, each write evicts about as many bytes
+   * of keys as it adds, choosing keys that have not been read recently in the
+   * CLOCK order. Evictions are transmitted to replicas as deletions. Reads mark
+   * keys by sampling, so the order is approximate.
+   *
+   * If the value is 0, the dataset is unbounded.
+   *
+   * The default value is 0.
+   *
+   * @see world_memory
+   */
+  size_t max_memory_bytes;
+
+  /**
+   * @brief A time in milliseconds to wait for a replica to say hello after it
+   * is attached.
+   *
+   * A replica of the protocol version 2 says hello as soon as it is opened.
+   * One not heard from by the time is sent the dataset in the protocol version
+   * 1, without sequences, and so is one which is not a socket. The value should
+   * cover the time between connecting and opening the replica, and the latency
+   * between them.
+   *
+   * The default value is 500.
+   *
+   * @see world_replica_protocol_version()
+   */
+  uint64_t greeting_timeout_msec;
+
   /**
    * @brief Reserved.
    */
@@ -124,6 +324,11 @@ world_originconf_init(struct world_originconf *conf)
   conf->set_nonblocking = true;
   conf->set_tcp_nodelay = true;
   conf->auto_transmission = true;
+  conf->hash_function = world_hash_function_xxh64;
+  conf->expected_cardinality = 0;
+  conf->max_load_factor = 1.0f;
+  conf->max_memory_bytes = 0;
+  conf->greeting_timeout_msec = 500;
   conf->logger = NULL; // TODO not yet implemented
 }
 
@@ -142,9 +347,94 @@ struct world_replicaconf {
 
   /**
    * @brief A callback function invoked whenever a new log is arrived.
+   *
+   * Logs received at once are applied as a batch, and the callback is invoked
+   * for each of them after the whole batch is visible to readers, in the order
+   * they were received. It is not invoked for the logs which were not applied,
+   * e.g. a deletion of a key that does not exist. The data of a deletion is
+   * empty.
    */
   void (*callback)(struct world_buffer key, struct world_buffer data);
 
+  /**
+   * @brief A hash function for the dataset.
+   *
+   * The value does not need to match the one of the origin.
+   *
+   * The default value is `world_hash_function_xxh64`.
+   *
+   * @see world_originconf.hash_function
+   */
+  enum world_hash_function hash_function;
+
+  /**
+   * @brief An expected number of keys in the dataset.
+   *
+   * Buckets for the number of keys are built in advance, so that loading the
+   * dataset does not have to grow the hashtable.
+   *
+   * The value should not exceed WORLD_MAX_BUCKETS times max_load_factor.
+   *
+   * The default value is 0.
+   */
+  size_t expected_cardinality;
+
+  /**
+   * @brief A maximum ratio of keys to buckets.
+   *
+   * Once the ratio exceeds the value, the number of buckets is doubled.
+   *
+   * The value should be at least WORLD_MIN_LOAD_FACTOR.
+   *
+   * The default value is 1.0.
+   */
+  float max_load_factor;
+
+  /**
+   * @brief Whether the keys are indexed in bytewise order.
+   *
+   * The index enables world_replica_range() and world_replica_prefix(), at the
+   * expense of memory and of the time to apply the log.
+   *
+   * The default value is false.
+   */
+  bool ordered_index;
+
+  /**
+   * @brief Whether the dataset keeps no older versions of the keys.
+   *
+   * A lean replica reclaims a version as soon as a newer one has been applied,
+   * rather than keeping it in the log, which saves memory and the time to
+   * apply the log. It cannot open snapshots.
+   *
+   * The default value is false.
+   *
+   * @see world_replica_snapshot_open()
+   */
+  bool lean;
+
+  /**
+   * @brief Whether the data of the same size as before is overwritten in
+   * place.
+   *
+   * Updates that do not change the size of the data, such as those of prices
+   * and counters, allocate nothing. The data returned by world_replica_get(),
+   * world_replica_get_many() and world_replica_get_pinned() may then be
+   * overwritten while it is being read, so that it should be read by
+   * world_replica_get_copy() instead. world_replica_range() and
+   * world_replica_prefix() pass copies of the data to their callbacks. This
+   * requires `lean` to be true.
+   *
+   * An overwrite is visible as soon as it is done, rather than with the other
+   * writes of the batch it is received in. Readers may see it before those
+   * writes, but never see them without it.
+   *
+   * The default value is false.
+   *
+   * @see world_replica_get_copy()
+   */
+  bool in_place;
+
   /**
    * @brief Reserved.
    */
@@ -161,6 +451,12 @@ world_replicaconf_init(struct world_replicaconf *conf)
 {
   conf->fd = -1;
   conf->callback = NULL;
+  conf->hash_function = world_hash_function_xxh64;
+  conf->expected_cardinality = 0;
+  conf->max_load_factor = 1.0f;
+  conf->ordered_index = false;
+  conf->lean = false;
+  conf->in_place = false;
   conf->logger = NULL; // TODO not yet implemented
 }
 
@@ -182,7 +478,7 @@ world_replicaconf_init(struct world_replicaconf *conf)
  * @see world_originconf
  * @see world_origin_open(), world_origin_close()
  * @see world_origin_attach(), world_origin_detach()
- * @see world_origin_get()
+ * @see world_origin_get(), world_origin_get_many()
  * @see world_origin_set(), world_origin_add(), world_origin_replace(),
  * world_origin_delete()
  */
@@ -221,6 +517,14 @@ world_origin_close(struct world_origin *origin);
 /**
  * @brief Attaches a socket to an origin.
  *
+ * Nothing is sent until the replica says hello in the protocol version 2, or
+ * until world_originconf.greeting_timeout_msec has passed, so that a replica
+ * of the version 1 starts receiving the dataset after the timeout. A replica
+ * whose hello arrives after the timeout is sent the dataset in the version 1
+ * as well, without sequences, and the connection is closed once a data too
+ * large for the version 1 is to be sent. world_replica_protocol_version()
+ * tells which version a replica has ended up with.
+ *
  * @param origin A world_origin handle.
  * @param fd A file descriptor connected to a replica.
  * @return world_error_ok
@@ -261,10 +565,16 @@ world_origin_transmit(struct world_origin *origin);
 /**
  * @brief Gets a data with a given key.
  *
- * The size of `key` should not be zero.
+ * The size of `key` should not be zero, nor exceed `WORLD_MAX_KEY_SIZE`.
  * If `found` is non-NULL and if the data associated with `key` exists, it is
  * returned.
  *
+ * The data refers to the dataset rather than a copy, and it may be freed as
+ * soon as the key is updated or deleted, possibly by another thread, and the
+ * replicas have received the update. It is not kept for any grace period
+ * after that. Use world_origin_get_copy() or world_origin_get_pinned() if the
+ * key may be written while the data is in use.
+ *
  * @param origin A world_origin handle.
  * @param key A key.
  * @param found A data.
@@ -276,10 +586,92 @@ enum world_error
 world_origin_get(const struct world_origin *origin,
                  struct world_buffer key, struct world_buffer *found);
 
+/**
+ * @brief Gets a copy of the data with a given key.
+ *
+ * The size of `key` should not be zero, nor exceed `WORLD_MAX_KEY_SIZE`.
+ * If the data associated with `key` exists, up to `capacity` bytes of it are
+ * copied to `buffer`, and its whole size is stored in `size`.
+ *
+ * @param origin A world_origin handle.
+ * @param key A key.
+ * @param buffer A buffer of at least `capacity` bytes.
+ * @param capacity The size of `buffer`.
+ * @param size A pointer to the size of the data to be filled.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ * @return world_error_no_such_key
+ */
+enum world_error
+world_origin_get_copy(const struct world_origin *origin,
+                      struct world_buffer key, void *buffer, size_t capacity,
+                      size_t *size);
+
+/**
+ * @brief Gets a data with a given key, and pins it.
+ *
+ * The size of `key` should not be zero, nor exceed `WORLD_MAX_KEY_SIZE`.
+ * If the data associated with `key` exists, it is returned in `pin`, and it
+ * stays valid until the pin is released by world_origin_release(), even if
+ * the key is updated or deleted in the meantime.
+ *
+ * A pin defers freeing memory of the whole dataset, so that it should be
+ * released soon. Up to `WORLD_MAX_PINS` pins can be held at once, and the call
+ * returns an error of `world_error_busy` beyond that. All the pins should be
+ * released before the origin is closed.
+ *
+ * @param origin A world_origin handle.
+ * @param key A key.
+ * @param pin A world_pin object to be filled.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ * @return world_error_no_such_key
+ * @return world_error_busy
+ * @see world_origin_release()
+ */
+enum world_error
+world_origin_get_pinned(const struct world_origin *origin,
+                        struct world_buffer key, struct world_pin *pin);
+
+/**
+ * @brief Releases a pin.
+ *
+ * @param origin A world_origin handle.
+ * @param pin A world_pin object filled by world_origin_get_pinned().
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ * @see world_origin_get_pinned()
+ */
+enum world_error
+world_origin_release(const struct world_origin *origin,
+                     struct world_pin *pin);
+
+/**
+ * @brief Gets data with given keys at once.
+ *
+ * Each of `reads` is looked up as if world_origin_get() were called, and its
+ * result is stored in the `data` and `error` fields. This is faster than
+ * calling world_origin_get() for each key, since the lookups overlap their
+ * memory accesses.
+ *
+ * If any of `reads` has an invalid key, none of them is looked up.
+ *
+ * @param origin A world_origin handle.
+ * @param reads An array of world_read objects.
+ * @param n_reads The number of `reads`.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ */
+enum world_error
+world_origin_get_many(const struct world_origin *origin,
+                      struct world_read *reads, size_t n_reads);
+
 /**
  * @brief Sets a given key to a given data.
  *
- * The size of both `key` and `data` should not be zero.
+ * The size of both `key` and `data` should not be zero. The size of `key`
+ * should not exceed `WORLD_MAX_KEY_SIZE`, and that of `data` should not exceed
+ * `WORLD_MAX_DATA_SIZE`.
  *
  * @param origin A world_origin handle.
  * @param key A key.
@@ -292,10 +684,33 @@ enum world_error
 world_origin_set(struct world_origin *origin,
                  struct world_buffer key, struct world_buffer data);
 
+/**
+ * @brief Sets a given key to a given data, which expires after a given time.
+ *
+ * Once the time has elapsed, the key is deleted as if world_origin_delete()
+ * were called, and replicas delete it as well. The expiry is cancelled if the
+ * key is written again before then, and a later call sets a new time. The key
+ * expires within `WORLD_ORIGIN_EXPIRY_RESOLUTION_MSEC` milliseconds after the
+ * time.
+ *
+ * @param origin A world_origin handle.
+ * @param key A key.
+ * @param data A data.
+ * @param ttl_msec The time to live in milliseconds, which should be positive.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ * @see world_origin_set()
+ */
+enum world_error
+world_origin_set_ttl(struct world_origin *origin, struct world_buffer key,
+                     struct world_buffer data, uint64_t ttl_msec);
+
 /**
  * @brief Adds a given data.
  *
- * The size of both `key` and `data` should not be zero.
+ * The size of both `key` and `data` should not be zero. The size of `key`
+ * should not exceed `WORLD_MAX_KEY_SIZE`, and that of `data` should not exceed
+ * `WORLD_MAX_DATA_SIZE`.
  * If `key` exists in the dataset, the call returns an error of
  * `world_error_key_exists`.
  *
@@ -314,7 +729,9 @@ world_origin_add(struct world_origin *origin,
 /**
  * @brief Replaces an existing data with a given one.
  *
- * The size of both `key` and `data` should not be zero.
+ * The size of both `key` and `data` should not be zero. The size of `key`
+ * should not exceed `WORLD_MAX_KEY_SIZE`, and that of `data` should not exceed
+ * `WORLD_MAX_DATA_SIZE`.
  * If `key` does not exist in the dataset, the call returns an error of
  * `world_error_no_such_key`.
  *
@@ -333,7 +750,7 @@ world_origin_replace(struct world_origin *origin,
 /**
  * @brief Deletes a given key.
  *
- * The size of `key` should not be zero.
+ * The size of `key` should not be zero, nor exceed `WORLD_MAX_KEY_SIZE`.
  * If `key` does not exist in the dataset, the call returns an error of
  * `world_error_no_such_key`.
  *
@@ -347,6 +764,152 @@ enum world_error
 world_origin_delete(struct world_origin *origin,
                     struct world_buffer key);
 
+/**
+ * @brief Updates a given key with a function of its current data.
+ *
+ * The size of `key` should not be zero, nor exceed `WORLD_MAX_KEY_SIZE`.
+ * `fn` is called with `ctx` and the current data, which is NULL if `key` does
+ * not exist. It returns one of the following:
+ *
+ * - `world_update_set` to set `key` to the data it has stored in `data`, whose
+ *   size should not be zero, nor exceed `WORLD_MAX_DATA_SIZE`. The data is
+ *   copied before the call returns.
+ * - `world_update_delete` to delete `key`.
+ * - `world_update_none` to leave `key` as it is.
+ *
+ * No other writer can modify `key` while `fn` is running, so that no update
+ * is lost. `fn` should return quickly, and should not call any function of the
+ * origin.
+ *
+ * @param origin A world_origin handle.
+ * @param key A key.
+ * @param fn A function that computes a new data.
+ * @param ctx An argument passed to `fn`.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ * @return world_error_no_such_key
+ */
+enum world_error
+world_origin_update(struct world_origin *origin, struct world_buffer key,
+                    enum world_update (*fn)(void *ctx,
+                                            const struct world_buffer *current,
+                                            struct world_buffer *data),
+                    void *ctx);
+
+/**
+ * @brief Applies a batch of writing at once.
+ *
+ * Each of `writes` is applied in order, as if the corresponding one of
+ * world_origin_set(), world_origin_add(), world_origin_replace() and
+ * world_origin_delete() were called, and its result is stored in the `error`
+ * field. The successful ones are given consecutive sequence numbers, and they
+ * are transmitted at once.
+ *
+ * If any of `writes` has an invalid argument, none of them is applied.
+ *
+ * @param origin A world_origin handle.
+ * @param writes An array of world_write objects.
+ * @param n_writes The number of `writes`.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ */
+enum world_error
+world_origin_write_batch(struct world_origin *origin,
+                         struct world_write *writes, size_t n_writes);
+
+/**
+ * @brief An opaque structure represents a point-in-time view of the dataset
+ * of an origin or a replica.
+ *
+ * A snapshot sees the dataset as of its opening, regardless of the writing
+ * afterward. It holds back the reclamation of the superseded entries until it
+ * is closed, so that it should not be left open longer than necessary.
+ *
+ * The dataset is divided into the partitions of a snapshot, which are disjoint
+ * ranges of the hashtable. Each partition can be iterated by a different
+ * thread at the same time, while a partition must not be iterated by multiple
+ * threads at once.
+ *
+ * @see world_origin_snapshot_open(), world_replica_snapshot_open()
+ * @see world_snapshot_next(), world_snapshot_close()
+ */
+struct world_snapshot
+#if defined(DOXYGEN)
+{}
+#endif
+;
+
+/**
+ * @brief Retrieves the next key-value pair of a partition of a snapshot.
+ *
+ * The pairs are retrieved in no particular order. The retrieved buffers remain
+ * valid until the snapshot is closed.
+ *
+ * @param snapshot A world_snapshot handle.
+ * @param partition The index of the partition.
+ * @param key A world_buffer object to be filled with the key, or NULL.
+ * @param data A world_buffer object to be filled with the data, or NULL.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ * @return world_error_no_such_key if all the pairs of the partition have been
+ * retrieved.
+ */
+enum world_error
+world_snapshot_next(struct world_snapshot *snapshot, size_t partition,
+                    struct world_buffer *key, struct world_buffer *data);
+
+/**
+ * @brief Closes a snapshot.
+ *
+ * @param snapshot A world_snapshot handle.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ */
+enum world_error
+world_snapshot_close(struct world_snapshot *snapshot);
+
+/**
+ * @brief Opens a snapshot of the dataset of an origin.
+ *
+ * @param origin A world_origin handle.
+ * @param n_partitions The number of partitions, from 1 to
+ * `WORLD_MAX_SNAPSHOT_PARTITIONS`.
+ * @param snapshot A pointer to a world_snapshot handle to be filled.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ */
+enum world_error
+world_origin_snapshot_open(struct world_origin *origin, size_t n_partitions,
+                           struct world_snapshot **snapshot);
+
+/**
+ * @brief Reports memory usage of an origin.
+ *
+ * @param origin A world_origin handle.
+ * @param memory A world_memory object to be filled.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ */
+enum world_error
+world_origin_memory(const struct world_origin *origin,
+                    struct world_memory *memory);
+
+/**
+ * @brief Reports the sequence of the latest write of an origin.
+ *
+ * Replicas which speak the protocol version 2 report the same sequence once
+ * they have caught up with the write.
+ *
+ * @param origin A world_origin handle.
+ * @param seq A sequence to be filled.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ *
+ * @see world_replica_sequence()
+ */
+enum world_error
+world_origin_sequence(const struct world_origin *origin, world_sequence *seq);
+
 /**
  * @brief An opaque structure represents a replica (often referred as *slave*
  * or *subscriber*).
@@ -363,7 +926,7 @@ world_origin_delete(struct world_origin *origin,
  *
  * @see world_replicaconf
  * @see world_replica_open(), world_replica_close()
- * @see world_replica_get()
+ * @see world_replica_get(), world_replica_get_many()
  */
 struct world_replica
 #if defined(DOXYGEN)
@@ -400,10 +963,18 @@ world_replica_close(struct world_replica *replica);
 /**
  * @brief Gets a data with a given key.
  *
- * The size of `key` should not be zero.
+ * The size of `key` should not be zero, nor exceed `WORLD_MAX_KEY_SIZE`.
  * If `found` is non-NULL and if the data associated with `key` exists, it is
  * returned.
  *
+ * The data refers to the dataset rather than a copy, and it may be freed as
+ * soon as an update or a deletion of the key is received, once the snapshots
+ * opened before it are closed. On a `lean` replica, it may be freed at the
+ * next update of the key regardless of snapshots, and on an `in_place` one it
+ * may be overwritten while it is being read. Use world_replica_get_copy() or
+ * world_replica_get_pinned() if the key may be written while the data is in
+ * use.
+ *
  * @param replica A world_replica handle.
  * @param key A key.
  * @param found A data.
@@ -415,6 +986,201 @@ enum world_error
 world_replica_get(const struct world_replica *replica,
                   struct world_buffer key, struct world_buffer *found);
 
+/**
+ * @brief Gets a copy of the data with a given key.
+ *
+ * The size of `key` should not be zero, nor exceed `WORLD_MAX_KEY_SIZE`.
+ * If the data associated with `key` exists, up to `capacity` bytes of it are
+ * copied to `buffer`, and its whole size is stored in `size`. The copy is
+ * consistent even if the data is being overwritten in place.
+ *
+ * @param replica A world_replica handle.
+ * @param key A key.
+ * @param buffer A buffer of at least `capacity` bytes.
+ * @param capacity The size of `buffer`.
+ * @param size A pointer to the size of the data to be filled.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ * @return world_error_no_such_key
+ * @see world_replicaconf.in_place
+ */
+enum world_error
+world_replica_get_copy(const struct world_replica *replica,
+                       struct world_buffer key, void *buffer, size_t capacity,
+                       size_t *size);
+
+/**
+ * @brief Gets data with given keys at once.
+ *
+ * Each of `reads` is looked up as if world_replica_get() were called, and its
+ * result is stored in the `data` and `error` fields. This is faster than
+ * calling world_replica_get() for each key, since the lookups overlap their
+ * memory accesses.
+ *
+ * If any of `reads` has an invalid key, none of them is looked up.
+ *
+ * @param replica A world_replica handle.
+ * @param reads An array of world_read objects.
+ * @param n_reads The number of `reads`.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ */
+enum world_error
+world_replica_get_many(const struct world_replica *replica,
+                       struct world_read *reads, size_t n_reads);
+
+/**
+ * @brief Gets a data with a given key, and pins it.
+ *
+ * The size of `key` should not be zero, nor exceed `WORLD_MAX_KEY_SIZE`.
+ * If the data associated with `key` exists, it is returned in `pin`, and it
+ * stays valid until the pin is released by world_replica_release(), even if
+ * the key is updated or deleted in the meantime.
+ *
+ * A pin defers freeing memory of the whole dataset, so that it should be
+ * released soon. Up to `WORLD_MAX_PINS` pins can be held at once, and the call
+ * returns an error of `world_error_busy` beyond that. All the pins should be
+ * released before the replica is closed.
+ *
+ * @param replica A world_replica handle.
+ * @param key A key.
+ * @param pin A world_pin object to be filled.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ * @return world_error_no_such_key
+ * @return world_error_busy
+ * @see world_replica_release()
+ */
+enum world_error
+world_replica_get_pinned(const struct world_replica *replica,
+                         struct world_buffer key, struct world_pin *pin);
+
+/**
+ * @brief Releases a pin.
+ *
+ * @param replica A world_replica handle.
+ * @param pin A world_pin object filled by world_replica_get_pinned().
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ * @see world_replica_get_pinned()
+ */
+enum world_error
+world_replica_release(const struct world_replica *replica,
+                      struct world_pin *pin);
+
+/**
+ * @brief Iterates over the keys in a range in bytewise order.
+ *
+ * `fn` is called with each key not less than `lower` and less than `upper`,
+ * along with its data, until it returns false. The buffers are only valid
+ * during the call, and `fn` should return soon, since it holds back the
+ * reclamation of memory. The iteration is not a point-in-time view of the
+ * dataset, unlike a snapshot.
+ *
+ * The replica must have been opened with world_replicaconf.ordered_index.
+ *
+ * @param replica A world_replica handle.
+ * @param lower The lower bound of the keys.
+ * @param upper The upper bound of the keys, or a buffer whose base is NULL for
+ * no upper bound.
+ * @param fn A callback function.
+ * @param ctx An argument passed to `fn`.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ */
+enum world_error
+world_replica_range(const struct world_replica *replica,
+                    struct world_buffer lower, struct world_buffer upper,
+                    bool (*fn)(void *ctx, struct world_buffer key,
+                               struct world_buffer data),
+                    void *ctx);
+
+/**
+ * @brief Iterates over the keys with a prefix in bytewise order.
+ *
+ * It is the same as world_replica_range() except the keys to be iterated.
+ *
+ * @param replica A world_replica handle.
+ * @param prefix The prefix of the keys.
+ * @param fn A callback function.
+ * @param ctx An argument passed to `fn`.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ * @see world_replica_range()
+ */
+enum world_error
+world_replica_prefix(const struct world_replica *replica,
+                     struct world_buffer prefix,
+                     bool (*fn)(void *ctx, struct world_buffer key,
+                                struct world_buffer data),
+                     void *ctx);
+
+/**
+ * @brief Opens a snapshot of the dataset of a replica.
+ *
+ * The replica keeps applying the log while the snapshot is open. A lean
+ * replica cannot open snapshots.
+ *
+ * @param replica A world_replica handle.
+ * @param n_partitions The number of partitions, from 1 to
+ * `WORLD_MAX_SNAPSHOT_PARTITIONS`.
+ * @param snapshot A pointer to a world_snapshot handle to be filled.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ */
+enum world_error
+world_replica_snapshot_open(struct world_replica *replica, size_t n_partitions,
+                            struct world_snapshot **snapshot);
+
+/**
+ * @brief Reports memory usage of a replica.
+ *
+ * @param replica A world_replica handle.
+ * @param memory A world_memory object to be filled.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ */
+enum world_error
+world_replica_memory(const struct world_replica *replica,
+                     struct world_memory *memory);
+
+/**
+ * @brief Reports the sequence of the origin a replica has caught up with.
+ *
+ * The sequence is known once the replica has received the whole dataset from
+ * an origin which speaks the protocol version 2, and is 0 until then. It stays
+ * 0 with an origin of the protocol version 1, including one which has not
+ * heard the hello of the replica in time.
+ *
+ * @param replica A world_replica handle.
+ * @param seq A sequence to be filled.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ *
+ * @see world_origin_sequence(), world_replica_protocol_version()
+ */
+enum world_error
+world_replica_sequence(const struct world_replica *replica,
+                       world_sequence *seq);
+
+/**
+ * @brief Reports the protocol version an origin speaks to a replica.
+ *
+ * The version is 0 until the first frame is received from the origin. It is 1
+ * if the origin does not support the version 2, or has not heard the hello of
+ * the replica within `greeting_timeout_msec`.
+ *
+ * @param replica A world_replica handle.
+ * @param version A version to be filled.
+ * @return world_error_ok
+ * @return world_error_invalid_argument
+ *
+ * @see world_originconf.greeting_timeout_msec
+ */
+enum world_error
+world_replica_protocol_version(const struct world_replica *replica,
+                               unsigned int *version);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -20,21 +20,107 @@
  * SOFTWARE.
  */
 
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "world_allocator.h"
 #include "world_assert.h"
 
+// Small objects, e.g. hashtable entries, are carved out of chunks by size
+// class. Each thread keeps a cache of free objects per class, so that it
+// allocates and frees objects without any lock in steady state. A cache
+// exchanges objects with the allocator-wide free lists in batches.
+//
+// The size classes are 16 bytes apart up to 256 bytes, and then four classes
+// per power of two up to WORLD_ALLOCATOR_MAX_CLASS_SIZE. Larger objects are
+// allocated by malloc(3).
+//
+// A chunk serves a single class, and is aligned to its size so that an object
+// finds its chunk by masking its address. A chunk counts its objects out in
+// caches or in use, and is freed once they all come back, unless it is the
+// last chunk with free objects in the class.
+
+#define WORLD_ALLOCATOR_CHUNK_SIZE (64 * 1024)
+#define WORLD_ALLOCATOR_BATCH_SIZE (8 * 1024)
+
+struct world_allocator_chunk {
+  struct world_allocator_chunk *prev;
+  struct world_allocator_chunk *next;
+  void *free;
+  char *cursor;
+  size_t n_used;
+};
+
+struct world_allocator_cache {
+  struct world_allocator *allocator;
+  struct world_allocator_cache *prev;
+  struct world_allocator_cache *next;
+  struct {
+    void *free;
+    size_t n_free;
+  } classes[WORLD_ALLOCATOR_N_CLASSES];
+  _Atomic(size_t) live;
+};
+
+static size_t _class(size_t size);
+static size_t _class_size(size_t c);
+static size_t _batch(size_t c);
+static struct world_allocator_cache *_cache(struct world_allocator *a);
+static void _cache_destructor(void *cache);
+static void _refill(struct world_allocator *a, struct world_allocator_cache *cache, size_t c);
+static void _flush(struct world_allocator *a, struct world_allocator_cache *cache, size_t c, size_t n);
+static struct world_allocator_chunk *_chunk_new(struct world_allocator *a, size_t c);
+static void *_chunk_pop(struct world_allocator_chunk *chunk, size_t size);
+static int _chunk_is_full(struct world_allocator_chunk *chunk, size_t size);
+static void _chunk_link(struct world_allocator_chunk **list, struct world_allocator_chunk *chunk);
+static void _chunk_unlink(struct world_allocator_chunk **list, struct world_allocator_chunk *chunk);
+static void _add(_Atomic(size_t) *counter, size_t delta);
+
 void world_allocator_init(struct world_allocator *a)
 {
   WORLD_ASSERT(a);
-  // do nothing for now
+  world_mutex_init(&a->mtx);
+  int err;
+  if ((err = pthread_key_create(&a->key, _cache_destructor))) {
+    fprintf(stderr, "FATAL: pthread_key_create: %s\n", strerror(err));
+    abort();
+  }
+  for (size_t c = 0; c < WORLD_ALLOCATOR_N_CLASSES; c++) {
+    a->classes[c].partial = NULL;
+    a->classes[c].full = NULL;
+  }
+  a->caches = NULL;
+  atomic_init(&a->held, 0);
+  atomic_init(&a->live, 0);
 }
 
 void world_allocator_destroy(struct world_allocator *a)
 {
   WORLD_ASSERT(a);
-  // do nothing for now
+  int err;
+  if ((err = pthread_key_delete(a->key))) {
+    fprintf(stderr, "FATAL: pthread_key_delete: %s\n", strerror(err));
+    abort();
+  }
+  while (a->caches) {
+    struct world_allocator_cache *next = a->caches->next;
+    free(a->caches);
+    a->caches = next;
+  }
+  for (size_t c = 0; c < WORLD_ALLOCATOR_N_CLASSES; c++) {
+    struct world_allocator_chunk **lists[] = {&a->classes[c].partial, &a->classes[c].full};
+    for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+      while (*lists[i]) {
+        struct world_allocator_chunk *next = (*lists[i])->next;
+        free(*lists[i]);
+        *lists[i] = next;
+      }
+    }
+  }
+  world_mutex_destroy(&a->mtx);
 }
 
 void *world_allocator_malloc(struct world_allocator *a, size_t size)
@@ -75,3 +161,271 @@ void world_allocator_free(struct world_allocator *restrict a, void *restrict ptr
   WORLD_ASSERT(a);
   free(ptr);
 }
+
+void *world_allocator_slab_alloc(struct world_allocator *a, size_t size)
+{
+  WORLD_ASSERT(a);
+  WORLD_ASSERT(size > 0);
+
+  if (size > WORLD_ALLOCATOR_MAX_CLASS_SIZE) {
+    void *p = world_allocator_malloc(a, size);
+    atomic_fetch_add_explicit(&a->held, size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&a->live, size, memory_order_relaxed);
+    return p;
+  }
+
+  size_t c = _class(size);
+  struct world_allocator_cache *cache = _cache(a);
+  if (!cache->classes[c].free) {
+    _refill(a, cache, c);
+  }
+  void *p = cache->classes[c].free;
+  cache->classes[c].free = *(void **)p;
+  cache->classes[c].n_free--;
+  _add(&cache->live, size);
+  return p;
+}
+
+void world_allocator_slab_free(struct world_allocator *restrict a, void *restrict ptr, size_t size)
+{
+  WORLD_ASSERT(a);
+
+  if (!ptr) {
+    return;
+  }
+
+  if (size > WORLD_ALLOCATOR_MAX_CLASS_SIZE) {
+    world_allocator_free(a, ptr);
+    atomic_fetch_sub_explicit(&a->held, size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&a->live, size, memory_order_relaxed);
+    return;
+  }
+
+  size_t c = _class(size);
+  struct world_allocator_cache *cache = _cache(a);
+  *(void **)ptr = cache->classes[c].free;
+  cache->classes[c].free = ptr;
+  cache->classes[c].n_free++;
+  _add(&cache->live, -size);
+  if (cache->classes[c].n_free >= _batch(c) * 2) {
+    _flush(a, cache, c, _batch(c));
+  }
+}
+
+size_t world_allocator_held(struct world_allocator *a)
+{
+  return atomic_load_explicit(&a->held, memory_order_relaxed);
+}
+
+size_t world_allocator_live(struct world_allocator *a)
+{
+  // The counters of the caches may wrap around individually, since an object
+  // may be freed by a thread other than the one that allocated it, but their
+  // sum does not.
+  world_mutex_lock(&a->mtx);
+  size_t live = atomic_load_explicit(&a->live, memory_order_relaxed);
+  for (struct world_allocator_cache *cache = a->caches; cache; cache = cache->next) {
+    live += atomic_load_explicit(&cache->live, memory_order_relaxed);
+  }
+  world_mutex_unlock(&a->mtx);
+  return live;
+}
+
+static size_t _class(size_t size)
+{
+  WORLD_ASSERT(size > 0 && size <= WORLD_ALLOCATOR_MAX_CLASS_SIZE);
+  if (size <= 256) {
+    return (size - 1) / 16;
+  }
+  size_t width = sizeof(unsigned long long) * CHAR_BIT - __builtin_clzll(size - 1);
+  return 16 + (width - 9) * 4 + (((size - 1) >> (width - 3)) & 3);
+}
+
+static size_t _class_size(size_t c)
+{
+  WORLD_ASSERT(c < WORLD_ALLOCATOR_N_CLASSES);
+  if (c < 16) {
+    return (c + 1) * 16;
+  }
+  return (5 + (c - 16) % 4) << (6 + (c - 16) / 4);
+}
+
+static size_t _batch(size_t c)
+{
+  return WORLD_ALLOCATOR_BATCH_SIZE / _class_size(c);
+}
+
+static struct world_allocator_cache *_cache(struct world_allocator *a)
+{
+  struct world_allocator_cache *cache = pthread_getspecific(a->key);
+  if (cache) {
+    return cache;
+  }
+
+  cache = calloc(1, sizeof(*cache));
+  if (!cache) {
+    perror("calloc");
+    abort();
+  }
+  cache->allocator = a;
+  atomic_init(&cache->live, 0);
+
+  world_mutex_lock(&a->mtx);
+  cache->prev = NULL;
+  cache->next = a->caches;
+  if (a->caches) {
+    a->caches->prev = cache;
+  }
+  a->caches = cache;
+  world_mutex_unlock(&a->mtx);
+
+  int err;
+  if ((err = pthread_setspecific(a->key, cache))) {
+    fprintf(stderr, "FATAL: pthread_setspecific: %s\n", strerror(err));
+    abort();
+  }
+  return cache;
+}
+
+static void _cache_destructor(void *p)
+{
+  // Returns the objects to the allocator when a thread exits.
+  struct world_allocator_cache *cache = p;
+  struct world_allocator *a = cache->allocator;
+  for (size_t c = 0; c < WORLD_ALLOCATOR_N_CLASSES; c++) {
+    _flush(a, cache, c, cache->classes[c].n_free);
+  }
+
+  world_mutex_lock(&a->mtx);
+  atomic_fetch_add_explicit(&a->live, atomic_load_explicit(&cache->live, memory_order_relaxed), memory_order_relaxed);
+  if (cache->prev) {
+    cache->prev->next = cache->next;
+  } else {
+    a->caches = cache->next;
+  }
+  if (cache->next) {
+    cache->next->prev = cache->prev;
+  }
+  world_mutex_unlock(&a->mtx);
+
+  free(cache);
+}
+
+static void _refill(struct world_allocator *a, struct world_allocator_cache *cache, size_t c)
+{
+  size_t size = _class_size(c);
+  size_t n = _batch(c);
+  struct world_allocator_class *sc = &a->classes[c];
+
+  world_mutex_lock(&a->mtx);
+  for (size_t i = 0; i < n; i++) {
+    struct world_allocator_chunk *chunk = sc->partial;
+    if (!chunk) {
+      chunk = _chunk_new(a, c);
+    }
+    void *p = _chunk_pop(chunk, size);
+    if (_chunk_is_full(chunk, size)) {
+      _chunk_unlink(&sc->partial, chunk);
+      _chunk_link(&sc->full, chunk);
+    }
+    *(void **)p = cache->classes[c].free;
+    cache->classes[c].free = p;
+    cache->classes[c].n_free++;
+  }
+  world_mutex_unlock(&a->mtx);
+}
+
+static void _flush(struct world_allocator *a, struct world_allocator_cache *cache, size_t c, size_t n)
+{
+  size_t size = _class_size(c);
+  struct world_allocator_class *sc = &a->classes[c];
+
+  world_mutex_lock(&a->mtx);
+  for (size_t i = 0; i < n; i++) {
+    void *p = cache->classes[c].free;
+    WORLD_ASSERT(p);
+    cache->classes[c].free = *(void **)p;
+    cache->classes[c].n_free--;
+
+    struct world_allocator_chunk *chunk = (void *)((uintptr_t)p & ~(uintptr_t)(WORLD_ALLOCATOR_CHUNK_SIZE - 1));
+    WORLD_ASSERT(chunk->n_used > 0);
+    if (_chunk_is_full(chunk, size)) {
+      _chunk_unlink(&sc->full, chunk);
+      _chunk_link(&sc->partial, chunk);
+    }
+    *(void **)p = chunk->free;
+    chunk->free = p;
+    chunk->n_used--;
+    if (!chunk->n_used && (chunk->prev || chunk->next)) {
+      _chunk_unlink(&sc->partial, chunk);
+      free(chunk);
+      atomic_fetch_sub_explicit(&a->held, WORLD_ALLOCATOR_CHUNK_SIZE, memory_order_relaxed);
+    }
+  }
+  world_mutex_unlock(&a->mtx);
+}
+
+static struct world_allocator_chunk *_chunk_new(struct world_allocator *a, size_t c)
+{
+  struct world_allocator_chunk *chunk = aligned_alloc(WORLD_ALLOCATOR_CHUNK_SIZE, WORLD_ALLOCATOR_CHUNK_SIZE);
+  if (!chunk) {
+    perror("aligned_alloc");
+    abort();
+  }
+  chunk->free = NULL;
+  // Objects are aligned as malloc(3) does.
+  chunk->cursor = (char *)chunk + (sizeof(*chunk) + 15) / 16 * 16;
+  chunk->n_used = 0;
+  _chunk_link(&a->classes[c].partial, chunk);
+  atomic_fetch_add_explicit(&a->held, WORLD_ALLOCATOR_CHUNK_SIZE, memory_order_relaxed);
+  return chunk;
+}
+
+static void *_chunk_pop(struct world_allocator_chunk *chunk, size_t size)
+{
+  void *p;
+  if (chunk->free) {
+    p = chunk->free;
+    chunk->free = *(void **)p;
+  } else {
+    p = chunk->cursor;
+    chunk->cursor += size;
+  }
+  chunk->n_used++;
+  return p;
+}
+
+static int _chunk_is_full(struct world_allocator_chunk *chunk, size_t size)
+{
+  return !chunk->free && (size_t)((char *)chunk + WORLD_ALLOCATOR_CHUNK_SIZE - chunk->cursor) < size;
+}
+
+static void _chunk_link(struct world_allocator_chunk **list, struct world_allocator_chunk *chunk)
+{
+  chunk->prev = NULL;
+  chunk->next = *list;
+  if (*list) {
+    (*list)->prev = chunk;
+  }
+  *list = chunk;
+}
+
+static void _chunk_unlink(struct world_allocator_chunk **list, struct world_allocator_chunk *chunk)
+{
+  if (chunk->prev) {
+    chunk->prev->next = chunk->next;
+  } else {
+    *list = chunk->next;
+  }
+  if (chunk->next) {
+    chunk->next->prev = chunk->prev;
+  }
+}
+
+static void _add(_Atomic(size_t) *counter, size_t delta)
+{
+  // Only the owner writes to the counter, so that it needs no atomic
+  // read-modify-write.
+  size_t value = atomic_load_explicit(counter, memory_order_relaxed);
+  atomic_store_explicit(counter, value + delta, memory_order_relaxed);
+}
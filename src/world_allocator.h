@@ -22,10 +22,26 @@
 
 #pragma once
 
+#include <pthread.h>
 #include <stddef.h>
+#include "world_mutex.h"
+
+#define WORLD_ALLOCATOR_N_CLASSES 28
+#define WORLD_ALLOCATOR_MAX_CLASS_SIZE 2048
+
+struct world_allocator_cache;
+struct world_allocator_chunk;
 
 struct world_allocator {
-  void *dummy;
+  struct world_mutex mtx;
+  pthread_key_t key;
+  struct world_allocator_class {
+    struct world_allocator_chunk *partial;
+    struct world_allocator_chunk *full;
+  } classes[WORLD_ALLOCATOR_N_CLASSES];
+  struct world_allocator_cache *caches;
+  _Atomic(size_t) held;
+  _Atomic(size_t) live;
 };
 
 void world_allocator_init(struct world_allocator *a);
@@ -34,3 +50,7 @@ void *world_allocator_malloc(struct world_allocator *a, size_t size);
 void *world_allocator_calloc(struct world_allocator *a, size_t count, size_t size);
 void *world_allocator_realloc(struct world_allocator *restrict a, void *restrict ptr, size_t size);
 void world_allocator_free(struct world_allocator *restrict a, void *restrict ptr);
+void *world_allocator_slab_alloc(struct world_allocator *a, size_t size);
+void world_allocator_slab_free(struct world_allocator *restrict a, void *restrict ptr, size_t size);
+size_t world_allocator_held(struct world_allocator *a);
+size_t world_allocator_live(struct world_allocator *a);
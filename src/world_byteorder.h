@@ -31,6 +31,12 @@ static inline uintmax_t world_encode_key_size(world_key_size key_size);
 static inline uintmax_t world_decode_key_size(world_key_size key_size);
 static inline uintmax_t world_encode_data_size(world_data_size data_size);
 static inline uintmax_t world_decode_data_size(world_data_size data_size);
+static inline uintmax_t world_encode_extended_data_size(world_extended_data_size data_size);
+static inline uintmax_t world_decode_extended_data_size(world_extended_data_size data_size);
+
+// A data size of WORLD_DATA_SIZE_ESCAPE or more is encoded as the escape,
+// followed by an extended data size.
+#define WORLD_DATA_SIZE_ESCAPE UINT16_MAX
 
 static inline uintmax_t world_encode_key_size(world_key_size key_size)
 {
@@ -55,3 +61,15 @@ static inline uintmax_t world_decode_data_size(world_data_size data_size)
   _Static_assert(sizeof(world_data_size) == sizeof(uint16_t), "world_data_size is uint16_t");
   return ntohs(data_size);
 }
+
+static inline uintmax_t world_encode_extended_data_size(world_extended_data_size data_size)
+{
+  _Static_assert(sizeof(world_extended_data_size) == sizeof(uint32_t), "world_extended_data_size is uint32_t");
+  return htonl(data_size);
+}
+
+static inline uintmax_t world_decode_extended_data_size(world_extended_data_size data_size)
+{
+  _Static_assert(sizeof(world_extended_data_size) == sizeof(uint32_t), "world_extended_data_size is uint32_t");
+  return ntohl(data_size);
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "world_assert.h"
+#include "world_epoch.h"
+
+// Epoch-based reclamation.
+//
+// A reader occupies a slot with the global epoch it observed while it follows
+// pointers. A writer unlinks objects, then advances the global epoch and tags
+// the unlinked objects with the epoch before the advance. Such objects may be
+// freed once every occupied slot holds a greater epoch, since a reader that
+// observed a greater epoch cannot reach them anymore.
+//
+// The slots are kept in a list of blocks. When every slot is occupied, a reader
+// appends a new block rather than waiting for another reader to leave, so any
+// number of threads (and pins) may be in the epoch at once. Blocks are only
+// freed on destroy, and a thread retries the slot it used last first.
+
+static void _init_block(struct world_epoch_block *block, size_t base);
+static struct world_epoch_slot *_slot(struct world_epoch *e, size_t slot);
+static int _occupy(struct world_epoch_slot *slot, uint64_t epoch);
+static void _append(struct world_epoch_block *last);
+static size_t _slot_hint(void);
+
+static _Thread_local size_t _hint = WORLD_EPOCH_NO_SLOT;
+
+void world_epoch_init(struct world_epoch *e)
+{
+  atomic_store_explicit(&e->epoch, 1, memory_order_relaxed);
+  _init_block(&e->block, 0);
+}
+
+void world_epoch_destroy(struct world_epoch *e)
+{
+  struct world_epoch_block *block = &e->block;
+  while (block) {
+    struct world_epoch_block *next = atomic_load_explicit(&block->next, memory_order_relaxed);
+    for (size_t i = 0; i < WORLD_EPOCH_N_SLOTS; i++) {
+      WORLD_ASSERT(atomic_load_explicit(&block->slots[i].epoch, memory_order_relaxed) == 0);
+    }
+    if (block != &e->block) {
+      free(block);
+    }
+    block = next;
+  }
+}
+
+size_t world_epoch_enter(struct world_epoch *e)
+{
+  size_t hint = _slot_hint();
+  uint64_t epoch = atomic_load_explicit(&e->epoch, memory_order_acquire);
+  size_t slot = hint;
+  struct world_epoch_slot *s = _slot(e, hint);
+  if (s && _occupy(s, epoch)) {
+    goto entered;
+  }
+
+  for (;;) {
+    struct world_epoch_block *block = &e->block, *last = NULL;
+    while (block) {
+      for (size_t i = 0; i < WORLD_EPOCH_N_SLOTS; i++) {
+        size_t offset = (hint + i) % WORLD_EPOCH_N_SLOTS;
+        if (_occupy(&block->slots[offset], epoch)) {
+          slot = block->base + offset;
+          goto entered;
+        }
+      }
+      last = block;
+      block = atomic_load_explicit(&block->next, memory_order_acquire);
+    }
+    _append(last);
+  }
+
+entered:
+  // Pairs with the fence in world_epoch_least(). Either the writer sees the
+  // slot, or the reader sees what the writer has unlinked.
+  atomic_thread_fence(memory_order_seq_cst);
+  _hint = slot;
+  return slot;
+}
+
+void world_epoch_leave(struct world_epoch *e, size_t slot)
+{
+  struct world_epoch_slot *s = _slot(e, slot);
+  WORLD_ASSERT(s);
+  atomic_store_explicit(&s->epoch, 0, memory_order_release);
+}
+
+uint64_t world_epoch_advance(struct world_epoch *e)
+{
+  return atomic_fetch_add_explicit(&e->epoch, 1, memory_order_seq_cst);
+}
+
+uint64_t world_epoch_least(struct world_epoch *e)
+{
+  atomic_thread_fence(memory_order_seq_cst);
+  uint64_t least = atomic_load_explicit(&e->epoch, memory_order_relaxed);
+  struct world_epoch_block *block = &e->block;
+  while (block) {
+    for (size_t i = 0; i < WORLD_EPOCH_N_SLOTS; i++) {
+      uint64_t epoch = atomic_load_explicit(&block->slots[i].epoch, memory_order_acquire);
+      if (epoch && epoch < least) {
+        least = epoch;
+      }
+    }
+    block = atomic_load_explicit(&block->next, memory_order_acquire);
+  }
+  return least;
+}
+
+static void _init_block(struct world_epoch_block *block, size_t base)
+{
+  for (size_t i = 0; i < WORLD_EPOCH_N_SLOTS; i++) {
+    atomic_store_explicit(&block->slots[i].epoch, 0, memory_order_relaxed);
+  }
+  block->base = base;
+  atomic_store_explicit(&block->next, NULL, memory_order_relaxed);
+}
+
+static struct world_epoch_slot *_slot(struct world_epoch *e, size_t slot)
+{
+  struct world_epoch_block *block = &e->block;
+  while (block && slot >= block->base + WORLD_EPOCH_N_SLOTS) {
+    block = atomic_load_explicit(&block->next, memory_order_acquire);
+  }
+  return block ? &block->slots[slot - block->base] : NULL;
+}
+
+static int _occupy(struct world_epoch_slot *slot, uint64_t epoch)
+{
+  uint64_t idle = 0;
+  return atomic_compare_exchange_strong_explicit(&slot->epoch, &idle, epoch, memory_order_relaxed, memory_order_relaxed);
+}
+
+static void _append(struct world_epoch_block *last)
+{
+  // The size is rounded up to the alignment, as aligned_alloc() requires.
+  size_t size = (sizeof(struct world_epoch_block) + WORLD_EPOCH_CACHE_LINE_SIZE - 1) / WORLD_EPOCH_CACHE_LINE_SIZE * WORLD_EPOCH_CACHE_LINE_SIZE;
+  struct world_epoch_block *block = aligned_alloc(WORLD_EPOCH_CACHE_LINE_SIZE, size);
+  if (!block) {
+    perror("aligned_alloc");
+    abort();
+  }
+  _init_block(block, last->base + WORLD_EPOCH_N_SLOTS);
+  struct world_epoch_block *expected = NULL;
+  if (!atomic_compare_exchange_strong_explicit(&last->next, &expected, block, memory_order_release, memory_order_relaxed)) {
+    // Another reader has appended a block, which the caller scans next.
+    free(block);
+  }
+}
+
+static size_t _slot_hint(void)
+{
+  if (_hint == WORLD_EPOCH_NO_SLOT) {
+    // Spread threads over the slots by the address of their thread-local.
+    uint64_t x = (uintptr_t)&_hint;
+    _hint = (x * 0x9E3779B97F4A7C15ull >> 32) % WORLD_EPOCH_N_SLOTS;
+  }
+  return _hint;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WORLD_EPOCH_N_SLOTS 64
+#define WORLD_EPOCH_CACHE_LINE_SIZE 64
+#define WORLD_EPOCH_NO_SLOT SIZE_MAX
+
+struct world_epoch_block {
+  struct world_epoch_slot {
+    _Atomic(uint64_t) epoch;
+    char padding[WORLD_EPOCH_CACHE_LINE_SIZE - sizeof(uint64_t)];
+  } slots[WORLD_EPOCH_N_SLOTS];
+  size_t base;
+  _Atomic(struct world_epoch_block *) next;
+};
+
+struct world_epoch {
+  _Atomic(uint64_t) epoch;
+  char padding[WORLD_EPOCH_CACHE_LINE_SIZE - sizeof(uint64_t)];
+  struct world_epoch_block block;
+};
+
+void world_epoch_init(struct world_epoch *e);
+void world_epoch_destroy(struct world_epoch *e);
+size_t world_epoch_enter(struct world_epoch *e);
+void world_epoch_leave(struct world_epoch *e, size_t slot);
+uint64_t world_epoch_advance(struct world_epoch *e);
+uint64_t world_epoch_least(struct world_epoch *e);
@@ -23,10 +23,18 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include "world_assert.h"
 #include "world_hash.h"
 
-world_hash_type world_generate_seed(void)
+static uint32_t _read32(const void *p);
+static uint64_t _read64(const void *p);
+static uint64_t _rotl(uint64_t x, int r);
+static uint64_t _xxh64_round(uint64_t acc, uint64_t input);
+static uint64_t _xxh64_merge_round(uint64_t acc, uint64_t val);
+
+void world_generate_seed(struct world_hash_seed *seed)
 {
   // FIXME it may be platform dependent implementation
 
@@ -36,8 +44,7 @@ world_hash_type world_generate_seed(void)
     abort();
   }
 
-  world_hash_type seed = 0;
-  if (read(fd, &seed, sizeof(seed)) == -1) {
+  if (read(fd, seed, sizeof(*seed)) == -1) {
     perror("read");
     abort();
   }
@@ -46,32 +53,60 @@ world_hash_type world_generate_seed(void)
     perror("close");
     abort();
   }
+}
 
-  return seed;
+bool world_hash_validate_function(enum world_hash_function function)
+{
+  switch (function) {
+  case world_hash_function_murmur1:
+  case world_hash_function_xxh64:
+  case world_hash_function_siphash:
+    return true;
+  }
+  return false;
 }
 
-world_hash_type world_hash(const void *data, size_t size, world_hash_type seed)
+world_hash_type world_hash(enum world_hash_function function, const void *data, size_t size, const struct world_hash_seed *seed)
+{
+  switch (function) {
+  case world_hash_function_murmur1:
+    return world_hash_murmur1(data, size, (uint32_t)seed->k0);
+  case world_hash_function_xxh64:
+    return world_hash_xxh64(data, size, seed->k0);
+  case world_hash_function_siphash:
+    return world_hash_siphash(data, size, seed);
+  }
+  WORLD_ASSERT(false);
+  return 0;
+}
+
+world_hash_type world_hash_murmur1(const void *data, size_t size, uint32_t seed)
 {
   // We employ MurmurHash1.
   // https://github.com/aappleby/smhasher/blob/master/src/MurmurHash1.cpp
+  //
+  // The 32-bit result is placed at the upper half, since the split ordering
+  // and the stripes of a hashtable look at the most significant bits.
 
-  const world_hash_type m = 0xc6a4a793;
+  const uint32_t m = 0xc6a4a793;
 
-  world_hash_type h = seed ^ (size * m);
+  uint32_t h = seed ^ (size * m);
 
-  while (size >= sizeof(world_hash_type)) {
-    h += ((world_hash_type *)data)[0];
+  while (size >= sizeof(uint32_t)) {
+    h += _read32(data);
     h *= m;
     h ^= h >> 16;
-    data = (world_hash_type *)data + 1;
-    size -= sizeof(world_hash_type);
+    data = (const uint8_t *)data + sizeof(uint32_t);
+    size -= sizeof(uint32_t);
   }
 
   switch (size) {
   case 3:
     h += ((uint8_t *)data)[2] << 16;
+    // fall through
   case 2:
     h += ((uint8_t *)data)[1] << 16;
+    // fall through
   case 1:
     h += ((uint8_t *)data)[0] << 16;
     h *= m;
@@ -83,15 +118,199 @@ world_hash_type world_hash(const void *data, size_t size, world_hash_type seed)
   h *= m;
   h ^= h >> 17;
 
+  return (world_hash_type)h << 32;
+}
+
+world_hash_type world_hash_xxh64(const void *data, size_t size, uint64_t seed)
+{
+  // We employ XXH64, which consumes 32 bytes per step in four independent
+  // lanes.
+  // https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+
+  const uint64_t p1 = 0x9E3779B185EBCA87ull;
+  const uint64_t p2 = 0xC2B2AE3D27D4EB4Full;
+  const uint64_t p3 = 0x165667B19E3779F9ull;
+  const uint64_t p4 = 0x85EBCA77C2B2AE63ull;
+  const uint64_t p5 = 0x27D4EB2F165667C5ull;
+
+  const uint8_t *p = data;
+  const uint8_t *end = p + size;
+  uint64_t h;
+
+  if (size >= 32) {
+    uint64_t v1 = seed + p1 + p2;
+    uint64_t v2 = seed + p2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - p1;
+    do {
+      v1 = _xxh64_round(v1, _read64(p));
+      v2 = _xxh64_round(v2, _read64(p + 8));
+      v3 = _xxh64_round(v3, _read64(p + 16));
+      v4 = _xxh64_round(v4, _read64(p + 24));
+      p += 32;
+    } while (end - p >= 32);
+    h = _rotl(v1, 1) + _rotl(v2, 7) + _rotl(v3, 12) + _rotl(v4, 18);
+    h = _xxh64_merge_round(h, v1);
+    h = _xxh64_merge_round(h, v2);
+    h = _xxh64_merge_round(h, v3);
+    h = _xxh64_merge_round(h, v4);
+  } else {
+    h = seed + p5;
+  }
+
+  h += size;
+
+  while (end - p >= 8) {
+    h ^= _xxh64_round(0, _read64(p));
+    h = _rotl(h, 27) * p1 + p4;
+    p += 8;
+  }
+  if (end - p >= 4) {
+    h ^= _read32(p) * p1;
+    h = _rotl(h, 23) * p2 + p3;
+    p += 4;
+  }
+  while (p < end) {
+    h ^= *p * p5;
+    h = _rotl(h, 11) * p1;
+    p++;
+  }
+
+  h ^= h >> 33;
+  h *= p2;
+  h ^= h >> 29;
+  h *= p3;
+  h ^= h >> 32;
+
   return h;
 }
 
+#define WORLD_HASH_SIPROUND                                                    \
+  do {                                                                         \
+    v0 += v1;                                                                  \
+    v1 = _rotl(v1, 13);                                                        \
+    v1 ^= v0;                                                                  \
+    v0 = _rotl(v0, 32);                                                        \
+    v2 += v3;                                                                  \
+    v3 = _rotl(v3, 16);                                                        \
+    v3 ^= v2;                                                                  \
+    v0 += v3;                                                                  \
+    v3 = _rotl(v3, 21);                                                        \
+    v3 ^= v0;                                                                  \
+    v2 += v1;                                                                  \
+    v1 = _rotl(v1, 17);                                                        \
+    v1 ^= v2;                                                                  \
+    v2 = _rotl(v2, 32);                                                        \
+  } while (0)
+
+world_hash_type world_hash_siphash(const void *data, size_t size, const struct world_hash_seed *seed)
+{
+  // We employ SipHash-2-4, a keyed function which resists hash flooding as long
+  // as the seed is kept secret.
+  // https://www.aumasson.jp/siphash/siphash.pdf
+
+  uint64_t v0 = seed->k0 ^ 0x736f6d6570736575ull;
+  uint64_t v1 = seed->k1 ^ 0x646f72616e646f6dull;
+  uint64_t v2 = seed->k0 ^ 0x6c7967656e657261ull;
+  uint64_t v3 = seed->k1 ^ 0x7465646279746573ull;
+
+  const uint8_t *p = data;
+  const uint8_t *end = p + (size & ~(size_t)7);
+  for (; p < end; p += 8) {
+    uint64_t m = _read64(p);
+    v3 ^= m;
+    WORLD_HASH_SIPROUND;
+    WORLD_HASH_SIPROUND;
+    v0 ^= m;
+  }
+
+  uint64_t b = (uint64_t)size << 56;
+  switch (size & 7) {
+  case 7:
+    b |= (uint64_t)p[6] << 48;
+    // fall through
+  case 6:
+    b |= (uint64_t)p[5] << 40;
+    // fall through
+  case 5:
+    b |= (uint64_t)p[4] << 32;
+    // fall through
+  case 4:
+    b |= (uint64_t)p[3] << 24;
+    // fall through
+  case 3:
+    b |= (uint64_t)p[2] << 16;
+    // fall through
+  case 2:
+    b |= (uint64_t)p[1] << 8;
+    // fall through
+  case 1:
+    b |= (uint64_t)p[0];
+  }
+
+  v3 ^= b;
+  WORLD_HASH_SIPROUND;
+  WORLD_HASH_SIPROUND;
+  v0 ^= b;
+
+  v2 ^= 0xff;
+  WORLD_HASH_SIPROUND;
+  WORLD_HASH_SIPROUND;
+  WORLD_HASH_SIPROUND;
+  WORLD_HASH_SIPROUND;
+
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
 world_hash_type world_hash_reverse(world_hash_type hash)
 {
-  hash = ((hash & 0x55555555) << 1) | ((hash & 0xAAAAAAAA) >> 1);
-  hash = ((hash & 0x33333333) << 2) | ((hash & 0xCCCCCCCC) >> 2);
-  hash = ((hash & 0x0F0F0F0F) << 4) | ((hash & 0xF0F0F0F0) >> 4);
-  hash = ((hash & 0x00FF00FF) << 8) | ((hash & 0xFF00FF00) >> 8);
-  hash = ((hash & 0x0000FFFF) << 16) | ((hash & 0xFFFF0000) >> 16);
+  hash = ((hash & 0x5555555555555555ull) << 1) | ((hash & 0xAAAAAAAAAAAAAAAAull) >> 1);
+  hash = ((hash & 0x3333333333333333ull) << 2) | ((hash & 0xCCCCCCCCCCCCCCCCull) >> 2);
+  hash = ((hash & 0x0F0F0F0F0F0F0F0Full) << 4) | ((hash & 0xF0F0F0F0F0F0F0F0ull) >> 4);
+  hash = ((hash & 0x00FF00FF00FF00FFull) << 8) | ((hash & 0xFF00FF00FF00FF00ull) >> 8);
+  hash = ((hash & 0x0000FFFF0000FFFFull) << 16) | ((hash & 0xFFFF0000FFFF0000ull) >> 16);
+  hash = ((hash & 0x00000000FFFFFFFFull) << 32) | ((hash & 0xFFFFFFFF00000000ull) >> 32);
   return hash;
 }
+
+static uint32_t _read32(const void *p)
+{
+  // The hash functions are defined on little-endian words.
+  uint32_t x;
+  memcpy(&x, p, sizeof(x));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  x = __builtin_bswap32(x);
+#endif
+  return x;
+}
+
+static uint64_t _read64(const void *p)
+{
+  uint64_t x;
+  memcpy(&x, p, sizeof(x));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  x = __builtin_bswap64(x);
+#endif
+  return x;
+}
+
+static uint64_t _rotl(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t _xxh64_round(uint64_t acc, uint64_t input)
+{
+  acc += input * 0xC2B2AE3D27D4EB4Full;
+  acc = _rotl(acc, 31);
+  acc *= 0x9E3779B185EBCA87ull;
+  return acc;
+}
+
+static uint64_t _xxh64_merge_round(uint64_t acc, uint64_t val)
+{
+  val = _xxh64_round(0, val);
+  acc ^= val;
+  acc = acc * 0x9E3779B185EBCA87ull + 0x85EBCA77C2B2AE63ull;
+  return acc;
+}
@@ -22,11 +22,22 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <world.h>
 
-typedef uint32_t world_hash_type;
+typedef uint64_t world_hash_type;
 
-world_hash_type world_generate_seed(void);
-world_hash_type world_hash(const void *data, size_t size, world_hash_type seed);
+struct world_hash_seed {
+  uint64_t k0;
+  uint64_t k1;
+};
+
+void world_generate_seed(struct world_hash_seed *seed);
+bool world_hash_validate_function(enum world_hash_function function);
+world_hash_type world_hash(enum world_hash_function function, const void *data, size_t size, const struct world_hash_seed *seed);
+world_hash_type world_hash_murmur1(const void *data, size_t size, uint32_t seed);
+world_hash_type world_hash_xxh64(const void *data, size_t size, uint64_t seed);
+world_hash_type world_hash_siphash(const void *data, size_t size, const struct world_hash_seed *seed);
 world_hash_type world_hash_reverse(world_hash_type hash);
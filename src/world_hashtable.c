@@ -20,61 +20,161 @@
  * SOFTWARE.
  */
 
+#include <limits.h>
 #include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
+#include "world_allocator.h"
 #include "world_assert.h"
 #include "world_circular.h"
 #include "world_hashtable.h"
 #include "world_hashtable_entry.h"
 
+struct _retired {
+  uint64_t epoch;
+  struct world_hashtable_entry *entry;
+};
+
+// A garbage is keyed by the last sequence at which it is still visible, so that
+// snapshots up to that sequence can still see it. A void entry is keyed by its
+// own sequence, which keeps it as long as it is in the log.
+struct _garbage {
+  world_sequence seq;
+  struct world_hashtable_entry *entry;
+};
+
+struct _unspliced {
+  world_sequence seq;
+  struct world_hashtable_entry *bucket;
+};
+
 static float _load_factor(struct world_hashtable *ht);
 static bool _find(struct world_hashtable *ht, world_hash_type hash, struct world_buffer key, struct world_hashtable_entry **cursor);
-static void _append_bucket(struct world_hashtable *ht);
-static void _mark_garbage(struct world_hashtable *ht, struct world_hashtable_entry *entry);
-static void _unlink_garbage(struct world_hashtable *ht, struct world_hashtable_entry *entry);
+static struct world_hashtable_entry *_lookup(struct world_hashtable *ht, world_hash_type hash, struct world_buffer key);
+static struct world_hashtable_entry *_resolve(struct world_hashtable *ht, struct world_hashtable_entry *cursor, world_hash_type hash, struct world_buffer key);
+static struct world_hashtable_entry *_visible_version(struct world_hashtable *ht, struct world_hashtable_entry *entry, world_hash_type hash, struct world_buffer key);
+static size_t _stripe_index(world_hash_type hash);
+static struct world_mutex *_stripe(struct world_hashtable *ht, world_hash_type hash);
+static void _commit(struct world_hashtable *ht, struct world_hashtable_entry *cursor, struct world_hashtable_entry *entry, bool found);
+static void _link(struct world_hashtable *ht, struct world_hashtable_entry *cursor, struct world_hashtable_entry *entry, bool found);
+static struct world_hashtable_entry *_new_entry(struct world_hashtable *ht, world_hash_type hash, const struct world_write *w);
+static bool _overwrite(struct world_hashtable *ht, struct world_hashtable_entry *entry, struct world_buffer data);
+static bool _overwritable(struct world_hashtable *ht, world_hash_type hash, const struct world_write *w);
+static void _supersede(struct world_hashtable *ht);
+static bool _same_key(struct world_hashtable_entry *x, struct world_hashtable_entry *y);
+static world_sequence _greatest_sequence(struct world_hashtable *ht);
+static void _grow(struct world_hashtable *ht);
+static void _shrink(struct world_hashtable *ht);
+static void _mark_garbage(struct world_hashtable *ht, struct world_hashtable_entry *entry, world_sequence seq);
+static void _unlink_garbages(struct world_hashtable *ht, size_t begin);
+static void _unlink_run(struct world_hashtable *ht, struct world_hashtable_entry **run, size_t n_run);
+static int _unlinking_order(const void *x, const void *y);
+static int _pointer_order(const void *x, const void *y);
+static size_t _reclaim_retired(struct world_hashtable *ht, uint64_t epoch, struct world_circular *garbages, size_t budget);
 static bool _garbage_heap_property(const void *x, const void *y);
+static void _reference(struct world_hashtable *ht, world_hash_type hash);
+static bool _test_and_clear_reference(struct world_hashtable *ht, world_hash_type hash);
+static struct world_hashtable_entry *_clock(struct world_hashtable *ht, size_t *n_scans, size_t max_scans);
 
-void world_hashtable_init(struct world_hashtable *ht, world_hash_type seed, struct world_allocator *a)
+void world_hashtable_init(struct world_hashtable *ht, enum world_hash_function hash_function, const struct world_hash_seed *seed, size_t expected_cardinality, float max_load_factor, struct world_allocator *a)
 {
   world_mutex_init(&ht->mtx);
+  world_mutex_init(&ht->log_mtx);
+  world_mutex_init(&ht->grow_mtx);
+  world_mutex_init(&ht->evict_mtx);
+  for (size_t i = 0; i < WORLD_HASHTABLE_N_STRIPES; i++) {
+    world_mutex_init(&ht->stripes[i].mtx);
+  }
+  world_epoch_init(&ht->epoch);
   world_hashtable_bucket_init(&ht->bucket, a);
+
+  // All the buckets for the expected cardinality are built in advance, up to
+  // the number the configuration is validated against.
+  WORLD_ASSERT(max_load_factor >= WORLD_MIN_LOAD_FACTOR);
+  size_t size = WORLD_HASHTABLE_N_STRIPES;
+  while (size < WORLD_MAX_BUCKETS && size * max_load_factor < expected_cardinality) {
+    size *= 2;
+  }
+  for (size_t i = 1; i < size; i++) {
+    world_hashtable_bucket_splice(&ht->bucket, i, a);
+  }
+  world_hashtable_bucket_publish(&ht->bucket, size);
+  ht->min_bucket_size = size;
+
   world_hashtable_log_init(&ht->log, a);
   world_vector_init(&ht->garbages, a);
+  world_vector_init(&ht->unlinking, a);
+  world_vector_init(&ht->sequences, a);
+  world_circular_init(&ht->retired, a);
+  world_circular_init(&ht->unspliced, a);
+  world_vector_init(&ht->superseding, a);
+  world_circular_init(&ht->superseded, a);
   ht->allocator = a;
-  ht->seed = seed;
-  ht->n_fresh_entries = 0;
+  ht->hash_function = hash_function;
+  ht->seed = *seed;
+  ht->max_load_factor = max_load_factor;
+  atomic_store_explicit(&ht->visible, 0, memory_order_relaxed);
+  atomic_store_explicit(&ht->n_fresh_entries, 0, memory_order_relaxed);
+  atomic_store_explicit(&ht->n_pins, 0, memory_order_relaxed);
+  atomic_store_explicit(&ht->n_live_bytes, 0, memory_order_relaxed);
+  atomic_store_explicit(&ht->n_stale_bytes, 0, memory_order_relaxed);
+  ht->referenced = NULL;
+  ht->hand = 0;
+  ht->lean = false;
+  ht->in_place = false;
+  ht->greatest = 0;
 }
 
 void world_hashtable_destroy(struct world_hashtable *ht)
 {
-  world_hashtable_checkpoint(ht, world_hashtable_log_greatest_sequence(&ht->log), NULL);
+  while (!world_hashtable_checkpoint(ht, _greatest_sequence(ht), NULL)) {
+  }
+  _reclaim_retired(ht, UINT64_MAX, NULL, SIZE_MAX);
+  struct _unspliced *unspliced = NULL;
+  while ((unspliced = world_circular_front(&ht->unspliced, sizeof(*unspliced)))) {
+    world_hashtable_entry_delete_bucket(unspliced->bucket, ht->allocator);
+    world_circular_pop_front(&ht->unspliced);
+  }
+  world_circular_destroy(&ht->superseded);
+  world_vector_destroy(&ht->superseding);
+  world_circular_destroy(&ht->unspliced);
+  world_circular_destroy(&ht->retired);
+  if (ht->referenced) {
+    world_allocator_free(ht->allocator, ht->referenced);
+  }
+  world_vector_destroy(&ht->sequences);
+  world_vector_destroy(&ht->unlinking);
   world_vector_destroy(&ht->garbages);
   world_hashtable_log_destroy(&ht->log, ht->allocator);
   world_hashtable_bucket_destroy(&ht->bucket, ht->allocator);
+  world_epoch_destroy(&ht->epoch);
+  for (size_t i = 0; i < WORLD_HASHTABLE_N_STRIPES; i++) {
+    world_mutex_destroy(&ht->stripes[i].mtx);
+  }
+  world_mutex_destroy(&ht->evict_mtx);
+  world_mutex_destroy(&ht->grow_mtx);
+  world_mutex_destroy(&ht->log_mtx);
   world_mutex_destroy(&ht->mtx);
 }
 
 enum world_error world_hashtable_get(struct world_hashtable *ht, struct world_buffer key, struct world_buffer *found)
 {
-  if (!key.base || !key.size) {
+  if (!key.base || !key.size || key.size > WORLD_MAX_KEY_SIZE) {
     return world_error_invalid_argument;
   }
 
+  // Readers take no lock. Entries are published by release stores, and the
+  // epoch keeps what we are looking at from being freed.
   enum world_error err = world_error_ok;
-  world_mutex_lock(&ht->mtx);
+  size_t slot = world_epoch_enter(&ht->epoch);
 
-  world_hash_type hash = world_hash(key.base, key.size, ht->seed);
-  struct world_hashtable_entry *cursor = NULL;
-  if (!_find(ht, hash, key, &cursor)) {
-    err = world_error_no_such_key;
-    goto release;
-  }
-
-  cursor = atomic_load_explicit(&cursor->base.next, memory_order_relaxed);
-  if (world_hashtable_entry_is_void(cursor)) {
+  world_hash_type hash = world_hash(ht->hash_function, key.base, key.size, &ht->seed);
+  struct world_hashtable_entry *cursor = _lookup(ht, hash, key);
+  if (!cursor || world_hashtable_entry_is_void(cursor)) {
     err = world_error_no_such_key;
     goto release;
   }
+  _reference(ht, hash);
 
   if (found) {
     struct world_buffer data = world_hashtable_entry_data(cursor);
@@ -83,55 +183,178 @@ enum world_error world_hashtable_get(struct world_hashtable *ht, struct world_bu
   }
 
 release:
-  world_mutex_unlock(&ht->mtx);
+  world_epoch_leave(&ht->epoch, slot);
   return err;
 }
 
+enum world_error world_hashtable_get_copy(struct world_hashtable *ht, struct world_buffer key, void *buffer, size_t capacity, size_t *size)
+{
+  if (!key.base || !key.size || key.size > WORLD_MAX_KEY_SIZE || (!buffer && capacity) || !size) {
+    return world_error_invalid_argument;
+  }
+
+  // Unlike world_hashtable_get(), the data is copied while we are in the
+  // epoch, and the copy is never torn by an overwrite in place. Only entries
+  // of an in-place hashtable have the sequence lock, which otherwise shares
+  // the space with the log.
+  enum world_error err = world_error_ok;
+  size_t slot = world_epoch_enter(&ht->epoch);
+
+  world_hash_type hash = world_hash(ht->hash_function, key.base, key.size, &ht->seed);
+  struct world_hashtable_entry *cursor = _lookup(ht, hash, key);
+  if (!cursor || world_hashtable_entry_is_void(cursor)) {
+    err = world_error_no_such_key;
+    goto release;
+  }
+  _reference(ht, hash);
+  if (ht->in_place) {
+    *size = world_hashtable_entry_copy_data(cursor, buffer, capacity);
+  } else {
+    struct world_buffer data = world_hashtable_entry_data(cursor);
+    memcpy(buffer, data.base, data.size < capacity ? data.size : capacity);
+    *size = data.size;
+  }
+
+release:
+  world_epoch_leave(&ht->epoch, slot);
+  return err;
+}
+
+enum world_error world_hashtable_get_many(struct world_hashtable *ht, struct world_read *reads, size_t n_reads)
+{
+  if (!reads && n_reads) {
+    return world_error_invalid_argument;
+  }
+  for (size_t i = 0; i < n_reads; i++) {
+    if (!reads[i].key.base || !reads[i].key.size || reads[i].key.size > WORLD_MAX_KEY_SIZE) {
+      return world_error_invalid_argument;
+    }
+  }
+
+  size_t slot = world_epoch_enter(&ht->epoch);
+
+  // Keys are looked up in groups. The buckets of a group are found and
+  // prefetched first, then their first entries, so that the cache misses of
+  // the group overlap each other rather than being paid one by one.
+  for (size_t base = 0; base < n_reads; base += WORLD_HASHTABLE_N_PREFETCHES) {
+    size_t n = n_reads - base < WORLD_HASHTABLE_N_PREFETCHES ? n_reads - base : WORLD_HASHTABLE_N_PREFETCHES;
+    struct world_read *group = &reads[base];
+    world_hash_type hashes[WORLD_HASHTABLE_N_PREFETCHES];
+    struct world_hashtable_entry *cursors[WORLD_HASHTABLE_N_PREFETCHES];
+
+    for (size_t i = 0; i < n; i++) {
+      hashes[i] = world_hash(ht->hash_function, group[i].key.base, group[i].key.size, &ht->seed);
+      cursors[i] = world_hashtable_bucket_find(&ht->bucket, hashes[i]);
+      __builtin_prefetch(cursors[i]);
+    }
+    for (size_t i = 0; i < n; i++) {
+      cursors[i] = atomic_load_explicit(&cursors[i]->base.next, memory_order_acquire);
+      if (cursors[i]) {
+        __builtin_prefetch(cursors[i]);
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      struct world_hashtable_entry *entry = _resolve(ht, cursors[i], hashes[i], group[i].key);
+      if (!entry || world_hashtable_entry_is_void(entry)) {
+        group[i].error = world_error_no_such_key;
+        group[i].data.base = NULL;
+        group[i].data.size = 0;
+        continue;
+      }
+      group[i].error = world_error_ok;
+      group[i].data = world_hashtable_entry_data(entry);
+      _reference(ht, hashes[i]);
+    }
+  }
+
+  world_epoch_leave(&ht->epoch, slot);
+  return world_error_ok;
+}
+
+enum world_error world_hashtable_get_pinned(struct world_hashtable *ht, struct world_buffer key, struct world_pin *pin)
+{
+  if (!key.base || !key.size || key.size > WORLD_MAX_KEY_SIZE || !pin) {
+    return world_error_invalid_argument;
+  }
+
+  // A pin is a reader that stays in the epoch until it is released. Pins are
+  // limited, since each of them holds back reclamation of the whole dataset.
+  if (atomic_fetch_add_explicit(&ht->n_pins, 1, memory_order_relaxed) >= WORLD_MAX_PINS) {
+    atomic_fetch_sub_explicit(&ht->n_pins, 1, memory_order_relaxed);
+    return world_error_busy;
+  }
+  size_t slot = world_epoch_enter(&ht->epoch);
+
+  world_hash_type hash = world_hash(ht->hash_function, key.base, key.size, &ht->seed);
+  struct world_hashtable_entry *entry = _lookup(ht, hash, key);
+  if (!entry || world_hashtable_entry_is_void(entry)) {
+    world_epoch_leave(&ht->epoch, slot);
+    atomic_fetch_sub_explicit(&ht->n_pins, 1, memory_order_relaxed);
+    return world_error_no_such_key;
+  }
+
+  _reference(ht, hash);
+  pin->data = world_hashtable_entry_data(entry);
+  pin->slot = slot;
+  return world_error_ok;
+}
+
+void world_hashtable_release(struct world_hashtable *ht, struct world_pin *pin)
+{
+  world_epoch_leave(&ht->epoch, pin->slot);
+  atomic_fetch_sub_explicit(&ht->n_pins, 1, memory_order_relaxed);
+  pin->data.base = NULL;
+  pin->data.size = 0;
+  pin->slot = WORLD_EPOCH_NO_SLOT;
+}
+
 enum world_error world_hashtable_set(struct world_hashtable *ht, struct world_buffer key, struct world_buffer data)
 {
-  if (!key.base || !key.size) {
+  return world_hashtable_set_versioned(ht, key, data, NULL);
+}
+
+enum world_error world_hashtable_set_versioned(struct world_hashtable *ht, struct world_buffer key, struct world_buffer data, world_sequence *seq)
+{
+  if (!key.base || !key.size || key.size > WORLD_MAX_KEY_SIZE || data.size > WORLD_MAX_DATA_SIZE) {
     return world_error_invalid_argument;
   }
 
-  world_mutex_lock(&ht->mtx);
+  world_hash_type hash = world_hash(ht->hash_function, key.base, key.size, &ht->seed);
+  struct world_hashtable_entry *entry = world_hashtable_entry_new(ht->allocator, hash, key, data);
+
+  struct world_mutex *stripe = _stripe(ht, hash);
+  world_mutex_lock(stripe);
 
-  world_hash_type hash = world_hash(key.base, key.size, ht->seed);
   struct world_hashtable_entry *cursor = NULL;
   bool found = _find(ht, hash, key, &cursor);
 
-  struct world_hashtable_entry *entry = world_hashtable_entry_new(ht->allocator, hash, key, data);
-  world_hashtable_log_push_back(&ht->log, entry);
-
   struct world_hashtable_entry *next = atomic_load_explicit(&cursor->base.next, memory_order_relaxed);
-  if (found) {
-    struct world_hashtable_entry *nextnext = atomic_load_explicit(&next->base.next, memory_order_relaxed);
-    _mark_garbage(ht, next);
-    atomic_store_explicit(&entry->base.next, nextnext, memory_order_relaxed);
-    atomic_store_explicit(&entry->stale, next, memory_order_relaxed);
-    atomic_store_explicit(&cursor->base.next, entry, memory_order_release);
-  } else {
-    atomic_store_explicit(&entry->base.next, next, memory_order_relaxed);
-    atomic_store_explicit(&cursor->base.next, entry, memory_order_release);
-    ht->n_fresh_entries++;
+  if (!found || world_hashtable_entry_is_void(next)) {
+    atomic_fetch_add_explicit(&ht->n_fresh_entries, 1, memory_order_relaxed);
+  }
+  _commit(ht, cursor, entry, found);
+  if (seq) {
+    *seq = entry->base.seq;
   }
 
-  _append_bucket(ht);
+  world_mutex_unlock(stripe);
 
-  world_mutex_unlock(&ht->mtx);
+  _grow(ht);
 
   return world_error_ok;
 }
 
 enum world_error world_hashtable_add(struct world_hashtable *ht, struct world_buffer key, struct world_buffer data)
 {
-  if (!key.base || !key.size) {
+  if (!key.base || !key.size || key.size > WORLD_MAX_KEY_SIZE || data.size > WORLD_MAX_DATA_SIZE) {
     return world_error_invalid_argument;
   }
 
   enum world_error err = world_error_ok;
-  world_mutex_lock(&ht->mtx);
+  world_hash_type hash = world_hash(ht->hash_function, key.base, key.size, &ht->seed);
+  struct world_mutex *stripe = _stripe(ht, hash);
+  world_mutex_lock(stripe);
 
-  world_hash_type hash = world_hash(key.base, key.size, ht->seed);
   struct world_hashtable_entry *cursor = NULL;
   bool found = _find(ht, hash, key, &cursor);
 
@@ -142,36 +365,28 @@ enum world_error world_hashtable_add(struct world_hashtable *ht, struct world_bu
   }
 
   struct world_hashtable_entry *entry = world_hashtable_entry_new(ht->allocator, hash, key, data);
-  world_hashtable_log_push_back(&ht->log, entry);
-
-  if (found) {
-    struct world_hashtable_entry *nextnext = atomic_load_explicit(&next->base.next, memory_order_relaxed);
-    atomic_store_explicit(&entry->base.next, nextnext, memory_order_relaxed);
-    atomic_store_explicit(&entry->stale, next, memory_order_relaxed);
-    atomic_store_explicit(&cursor->base.next, entry, memory_order_release);
-  } else {
-    atomic_store_explicit(&entry->base.next, next, memory_order_relaxed);
-    atomic_store_explicit(&cursor->base.next, entry, memory_order_release);
-  }
-  ht->n_fresh_entries++;
-
-  _append_bucket(ht);
+  atomic_fetch_add_explicit(&ht->n_fresh_entries, 1, memory_order_relaxed);
+  _commit(ht, cursor, entry, found);
 
 release:
-  world_mutex_unlock(&ht->mtx);
+  world_mutex_unlock(stripe);
+  if (!err) {
+    _grow(ht);
+  }
   return err;
 }
 
 enum world_error world_hashtable_replace(struct world_hashtable *ht, struct world_buffer key, struct world_buffer data)
 {
-  if (!key.base || !key.size) {
+  if (!key.base || !key.size || key.size > WORLD_MAX_KEY_SIZE || data.size > WORLD_MAX_DATA_SIZE) {
     return world_error_invalid_argument;
   }
 
   enum world_error err = world_error_ok;
-  world_mutex_lock(&ht->mtx);
+  world_hash_type hash = world_hash(ht->hash_function, key.base, key.size, &ht->seed);
+  struct world_mutex *stripe = _stripe(ht, hash);
+  world_mutex_lock(stripe);
 
-  world_hash_type hash = world_hash(key.base, key.size, ht->seed);
   struct world_hashtable_entry *cursor = NULL;
   bool found = _find(ht, hash, key, &cursor);
 
@@ -180,31 +395,26 @@ enum world_error world_hashtable_replace(struct world_hashtable *ht, struct worl
     err = world_error_no_such_key;
     goto release;
   }
-  _mark_garbage(ht, next);
 
   struct world_hashtable_entry *entry = world_hashtable_entry_new(ht->allocator, hash, key, data);
-  world_hashtable_log_push_back(&ht->log, entry);
-
-  struct world_hashtable_entry *nextnext = atomic_load_explicit(&next->base.next, memory_order_relaxed);
-  atomic_store_explicit(&entry->base.next, nextnext, memory_order_relaxed);
-  atomic_store_explicit(&entry->stale, next, memory_order_relaxed);
-  atomic_store_explicit(&cursor->base.next, entry, memory_order_release);
+  _commit(ht, cursor, entry, found);
 
 release:
-  world_mutex_unlock(&ht->mtx);
+  world_mutex_unlock(stripe);
   return err;
 }
 
 enum world_error world_hashtable_delete(struct world_hashtable *ht, struct world_buffer key)
 {
-  if (!key.base || !key.size) {
+  if (!key.base || !key.size || key.size > WORLD_MAX_KEY_SIZE) {
     return world_error_invalid_argument;
   }
 
   enum world_error err = world_error_ok;
-  world_mutex_lock(&ht->mtx);
+  world_hash_type hash = world_hash(ht->hash_function, key.base, key.size, &ht->seed);
+  struct world_mutex *stripe = _stripe(ht, hash);
+  world_mutex_lock(stripe);
 
-  world_hash_type hash = world_hash(key.base, key.size, ht->seed);
   struct world_hashtable_entry *cursor = NULL;
   bool found = _find(ht, hash, key, &cursor);
 
@@ -213,23 +423,249 @@ enum world_error world_hashtable_delete(struct world_hashtable *ht, struct world
     err = world_error_no_such_key;
     goto release;
   }
-  _mark_garbage(ht, next);
 
   struct world_hashtable_entry *entry = world_hashtable_entry_new_void(ht->allocator, hash, key);
-  world_hashtable_log_push_back(&ht->log, entry);
-  _mark_garbage(ht, entry);
+  atomic_fetch_sub_explicit(&ht->n_fresh_entries, 1, memory_order_relaxed);
+  _commit(ht, cursor, entry, found);
 
-  struct world_hashtable_entry *nextnext = atomic_load_explicit(&next->base.next, memory_order_relaxed);
-  atomic_store_explicit(&entry->base.next, nextnext, memory_order_relaxed);
-  atomic_store_explicit(&entry->stale, next, memory_order_relaxed);
-  atomic_store_explicit(&cursor->base.next, entry, memory_order_release);
-  ht->n_fresh_entries--;
+release:
+  world_mutex_unlock(stripe);
+  if (!err) {
+    _shrink(ht);
+  }
+  return err;
+}
+
+enum world_error world_hashtable_expire(struct world_hashtable *ht, struct world_buffer key, world_sequence seq)
+{
+  if (!key.base || !key.size || key.size > WORLD_MAX_KEY_SIZE) {
+    return world_error_invalid_argument;
+  }
+
+  // The key is deleted only if it has not been written since the version.
+  enum world_error err = world_error_ok;
+  world_hash_type hash = world_hash(ht->hash_function, key.base, key.size, &ht->seed);
+  struct world_mutex *stripe = _stripe(ht, hash);
+  world_mutex_lock(stripe);
+
+  struct world_hashtable_entry *cursor = NULL;
+  bool found = _find(ht, hash, key, &cursor);
+
+  struct world_hashtable_entry *next = atomic_load_explicit(&cursor->base.next, memory_order_relaxed);
+  if (!found || world_hashtable_entry_is_void(next) || next->base.seq != seq) {
+    err = world_error_no_such_key;
+    goto release;
+  }
+
+  struct world_hashtable_entry *entry = world_hashtable_entry_new_void(ht->allocator, hash, key);
+  atomic_fetch_sub_explicit(&ht->n_fresh_entries, 1, memory_order_relaxed);
+  _commit(ht, cursor, entry, found);
 
 release:
-  world_mutex_unlock(&ht->mtx);
+  world_mutex_unlock(stripe);
+  if (!err) {
+    _shrink(ht);
+  }
   return err;
 }
 
+enum world_error world_hashtable_update(struct world_hashtable *ht, struct world_buffer key, enum world_update (*fn)(void *ctx, const struct world_buffer *current, struct world_buffer *data), void *ctx)
+{
+  if (!key.base || !key.size || key.size > WORLD_MAX_KEY_SIZE || !fn) {
+    return world_error_invalid_argument;
+  }
+
+  enum world_error err = world_error_ok;
+  world_hash_type hash = world_hash(ht->hash_function, key.base, key.size, &ht->seed);
+  struct world_mutex *stripe = _stripe(ht, hash);
+  world_mutex_lock(stripe);
+
+  // The function runs under the stripe lock, so that nobody else writes the
+  // key between the read and the write.
+  struct world_hashtable_entry *cursor = NULL;
+  bool found = _find(ht, hash, key, &cursor);
+
+  struct world_hashtable_entry *next = atomic_load_explicit(&cursor->base.next, memory_order_relaxed);
+  bool exists = found && !world_hashtable_entry_is_void(next);
+  struct world_buffer current;
+  if (exists) {
+    current = world_hashtable_entry_data(next);
+  }
+  struct world_buffer data;
+  data.base = NULL;
+  data.size = 0;
+
+  struct world_hashtable_entry *entry = NULL;
+  switch (fn(ctx, exists ? &current : NULL, &data)) {
+  case world_update_none:
+    break;
+  case world_update_set:
+    if (!data.base || !data.size || data.size > WORLD_MAX_DATA_SIZE) {
+      err = world_error_invalid_argument;
+      break;
+    }
+    entry = world_hashtable_entry_new(ht->allocator, hash, key, data);
+    if (!exists) {
+      atomic_fetch_add_explicit(&ht->n_fresh_entries, 1, memory_order_relaxed);
+    }
+    break;
+  case world_update_delete:
+    if (!exists) {
+      err = world_error_no_such_key;
+      break;
+    }
+    entry = world_hashtable_entry_new_void(ht->allocator, hash, key);
+    atomic_fetch_sub_explicit(&ht->n_fresh_entries, 1, memory_order_relaxed);
+    break;
+  default:
+    err = world_error_invalid_argument;
+    break;
+  }
+  if (entry) {
+    _commit(ht, cursor, entry, found);
+  }
+
+  world_mutex_unlock(stripe);
+
+  if (entry) {
+    _grow(ht);
+    _shrink(ht);
+  }
+  return err;
+}
+
+enum world_error world_hashtable_write_batch(struct world_hashtable *ht, struct world_write *writes, size_t n_writes, struct world_hashtable_entry **linked)
+{
+  if (!writes && n_writes) {
+    return world_error_invalid_argument;
+  }
+  for (size_t i = 0; i < n_writes; i++) {
+    struct world_write *w = &writes[i];
+    if (!w->key.base || !w->key.size || w->key.size > WORLD_MAX_KEY_SIZE) {
+      return world_error_invalid_argument;
+    }
+    switch (w->operation) {
+    case world_operation_set:
+    case world_operation_add:
+    case world_operation_replace:
+      if (w->data.size > WORLD_MAX_DATA_SIZE) {
+        return world_error_invalid_argument;
+      }
+      break;
+    case world_operation_delete:
+      break;
+    default:
+      return world_error_invalid_argument;
+    }
+  }
+  if (n_writes == 0) {
+    return world_error_ok;
+  }
+
+  // Entries are generated before any lock is taken, except those which are
+  // likely to be overwritten in place. Then all the stripes involved are locked
+  // in ascending order, so that concurrent batches do not deadlock, and the log
+  // lock is taken once for the whole batch. Entries left unlinked are deleted
+  // after the locks are released.
+  struct world_hashtable_entry **entries = world_allocator_malloc(ht->allocator, sizeof(*entries) * n_writes);
+  world_hash_type *hashes = world_allocator_malloc(ht->allocator, sizeof(*hashes) * n_writes);
+  bool involved[WORLD_HASHTABLE_N_STRIPES];
+  memset(involved, 0, sizeof(involved));
+  for (size_t i = 0; i < n_writes; i++) {
+    hashes[i] = world_hash(ht->hash_function, writes[i].key.base, writes[i].key.size, &ht->seed);
+    entries[i] = _overwritable(ht, hashes[i], &writes[i]) ? NULL : _new_entry(ht, hashes[i], &writes[i]);
+    involved[_stripe_index(hashes[i])] = true;
+  }
+
+  for (size_t i = 0; i < WORLD_HASHTABLE_N_STRIPES; i++) {
+    if (involved[i]) {
+      world_mutex_lock(&ht->stripes[i].mtx);
+    }
+  }
+  world_mutex_lock(&ht->log_mtx);
+
+  for (size_t i = 0; i < n_writes; i++) {
+    struct world_write *w = &writes[i];
+    struct world_hashtable_entry *cursor = NULL;
+    bool found = _find(ht, hashes[i], w->key, &cursor);
+    struct world_hashtable_entry *next = atomic_load_explicit(&cursor->base.next, memory_order_relaxed);
+    bool exists = found && !world_hashtable_entry_is_void(next);
+
+    w->error = world_error_ok;
+    switch (w->operation) {
+    case world_operation_set:
+      if (!exists) {
+        atomic_fetch_add_explicit(&ht->n_fresh_entries, 1, memory_order_relaxed);
+      }
+      break;
+    case world_operation_add:
+      if (exists) {
+        w->error = world_error_key_exists;
+      } else {
+        atomic_fetch_add_explicit(&ht->n_fresh_entries, 1, memory_order_relaxed);
+      }
+      break;
+    case world_operation_replace:
+      if (!exists) {
+        w->error = world_error_no_such_key;
+      }
+      break;
+    case world_operation_delete:
+      if (!exists) {
+        w->error = world_error_no_such_key;
+      } else {
+        atomic_fetch_sub_explicit(&ht->n_fresh_entries, 1, memory_order_relaxed);
+      }
+      break;
+    }
+
+    if (w->error) {
+      if (linked) {
+        linked[i] = NULL;
+      }
+      continue;
+    }
+    if (exists && w->operation != world_operation_delete && _overwrite(ht, next, w->data)) {
+      if (linked) {
+        linked[i] = next;
+      }
+      continue;
+    }
+    if (!entries[i]) {
+      // The key has been written meanwhile, or earlier in the batch.
+      entries[i] = _new_entry(ht, hashes[i], w);
+    }
+    if (linked) {
+      linked[i] = entries[i];
+    }
+    _link(ht, cursor, entries[i], found);
+    entries[i] = NULL;
+  }
+  // Readers see the whole batch at once.
+  atomic_store_explicit(&ht->visible, _greatest_sequence(ht), memory_order_release);
+  _supersede(ht);
+
+  world_mutex_unlock(&ht->log_mtx);
+  for (size_t i = 0; i < WORLD_HASHTABLE_N_STRIPES; i++) {
+    if (involved[i]) {
+      world_mutex_unlock(&ht->stripes[i].mtx);
+    }
+  }
+
+  for (size_t i = 0; i < n_writes; i++) {
+    if (entries[i]) {
+      world_hashtable_entry_delete(entries[i], ht->allocator);
+    }
+  }
+  world_allocator_free(ht->allocator, hashes);
+  world_allocator_free(ht->allocator, entries);
+
+  _grow(ht);
+  _shrink(ht);
+
+  return world_error_ok;
+}
+
 struct world_hashtable_entry *world_hashtable_front(struct world_hashtable *ht)
 {
   return world_hashtable_bucket_front(&ht->bucket);
@@ -240,34 +676,221 @@ struct world_hashtable_entry *world_hashtable_log(struct world_hashtable *ht)
   return world_hashtable_log_back(&ht->log);
 }
 
-void world_hashtable_checkpoint(struct world_hashtable *ht, world_sequence seq, struct world_circular *garbages)
+world_sequence world_hashtable_acquire_sequence(struct world_hashtable *ht)
+{
+  // No checkpoint runs in the meantime, so that nothing visible at the
+  // sequence has been reclaimed yet.
+  world_mutex_lock(&ht->mtx);
+  WORLD_ASSERT(!ht->lean);
+  world_mutex_lock(&ht->log_mtx);
+  world_sequence seq = world_hashtable_log_greatest_sequence(&ht->log);
+  world_mutex_unlock(&ht->log_mtx);
+  world_vector_push_back(&ht->sequences, &seq, sizeof(seq));
+  world_mutex_unlock(&ht->mtx);
+  return seq;
+}
+
+void world_hashtable_release_sequence(struct world_hashtable *ht, world_sequence seq)
 {
   world_mutex_lock(&ht->mtx);
+  for (size_t i = 0; i < world_vector_size(&ht->sequences); i++) {
+    world_sequence *position = world_vector_at(&ht->sequences, i, sizeof(*position));
+    if (*position == seq) {
+      *position = *(world_sequence *)world_vector_back(&ht->sequences, sizeof(*position));
+      world_vector_pop_back(&ht->sequences);
+      break;
+    }
+  }
+  world_mutex_unlock(&ht->mtx);
+}
+
+void world_hashtable_partition(struct world_hashtable *ht, size_t i, size_t n, struct world_hashtable_entry **begin, struct world_hashtable_entry **end)
+{
+  // The partitions are aligned to the stripes, whose boundary buckets always
+  // exist, so that they never move while the partitions are walked.
+  WORLD_ASSERT(0 < n && n <= WORLD_HASHTABLE_N_STRIPES && i < n);
+  const int shift = sizeof(world_hash_type) * CHAR_BIT - WORLD_HASHTABLE_STRIPE_BITS;
+  size_t first = i * WORLD_HASHTABLE_N_STRIPES / n;
+  size_t last = (i + 1) * WORLD_HASHTABLE_N_STRIPES / n;
+  *begin = world_hashtable_bucket_find(&ht->bucket, (world_hash_type)first << shift);
+  *end = last < WORLD_HASHTABLE_N_STRIPES ? world_hashtable_bucket_find(&ht->bucket, (world_hash_type)last << shift) : NULL;
+}
 
-  while (seq > world_hashtable_log_least_sequence(&ht->log)) {
+struct world_hashtable_entry *world_hashtable_advance(struct world_hashtable *ht, struct world_hashtable_entry **cursor, struct world_hashtable_entry *end, world_sequence seq)
+{
+  // The caller pins the sequence, which keeps the entry under the cursor
+  // alive. The epoch protects what we pass over on the way to the next one.
+  size_t slot = world_epoch_enter(&ht->epoch);
+  struct world_hashtable_entry *entry = world_hashtable_entry_advance(cursor, end, seq);
+  world_epoch_leave(&ht->epoch, slot);
+  return entry;
+}
+
+void world_hashtable_enable_eviction(struct world_hashtable *ht)
+{
+  const size_t n_words = ((size_t)1 << WORLD_HASHTABLE_REFERENCE_BITS) / 64;
+  ht->referenced = world_allocator_calloc(ht->allocator, n_words, sizeof(*ht->referenced));
+}
+
+void world_hashtable_enable_lean(struct world_hashtable *ht)
+{
+  WORLD_ASSERT(_greatest_sequence(ht) == 0);
+  ht->lean = true;
+}
+
+void world_hashtable_enable_in_place(struct world_hashtable *ht)
+{
+  // Only the newest version of a key is kept while it is overwritten, which
+  // would be seen by snapshots otherwise.
+  WORLD_ASSERT(ht->lean);
+  ht->in_place = true;
+}
+
+size_t world_hashtable_evict(struct world_hashtable *ht, size_t max_bytes, size_t n_bytes)
+{
+  // Only the newest versions count against the limit. Evicted versions stay
+  // stale until a checkpoint reclaims them, and stale bytes piled up by lagging
+  // replicas would make us evict keys that have no part in it. Keys of about
+  // the given bytes are evicted at most, rather than until the bytes fit.
+  WORLD_ASSERT(ht->referenced);
+  world_mutex_lock(&ht->evict_mtx);
+
+  // The hand goes around the keys at most once, so that a key being read
+  // keeps its second chance until the next call.
+  size_t n_evicted = 0;
+  size_t n_scans = 0;
+  size_t max_scans = atomic_load_explicit(&ht->n_fresh_entries, memory_order_relaxed) + 1;
+  if (max_scans > WORLD_HASHTABLE_MAX_EVICTION_SCANS) {
+    max_scans = WORLD_HASHTABLE_MAX_EVICTION_SCANS;
+  }
+  while (n_evicted < n_bytes && world_hashtable_live_bytes(ht) > max_bytes) {
+    // The victim is deleted while we are still in the epoch, which keeps its
+    // key alive. The deletion fails if the key has been written meanwhile.
+    size_t slot = world_epoch_enter(&ht->epoch);
+    struct world_hashtable_entry *victim = _clock(ht, &n_scans, max_scans);
+    if (victim && !world_hashtable_expire(ht, world_hashtable_entry_key(victim), victim->base.seq)) {
+      n_evicted += world_hashtable_entry_size(victim);
+    }
+    world_epoch_leave(&ht->epoch, slot);
+    if (!victim) {
+      break;
+    }
+  }
+
+  world_mutex_unlock(&ht->evict_mtx);
+  return n_evicted;
+}
+
+size_t world_hashtable_live_bytes(struct world_hashtable *ht)
+{
+  return atomic_load_explicit(&ht->n_live_bytes, memory_order_relaxed);
+}
+
+size_t world_hashtable_stale_bytes(struct world_hashtable *ht)
+{
+  return atomic_load_explicit(&ht->n_stale_bytes, memory_order_relaxed);
+}
+
+bool world_hashtable_checkpoint(struct world_hashtable *ht, world_sequence seq, struct world_circular *garbages)
+{
+  world_mutex_lock(&ht->mtx);
+
+  // Nothing visible at the sequences acquired by snapshots is reclaimed.
+  for (size_t i = 0; i < world_vector_size(&ht->sequences); i++) {
+    world_sequence *acquired = world_vector_at(&ht->sequences, i, sizeof(*acquired));
+    if (seq > *acquired) {
+      seq = *acquired;
+    }
+  }
+
+  // A call does a limited amount of work, counted in entries, so that catching
+  // up with a slow replica does not hold the locks for long at once. What is
+  // left is done by the following calls.
+  size_t budget = WORLD_HASHTABLE_CHECKPOINT_BUDGET;
+
+  // Garbages are taken out of the heap under the log lock, and then unlinked
+  // under the stripe locks, since writers hold a stripe lock when they take the
+  // log lock.
+  world_mutex_lock(&ht->log_mtx);
+  size_t n_retired = world_circular_size(&ht->retired);
+  while (budget > 0 && !ht->lean && seq > world_hashtable_log_least_sequence(&ht->log)) {
     world_hashtable_log_pop_front(&ht->log);
+    budget--;
+  }
+  while (budget > 0 && world_vector_size(&ht->garbages) > 0) {
+    struct _garbage *garbage = world_vector_front(&ht->garbages);
+    if (garbage->seq >= world_hashtable_log_least_sequence(&ht->log)) {
+      break;
+    }
+    struct _retired retired;
+    retired.epoch = 0;
+    retired.entry = garbage->entry;
+    world_circular_push_back(&ht->retired, &retired, sizeof(retired));
+    world_vector_pop_heap(&ht->garbages, sizeof(*garbage), _garbage_heap_property);
+    budget--;
+  }
+  world_mutex_unlock(&ht->log_mtx);
+
+  _unlink_garbages(ht, n_retired);
+
+  // Superseded versions of a lean hashtable have already been unlinked, and
+  // only need to be tagged with the others. They are tagged here rather than
+  // when they are unlinked, since the caller may still refer to them from
+  // elsewhere until the checkpoint, as a replica does from its ordered index.
+  world_mutex_lock(&ht->log_mtx);
+  struct _retired *superseded = NULL;
+  while ((superseded = world_circular_front(&ht->superseded, sizeof(*superseded)))) {
+    world_circular_push_back(&ht->retired, superseded, sizeof(*superseded));
+    world_circular_pop_front(&ht->superseded);
   }
+  world_mutex_unlock(&ht->log_mtx);
 
-  while (world_vector_size(&ht->garbages) > 0) {
-    struct world_hashtable_entry **position = world_vector_front(&ht->garbages);
-    if ((*position)->base.seq >= world_hashtable_log_least_sequence(&ht->log)) {
+  // Unspliced buckets have already been unlinked. They are retired as well,
+  // once the log no longer contains anything written before they were
+  // unspliced, since snapshot cursors may still be standing on them.
+  struct _unspliced *unspliced = NULL;
+  while (budget > 0 && (unspliced = world_circular_front(&ht->unspliced, sizeof(*unspliced)))) {
+    if (!ht->lean && unspliced->seq >= world_hashtable_log_least_sequence(&ht->log)) {
       break;
     }
-    _unlink_garbage(ht, *position);
-    if (garbages) {
-      world_circular_push_back(garbages, position, sizeof(*position));
-    } else {
-      world_hashtable_entry_delete(*position, ht->allocator);
+    struct _retired retired;
+    retired.epoch = 0;
+    retired.entry = unspliced->bucket;
+    world_circular_push_back(&ht->retired, &retired, sizeof(retired));
+    world_circular_pop_front(&ht->unspliced);
+    budget--;
+  }
+
+  // Tag the entries unlinked above with the current epoch at once.
+  if (world_circular_size(&ht->retired) > n_retired) {
+    uint64_t epoch = world_epoch_advance(&ht->epoch);
+    for (size_t i = n_retired; i < world_circular_size(&ht->retired); i++) {
+      struct _retired *retired = world_circular_at(&ht->retired, i, sizeof(*retired));
+      retired->epoch = epoch;
     }
-    world_vector_pop_heap(&ht->garbages, sizeof(*position), _garbage_heap_property);
   }
 
+  budget -= _reclaim_retired(ht, world_epoch_least(&ht->epoch), garbages, budget);
+
   world_mutex_unlock(&ht->mtx);
+  return budget > 0;
 }
 
 static float _load_factor(struct world_hashtable *ht)
 {
-  return (float)ht->n_fresh_entries / world_hashtable_bucket_size(&ht->bucket);
+  return (float)atomic_load_explicit(&ht->n_fresh_entries, memory_order_relaxed) / world_hashtable_bucket_size(&ht->bucket);
+}
+
+static size_t _stripe_index(world_hash_type hash)
+{
+  // There are always buckets at the boundaries of the stripes, so an entry and
+  // its predecessors up to the bucket always belong to the same stripe.
+  return hash >> (sizeof(hash) * CHAR_BIT - WORLD_HASHTABLE_STRIPE_BITS);
+}
+
+static struct world_mutex *_stripe(struct world_hashtable *ht, world_hash_type hash)
+{
+  return &ht->stripes[_stripe_index(hash)].mtx;
 }
 
 static bool _find(struct world_hashtable *ht, world_hash_type hash, struct world_buffer key, struct world_hashtable_entry **cursor)
@@ -288,69 +911,441 @@ static bool _find(struct world_hashtable *ht, world_hash_type hash, struct world
   }
 }
 
-static void _append_bucket(struct world_hashtable *ht)
+static struct world_hashtable_entry *_lookup(struct world_hashtable *ht, world_hash_type hash, struct world_buffer key)
 {
-  if (_load_factor(ht) > 0.9f) {
-    world_hashtable_bucket_append(&ht->bucket, ht->allocator);
-  }
+  struct world_hashtable_entry *bucket = world_hashtable_bucket_find(&ht->bucket, hash);
+  return _resolve(ht, atomic_load_explicit(&bucket->base.next, memory_order_acquire), hash, key);
 }
 
-static void _mark_garbage(struct world_hashtable *ht, struct world_hashtable_entry *entry)
+static struct world_hashtable_entry *_resolve(struct world_hashtable *ht, struct world_hashtable_entry *cursor, world_hash_type hash, struct world_buffer key)
 {
-  world_vector_push_heap(&ht->garbages, &entry, sizeof(entry),_garbage_heap_property);
+  // Unlike _find(), the list may be modified while we are walking along it,
+  // so we return the entry we have compared rather than a cursor before it.
+  for (; cursor; cursor = atomic_load_explicit(&cursor->base.next, memory_order_acquire)) {
+    if (cursor->base.hash > hash) {
+      return NULL;
+    }
+    // We may pass over a bucket that has been appended after we found a
+    // coarser one.
+    if (cursor->base.hash == hash && !world_hashtable_entry_is_bucket(cursor)) {
+      struct world_buffer k = world_hashtable_entry_key(cursor);
+      if (k.size == key.size && memcmp(key.base, k.base, k.size) == 0) {
+        return _visible_version(ht, cursor, hash, key);
+      }
+    }
+  }
+  return NULL;
 }
 
-static void _unlink_garbage(struct world_hashtable *ht, struct world_hashtable_entry *entry)
+static struct world_hashtable_entry *_visible_version(struct world_hashtable *ht, struct world_hashtable_entry *entry, world_hash_type hash, struct world_buffer key)
 {
-  // We know what to be removed from the hashtable, so we use an optimized way,
-  // instead of _find(), to find an entry to be unlinked.
-  struct world_hashtable_entry *cursor = world_hashtable_bucket_find(&ht->bucket, entry->base.hash);
+  // The newest version is visible unless a batch linking it is in progress, in
+  // which case the older one is, or none if the batch adds the key.
+  world_sequence visible = atomic_load_explicit(&ht->visible, memory_order_acquire);
+  if (entry->base.seq <= visible) {
+    return entry;
+  }
+  struct world_hashtable_entry *version = entry;
   for (;;) {
-    // Check a next entry
-    struct world_hashtable_entry *next = atomic_load_explicit(&cursor->base.next, memory_order_relaxed);
-    if (next == entry) {
-      WORLD_ASSERT(next->stale == NULL);
-      struct world_hashtable_entry *nextnext = atomic_load_explicit(&next->base.next, memory_order_relaxed);
-      atomic_store_explicit(&cursor->base.next, nextnext, memory_order_release);
-      return;
+    version = atomic_load_explicit(&version->base.next, memory_order_acquire);
+    if (!version || version->base.hash != hash || world_hashtable_entry_is_bucket(version)) {
+      break;
     }
-    cursor = next;
-
-    if (world_hashtable_entry_is_bucket(cursor)) {
-      continue;
+    struct world_buffer k = world_hashtable_entry_key(version);
+    if (k.size != key.size || memcmp(key.base, k.base, k.size) != 0) {
+      break;
+    }
+    if (version->base.seq <= visible) {
+      return version;
     }
+  }
+  // The older versions may have been reclaimed since the batch was published.
+  return entry->base.seq <= atomic_load_explicit(&ht->visible, memory_order_acquire) ? entry : NULL;
+}
+
+static void _commit(struct world_hashtable *ht, struct world_hashtable_entry *cursor, struct world_hashtable_entry *entry, bool found)
+{
+  world_mutex_lock(&ht->log_mtx);
+  _link(ht, cursor, entry, found);
+  atomic_store_explicit(&ht->visible, entry->base.seq, memory_order_release);
+  _supersede(ht);
+  world_mutex_unlock(&ht->log_mtx);
+}
+
+static void _link(struct world_hashtable *ht, struct world_hashtable_entry *cursor, struct world_hashtable_entry *entry, bool found)
+{
+  // The entry is linked into the list before it is appended to the log, so
+  // that whoever finds it in the log also finds it in the list. The caller
+  // holds the log lock.
+  entry->base.seq = _greatest_sequence(ht) + 1;
 
-    // Check a stale entry
-    struct world_hashtable_entry *stale = atomic_load_explicit(&cursor->stale, memory_order_relaxed);
-    if (stale == entry) {
-      WORLD_ASSERT(stale->stale == NULL);
-      atomic_store_explicit(&cursor->stale, NULL, memory_order_release);
-      return;
+  struct world_hashtable_entry *next = atomic_load_explicit(&cursor->base.next, memory_order_relaxed);
+  if (found) {
+    // The superseded version is last visible just before the new one. A void
+    // entry has already been marked when it was generated.
+    if (!world_hashtable_entry_is_void(next)) {
+      if (!ht->lean) {
+        _mark_garbage(ht, next, entry->base.seq - 1);
+      }
+      size_t size = world_hashtable_entry_size(next);
+      atomic_fetch_sub_explicit(&ht->n_live_bytes, size, memory_order_relaxed);
+      atomic_fetch_add_explicit(&ht->n_stale_bytes, size, memory_order_relaxed);
     }
+  }
+  // The stale version stays in the list behind the new one, since snapshot
+  // cursors may still need it.
+  atomic_store_explicit(&entry->base.next, next, memory_order_relaxed);
+  if (world_hashtable_entry_is_void(entry)) {
+    if (!ht->lean) {
+      _mark_garbage(ht, entry, entry->base.seq);
+    }
+    atomic_fetch_add_explicit(&ht->n_stale_bytes, world_hashtable_entry_size(entry), memory_order_relaxed);
+  } else {
+    atomic_fetch_add_explicit(&ht->n_live_bytes, world_hashtable_entry_size(entry), memory_order_relaxed);
+  }
+  atomic_store_explicit(&cursor->base.next, entry, memory_order_release);
 
-    if (stale == NULL || cursor->base.hash != entry->base.hash) {
-      continue;
+  if (ht->lean) {
+    ht->greatest = entry->base.seq;
+    world_vector_push_back(&ht->superseding, &entry, sizeof(entry));
+    return;
+  }
+  world_hashtable_log_push_back(&ht->log, entry);
+}
+
+static struct world_hashtable_entry *_new_entry(struct world_hashtable *ht, world_hash_type hash, const struct world_write *w)
+{
+  if (w->operation == world_operation_delete) {
+    return world_hashtable_entry_new_void(ht->allocator, hash, w->key);
+  }
+  return world_hashtable_entry_new(ht->allocator, hash, w->key, w->data);
+}
+
+static bool _overwrite(struct world_hashtable *ht, struct world_hashtable_entry *entry, struct world_buffer data)
+{
+  // A version linked by the batch in progress is not visible yet, and it is
+  // superseded rather than overwritten so as not to be seen early. The caller
+  // holds the stripe lock of the entry and the log lock.
+  if (!ht->in_place ||
+      entry->base.seq > atomic_load_explicit(&ht->visible, memory_order_relaxed) ||
+      world_hashtable_entry_data(entry).size != data.size) {
+    return false;
+  }
+  world_hashtable_entry_overwrite(entry, data);
+  return true;
+}
+
+static bool _overwritable(struct world_hashtable *ht, world_hash_type hash, const struct world_write *w)
+{
+  // Tells whether the write will overwrite the newest version in place, as far
+  // as we can see before the locks are taken. The caller generates the entry
+  // under the locks if it turns out wrong.
+  if (!ht->in_place || w->operation == world_operation_delete) {
+    return false;
+  }
+  size_t slot = world_epoch_enter(&ht->epoch);
+  struct world_hashtable_entry *entry = _lookup(ht, hash, w->key);
+  bool overwritable = entry && !world_hashtable_entry_is_void(entry) && world_hashtable_entry_data(entry).size == w->data.size;
+  world_epoch_leave(&ht->epoch, slot);
+  return overwritable;
+}
+
+static void _supersede(struct world_hashtable *ht)
+{
+  // Once the entries just linked are visible, a lean hashtable unlinks the
+  // versions they have superseded, and the void entries themselves. The caller
+  // holds the stripe locks of the entries and the log lock.
+  size_t n = world_vector_size(&ht->superseding);
+  if (n == 0) {
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    struct world_hashtable_entry *entry = *(struct world_hashtable_entry **)world_vector_at(&ht->superseding, i, sizeof(entry));
+    struct world_hashtable_entry *next = atomic_load_explicit(&entry->base.next, memory_order_relaxed);
+    struct _retired retired;
+    retired.epoch = 0;
+    if (next && !world_hashtable_entry_is_bucket(next) && _same_key(entry, next)) {
+      atomic_store_explicit(&entry->base.next, atomic_load_explicit(&next->base.next, memory_order_relaxed), memory_order_release);
+      retired.entry = next;
+      world_circular_push_back(&ht->superseded, &retired, sizeof(retired));
+    }
+    // A void entry superseded later in the same batch is unlinked along with
+    // the older versions of the entry that superseded it.
+    struct world_hashtable_entry *cursor = NULL;
+    if (world_hashtable_entry_is_void(entry) &&
+        _find(ht, entry->base.hash, world_hashtable_entry_key(entry), &cursor) &&
+        atomic_load_explicit(&cursor->base.next, memory_order_relaxed) == entry) {
+      atomic_store_explicit(&cursor->base.next, atomic_load_explicit(&entry->base.next, memory_order_relaxed), memory_order_release);
+      retired.entry = entry;
+      world_circular_push_back(&ht->superseded, &retired, sizeof(retired));
     }
+  }
+  world_vector_clear(&ht->superseding);
+}
+
+static bool _same_key(struct world_hashtable_entry *x, struct world_hashtable_entry *y)
+{
+  struct world_buffer xkey = world_hashtable_entry_key(x);
+  struct world_buffer ykey = world_hashtable_entry_key(y);
+  return x->base.hash == y->base.hash &&
+         xkey.size == ykey.size &&
+         memcmp(xkey.base, ykey.base, xkey.size) == 0;
+}
+
+static world_sequence _greatest_sequence(struct world_hashtable *ht)
+{
+  return ht->lean ? ht->greatest : world_hashtable_log_greatest_sequence(&ht->log);
+}
 
-    // Check stale entries, recursively
-    for (;;) {
-      struct world_hashtable_entry *stalestale = atomic_load_explicit(&stale->stale, memory_order_relaxed);
-      if (stalestale == NULL) {
-        break;
+static void _grow(struct world_hashtable *ht)
+{
+  if (_load_factor(ht) <= ht->max_load_factor) {
+    return;
+  }
+
+  world_mutex_lock(&ht->grow_mtx);
+  if (_load_factor(ht) > ht->max_load_factor) {
+    // Doubles the buckets. The new buckets of a stripe are those whose indices
+    // have the same least significant bits as the stripe, so that we lock each
+    // stripe only once. They are published after all of them are spliced.
+    size_t size = world_hashtable_bucket_size(&ht->bucket);
+    for (size_t i = size; i < size + WORLD_HASHTABLE_N_STRIPES; i++) {
+      struct world_mutex *stripe = _stripe(ht, world_hash_reverse(i));
+      world_mutex_lock(stripe);
+      for (size_t j = i; j < size * 2; j += WORLD_HASHTABLE_N_STRIPES) {
+        world_hashtable_bucket_splice(&ht->bucket, j, ht->allocator);
       }
-      if (stalestale == entry) {
-        WORLD_ASSERT(stalestale->stale == NULL);
-        atomic_store_explicit(&stale->stale, NULL, memory_order_relaxed);
-        return;
+      world_mutex_unlock(stripe);
+    }
+    world_hashtable_bucket_publish(&ht->bucket, size * 2);
+  }
+  world_mutex_unlock(&ht->grow_mtx);
+}
+
+static void _shrink(struct world_hashtable *ht)
+{
+  if (_load_factor(ht) >= ht->max_load_factor / 4) {
+    return;
+  }
+
+  world_mutex_lock(&ht->grow_mtx);
+  size_t size = world_hashtable_bucket_size(&ht->bucket);
+  if (size > ht->min_bucket_size && _load_factor(ht) < ht->max_load_factor / 4) {
+    // Halves the buckets, in the reverse order of _grow(). Lookups stop
+    // starting from the upper half first, and then those buckets are unspliced
+    // one stripe at a time. Their segments are kept for the next growth.
+    size_t half = size / 2;
+    world_hashtable_bucket_truncate(&ht->bucket, half);
+    struct world_vector buckets;
+    world_vector_init(&buckets, ht->allocator);
+    for (size_t i = half; i < half + WORLD_HASHTABLE_N_STRIPES; i++) {
+      struct world_mutex *stripe = _stripe(ht, world_hash_reverse(i));
+      world_mutex_lock(stripe);
+      for (size_t j = i; j < size; j += WORLD_HASHTABLE_N_STRIPES) {
+        struct world_hashtable_entry *bucket = world_hashtable_bucket_unsplice(&ht->bucket, j);
+        world_vector_push_back(&buckets, &bucket, sizeof(bucket));
       }
-      stale = stalestale;
+      world_mutex_unlock(stripe);
     }
+
+    world_mutex_lock(&ht->mtx);
+    world_mutex_lock(&ht->log_mtx);
+    world_sequence seq = _greatest_sequence(ht);
+    world_mutex_unlock(&ht->log_mtx);
+    for (size_t i = 0; i < world_vector_size(&buckets); i++) {
+      struct _unspliced unspliced;
+      unspliced.seq = seq;
+      unspliced.bucket = *(struct world_hashtable_entry **)world_vector_at(&buckets, i, sizeof(unspliced.bucket));
+      world_circular_push_back(&ht->unspliced, &unspliced, sizeof(unspliced));
+    }
+    world_mutex_unlock(&ht->mtx);
+    world_vector_destroy(&buckets);
   }
+  world_mutex_unlock(&ht->grow_mtx);
 }
 
-static bool _garbage_heap_property(const void *x, const void *y)
+static void _mark_garbage(struct world_hashtable *ht, struct world_hashtable_entry *entry, world_sequence seq)
 {
+  struct _garbage garbage;
+  garbage.seq = seq;
+  garbage.entry = entry;
+  world_vector_push_heap(&ht->garbages, &garbage, sizeof(garbage), _garbage_heap_property);
+}
+
+static void _unlink_garbages(struct world_hashtable *ht, size_t begin)
+{
+  // Stale versions of a hot key pile up behind the newest one, and the oldest
+  // ones are retired first. Unlinking them one by one from the bucket would
+  // take quadratic time, so those sharing a hash are unlinked in a single walk.
+  world_vector_clear(&ht->unlinking);
+  for (size_t i = begin; i < world_circular_size(&ht->retired); i++) {
+    struct _retired *retired = world_circular_at(&ht->retired, i, sizeof(*retired));
+    world_vector_push_back(&ht->unlinking, &retired->entry, sizeof(retired->entry));
+  }
+  size_t n = world_vector_size(&ht->unlinking);
+  if (n == 0) {
+    return;
+  }
+  struct world_hashtable_entry **entries = world_vector_front(&ht->unlinking);
+  qsort(entries, n, sizeof(*entries), _unlinking_order);
+
+  for (size_t i = 0; i < n;) {
+    size_t j = i + 1;
+    while (j < n &&
+           entries[j]->base.hash == entries[i]->base.hash &&
+           world_hashtable_entry_is_void(entries[j]) == world_hashtable_entry_is_void(entries[i])) {
+      j++;
+    }
+    struct world_mutex *stripe = _stripe(ht, entries[i]->base.hash);
+    world_mutex_lock(stripe);
+    _unlink_run(ht, &entries[i], j - i);
+    world_mutex_unlock(stripe);
+    i = j;
+  }
+}
+
+static void _unlink_run(struct world_hashtable *ht, struct world_hashtable_entry **run, size_t n_run)
+{
+  // The run is sorted by address, and all of its entries have the same hash
+  // and are either void or not.
+  world_hash_type hash = run[0]->base.hash;
+  struct world_hashtable_entry *cursor = world_hashtable_bucket_find(&ht->bucket, hash);
+  size_t n_left = n_run;
+  while (n_left > 0) {
+    struct world_hashtable_entry *next = atomic_load_explicit(&cursor->base.next, memory_order_relaxed);
+    WORLD_ASSERT(next && next->base.hash <= hash);
+    if (next->base.hash == hash && bsearch(&next, run, n_run, sizeof(*run), _pointer_order)) {
+      struct world_hashtable_entry *nextnext = atomic_load_explicit(&next->base.next, memory_order_relaxed);
+      atomic_store_explicit(&cursor->base.next, nextnext, memory_order_release);
+      n_left--;
+      continue;
+    }
+    cursor = next;
+  }
+}
+
+static int _unlinking_order(const void *x, const void *y)
+{
+  // Void entries are unlinked after the versions they have deleted, so that
+  // readers never see a deleted version.
   struct world_hashtable_entry *const *xx = x;
   struct world_hashtable_entry *const *yy = y;
-  return (*xx)->base.seq <= (*yy)->base.seq;
+  if ((*xx)->base.hash != (*yy)->base.hash) {
+    return (*xx)->base.hash < (*yy)->base.hash ? -1 : 1;
+  }
+  bool xvoid = world_hashtable_entry_is_void(*xx);
+  bool yvoid = world_hashtable_entry_is_void(*yy);
+  if (xvoid != yvoid) {
+    return xvoid ? 1 : -1;
+  }
+  return _pointer_order(x, y);
+}
+
+static int _pointer_order(const void *x, const void *y)
+{
+  uintptr_t xx = (uintptr_t)*(void *const *)x;
+  uintptr_t yy = (uintptr_t)*(void *const *)y;
+  return xx < yy ? -1 : xx > yy;
+}
+
+static size_t _reclaim_retired(struct world_hashtable *ht, uint64_t epoch, struct world_circular *garbages, size_t budget)
+{
+  size_t n_reclaimed = 0;
+  struct _retired *retired = NULL;
+  while (n_reclaimed < budget && (retired = world_circular_front(&ht->retired, sizeof(*retired)))) {
+    if (retired->epoch >= epoch) {
+      break;
+    }
+    if (world_hashtable_entry_is_bucket(retired->entry)) {
+      world_hashtable_entry_delete_bucket(retired->entry, ht->allocator);
+    } else {
+      atomic_fetch_sub_explicit(&ht->n_stale_bytes, world_hashtable_entry_size(retired->entry), memory_order_relaxed);
+      if (garbages) {
+        world_circular_push_back(garbages, &retired->entry, sizeof(retired->entry));
+      } else {
+        world_hashtable_entry_delete(retired->entry, ht->allocator);
+      }
+    }
+    world_circular_pop_front(&ht->retired);
+    n_reclaimed++;
+  }
+  return n_reclaimed;
+}
+
+static bool _garbage_heap_property(const void *x, const void *y)
+{
+  const struct _garbage *xx = x;
+  const struct _garbage *yy = y;
+  return xx->seq <= yy->seq;
+}
+
+static void _reference(struct world_hashtable *ht, world_hash_type hash)
+{
+  // Readers set the reference bit of one read in every few, and only when it
+  // is not set yet, so that reading hot keys does not keep writing the same
+  // cache line. A key that is read often enough is still marked.
+  static _Thread_local unsigned n_reads;
+  if (!ht->referenced || n_reads++ % WORLD_HASHTABLE_REFERENCE_SAMPLING) {
+    return;
+  }
+  size_t index = hash >> (sizeof(hash) * CHAR_BIT - WORLD_HASHTABLE_REFERENCE_BITS);
+  _Atomic(uint64_t) *word = &ht->referenced[index / 64];
+  uint64_t bit = (uint64_t)1 << index % 64;
+  if (!(atomic_load_explicit(word, memory_order_relaxed) & bit)) {
+    atomic_fetch_or_explicit(word, bit, memory_order_relaxed);
+  }
+}
+
+static bool _test_and_clear_reference(struct world_hashtable *ht, world_hash_type hash)
+{
+  size_t index = hash >> (sizeof(hash) * CHAR_BIT - WORLD_HASHTABLE_REFERENCE_BITS);
+  _Atomic(uint64_t) *word = &ht->referenced[index / 64];
+  uint64_t bit = (uint64_t)1 << index % 64;
+  if (!(atomic_load_explicit(word, memory_order_relaxed) & bit)) {
+    return false;
+  }
+  atomic_fetch_and_explicit(word, ~bit, memory_order_relaxed);
+  return true;
+}
+
+static struct world_hashtable_entry *_clock(struct world_hashtable *ht, size_t *n_scans, size_t max_scans)
+{
+  // The hand is a position in the hash order rather than an entry, since the
+  // entry it stopped at may have been reclaimed since. The first version of a
+  // key we meet is the newest one, and a referenced key gets a second chance.
+  // The caller is in the epoch.
+  world_hash_type from = ht->hand;
+  struct world_hashtable_entry *cursor = world_hashtable_bucket_find(&ht->bucket, from);
+  struct world_hashtable_entry *previous = NULL;
+  while (*n_scans < max_scans) {
+    cursor = atomic_load_explicit(&cursor->base.next, memory_order_acquire);
+    if (!cursor) {
+      // Wrapping around counts as a scan, so that an empty list ends the walk.
+      (*n_scans)++;
+      from = 0;
+      cursor = world_hashtable_front(ht);
+      previous = NULL;
+      continue;
+    }
+    if (world_hashtable_entry_is_bucket(cursor) || cursor->base.hash < from) {
+      continue;
+    }
+    if (previous && previous->base.hash == cursor->base.hash) {
+      struct world_buffer x = world_hashtable_entry_key(previous);
+      struct world_buffer y = world_hashtable_entry_key(cursor);
+      if (x.size == y.size && memcmp(x.base, y.base, x.size) == 0) {
+        continue;
+      }
+    }
+    previous = cursor;
+    (*n_scans)++;
+    // The hand wraps around to 0 past the greatest hash, i.e. it goes back to
+    // the front, where the walk goes next anyway.
+    ht->hand = cursor->base.hash + 1;
+    if (world_hashtable_entry_is_void(cursor) || _test_and_clear_reference(ht, cursor->base.hash)) {
+      continue;
+    }
+    return cursor;
+  }
+  return NULL;
 }
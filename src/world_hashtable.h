@@ -24,33 +24,105 @@
 
 #include <stdbool.h>
 #include <world.h>
+#include "world_circular.h"
+#include "world_epoch.h"
 #include "world_hash.h"
 #include "world_hashtable_bucket.h"
 #include "world_hashtable_log.h"
 #include "world_mutex.h"
 #include "world_vector.h"
 
+#define WORLD_HASHTABLE_STRIPE_BITS 8
+#define WORLD_HASHTABLE_N_STRIPES (1 << WORLD_HASHTABLE_STRIPE_BITS)
+#define WORLD_HASHTABLE_CACHE_LINE_SIZE 64
+#define WORLD_HASHTABLE_N_PREFETCHES 16
+#define WORLD_HASHTABLE_REFERENCE_BITS 23
+#define WORLD_HASHTABLE_REFERENCE_SAMPLING 4
+#define WORLD_HASHTABLE_MAX_EVICTION_SCANS 1024
+#define WORLD_HASHTABLE_CHECKPOINT_BUDGET 1024
+
 struct world_allocator;
-struct world_circular;
 struct world_hashtable_entry;
 
+// Writers lock one of the stripes, each of which covers a contiguous range of
+// the split-ordered list. The sequence and the log are protected by a lock
+// that is only held while an entry is being linked.
+struct world_hashtable_stripe {
+  struct world_mutex mtx;
+  char padding[WORLD_HASHTABLE_CACHE_LINE_SIZE - sizeof(struct world_mutex) % WORLD_HASHTABLE_CACHE_LINE_SIZE];
+};
+
 struct world_hashtable {
   struct world_allocator *allocator;
   struct world_mutex mtx;
+  struct world_mutex log_mtx;
+  struct world_mutex grow_mtx;
+  struct world_mutex evict_mtx;
+  struct world_hashtable_stripe stripes[WORLD_HASHTABLE_N_STRIPES];
+  struct world_epoch epoch;
   struct world_hashtable_bucket bucket;
   struct world_hashtable_log log;
   struct world_vector garbages;
-  world_hash_type seed;
-  size_t n_fresh_entries;
+  struct world_vector unlinking;
+  struct world_vector sequences;
+  struct world_circular retired;
+  struct world_vector superseding;
+  struct world_circular superseded;
+  struct world_circular unspliced;
+  size_t min_bucket_size;
+  enum world_hash_function hash_function;
+  struct world_hash_seed seed;
+  float max_load_factor;
+  // The greatest sequence readers see. Entries linked by a batch beyond it are
+  // skipped in favor of their older versions until the whole batch is linked.
+  _Atomic(world_sequence) visible;
+  _Atomic(size_t) n_fresh_entries;
+  _Atomic(size_t) n_pins;
+  // Bytes of the newest versions, and of stale versions and void entries that
+  // are kept until a checkpoint reclaims them. The log consists of the same
+  // entries, so it takes no bytes of its own.
+  _Atomic(size_t) n_live_bytes;
+  _Atomic(size_t) n_stale_bytes;
+  // Reference bits of the CLOCK eviction, indexed by the upper bits of hashes.
+  // They are only allocated once eviction is enabled.
+  _Atomic(uint64_t) *referenced;
+  world_hash_type hand;
+  // A lean hashtable keeps neither the log nor older versions. A version is
+  // unlinked as soon as it is superseded, so that there is nothing to see for
+  // snapshots. The greatest sequence is counted here instead of by the log.
+  bool lean;
+  world_sequence greatest;
+  // The data of the same size is overwritten in place by batches. Readers
+  // copying it out retry on the sequence lock of the entry. Overwrites are
+  // visible before the rest of their batch, which is published after them.
+  bool in_place;
 };
 
-void world_hashtable_init(struct world_hashtable *ht, world_hash_type seed, struct world_allocator *a);
+void world_hashtable_init(struct world_hashtable *ht, enum world_hash_function hash_function, const struct world_hash_seed *seed, size_t expected_cardinality, float max_load_factor, struct world_allocator *a);
 void world_hashtable_destroy(struct world_hashtable *ht);
 enum world_error world_hashtable_get(struct world_hashtable *ht, struct world_buffer key, struct world_buffer *found);
+enum world_error world_hashtable_get_copy(struct world_hashtable *ht, struct world_buffer key, void *buffer, size_t capacity, size_t *size);
+enum world_error world_hashtable_get_many(struct world_hashtable *ht, struct world_read *reads, size_t n_reads);
+enum world_error world_hashtable_get_pinned(struct world_hashtable *ht, struct world_buffer key, struct world_pin *pin);
+void world_hashtable_release(struct world_hashtable *ht, struct world_pin *pin);
 enum world_error world_hashtable_set(struct world_hashtable *ht, struct world_buffer key, struct world_buffer data);
+enum world_error world_hashtable_set_versioned(struct world_hashtable *ht, struct world_buffer key, struct world_buffer data, world_sequence *seq);
 enum world_error world_hashtable_add(struct world_hashtable *ht, struct world_buffer key, struct world_buffer data);
 enum world_error world_hashtable_replace(struct world_hashtable *ht, struct world_buffer key, struct world_buffer data);
 enum world_error world_hashtable_delete(struct world_hashtable *ht, struct world_buffer key);
+enum world_error world_hashtable_expire(struct world_hashtable *ht, struct world_buffer key, world_sequence seq);
+enum world_error world_hashtable_update(struct world_hashtable *ht, struct world_buffer key, enum world_update (*fn)(void *ctx, const struct world_buffer *current, struct world_buffer *data), void *ctx);
+enum world_error world_hashtable_write_batch(struct world_hashtable *ht, struct world_write *writes, size_t n_writes, struct world_hashtable_entry **linked);
 struct world_hashtable_entry *world_hashtable_front(struct world_hashtable *ht);
 struct world_hashtable_entry *world_hashtable_log(struct world_hashtable *ht);
-void world_hashtable_checkpoint(struct world_hashtable *ht, world_sequence seq, struct world_circular *garbages);
+world_sequence world_hashtable_acquire_sequence(struct world_hashtable *ht);
+void world_hashtable_release_sequence(struct world_hashtable *ht, world_sequence seq);
+void world_hashtable_partition(struct world_hashtable *ht, size_t i, size_t n, struct world_hashtable_entry **begin, struct world_hashtable_entry **end);
+struct world_hashtable_entry *world_hashtable_advance(struct world_hashtable *ht, struct world_hashtable_entry **cursor, struct world_hashtable_entry *end, world_sequence seq);
+void world_hashtable_enable_eviction(struct world_hashtable *ht);
+void world_hashtable_enable_lean(struct world_hashtable *ht);
+void world_hashtable_enable_in_place(struct world_hashtable *ht);
+size_t world_hashtable_evict(struct world_hashtable *ht, size_t max_bytes, size_t n_bytes);
+size_t world_hashtable_live_bytes(struct world_hashtable *ht);
+size_t world_hashtable_stale_bytes(struct world_hashtable *ht);
+bool world_hashtable_checkpoint(struct world_hashtable *ht, world_sequence seq, struct world_circular *garbages);
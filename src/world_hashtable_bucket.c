@@ -20,18 +20,40 @@
  * SOFTWARE.
  */
 
+#include <limits.h>
 #include <stdatomic.h>
 #include <stdlib.h>
+#include "world_allocator.h"
+#include "world_assert.h"
 #include "world_hashtable_bucket.h"
 #include "world_hashtable_entry.h"
 
+// Buckets are stored in segments which are never moved, so that readers can
+// look up a bucket without any lock. The segment 0 holds the bucket 0, and the
+// segment k (k > 0) holds the buckets from 2^(k-1) to 2^k - 1.
+//
+// New buckets are spliced into the list first, and then published at once by
+// updating the size. Until then, lookups start from their parent buckets and
+// just pass over them. Buckets are removed in the reverse order: the size is
+// truncated first, and then they are unspliced.
+
+static struct world_hashtable_entry *_at(struct world_hashtable_bucket *b, size_t index);
+static size_t _segment(size_t index);
+static size_t _segment_base(size_t segment);
+static size_t _segment_size(size_t segment);
+static size_t _mask(size_t size);
+
 void world_hashtable_bucket_init(struct world_hashtable_bucket *b, struct world_allocator *a)
 {
+  for (size_t i = 0; i < WORLD_HASHTABLE_BUCKET_N_SEGMENTS; i++) {
+    atomic_store_explicit(&b->segments[i], NULL, memory_order_relaxed);
+  }
   struct world_hashtable_entry *front = world_hashtable_entry_new_bucket(a, 0);
-  world_vector_init(&b->buckets, a);
-  world_vector_push_back(&b->buckets, &front, sizeof(front));
+  struct world_hashtable_entry **segment = world_allocator_malloc(a, sizeof(*segment) * _segment_size(0));
+  segment[0] = front;
+  atomic_store_explicit(&b->segments[0], segment, memory_order_relaxed);
+  atomic_store_explicit(&b->size, 1, memory_order_relaxed);
   b->front = front;
-  b->mask = 0;
 }
 
 void world_hashtable_bucket_destroy(struct world_hashtable_bucket *b, struct world_allocator *a)
@@ -39,20 +61,28 @@ void world_hashtable_bucket_destroy(struct world_hashtable_bucket *b, struct wor
   struct world_hashtable_entry *cursor = world_hashtable_bucket_front(b);
   do {
     struct world_hashtable_entry *next = atomic_load_explicit(&cursor->base.next, memory_order_relaxed);
-    world_hashtable_entry_delete(cursor, a);
+    if (world_hashtable_entry_is_bucket(cursor)) {
+      world_hashtable_entry_delete_bucket(cursor, a);
+    } else {
+      world_hashtable_entry_delete(cursor, a);
+    }
     cursor = next;
   } while (cursor);
-  world_hashtable_entry_delete(cursor, a);
-  world_vector_destroy(&b->buckets);
+  for (size_t i = 0; i < WORLD_HASHTABLE_BUCKET_N_SEGMENTS; i++) {
+    world_allocator_free(a, atomic_load_explicit(&b->segments[i], memory_order_relaxed));
+  }
 }
 
-void world_hashtable_bucket_append(struct world_hashtable_bucket *b, struct world_allocator *a)
+void world_hashtable_bucket_splice(struct world_hashtable_bucket *b, size_t index, struct world_allocator *a)
 {
-  size_t index = world_hashtable_bucket_size(b);
+  WORLD_ASSERT(index > 0);
   world_hash_type hash = world_hash_reverse(index);
   struct world_hashtable_entry *bucket = world_hashtable_entry_new_bucket(a, hash);
 
-  struct world_hashtable_entry *cursor = world_hashtable_bucket_find(b, hash);
+  // The parent bucket, which is the index without its most significant bit,
+  // should have been spliced already.
+  size_t parent = index & ~((size_t)1 << (_segment(index) - 1));
+  struct world_hashtable_entry *cursor = _at(b, parent);
   struct world_hashtable_entry *next = NULL;
   for (;;) {
     next = atomic_load_explicit(&cursor->base.next, memory_order_relaxed);
@@ -65,17 +95,55 @@ void world_hashtable_bucket_append(struct world_hashtable_bucket *b, struct worl
   }
 
   atomic_store_explicit(&bucket->base.next, next, memory_order_relaxed);
-  atomic_store_explicit(&cursor->base.next, bucket, memory_order_relaxed);
-  world_vector_push_back(&b->buckets, &bucket, sizeof(bucket));
+  atomic_store_explicit(&cursor->base.next, bucket, memory_order_release);
 
-  if ((index & (index - 1)) == 0) {
-    b->mask = (b->mask << 1) | 0x1;
+  size_t s = _segment(index);
+  struct world_hashtable_entry **segment = atomic_load_explicit(&b->segments[s], memory_order_relaxed);
+  if (!segment) {
+    segment = world_allocator_malloc(a, sizeof(*segment) * _segment_size(s));
+    atomic_store_explicit(&b->segments[s], segment, memory_order_release);
+  }
+  segment[index - _segment_base(s)] = bucket;
+}
+
+void world_hashtable_bucket_publish(struct world_hashtable_bucket *b, size_t size)
+{
+  WORLD_ASSERT(size >= world_hashtable_bucket_size(b));
+  atomic_store_explicit(&b->size, size, memory_order_release);
+}
+
+void world_hashtable_bucket_truncate(struct world_hashtable_bucket *b, size_t size)
+{
+  WORLD_ASSERT(size > 0 && size <= world_hashtable_bucket_size(b));
+  atomic_store_explicit(&b->size, size, memory_order_release);
+}
+
+struct world_hashtable_entry *world_hashtable_bucket_unsplice(struct world_hashtable_bucket *b, size_t index)
+{
+  // The bucket should have been truncated, so that nobody starts a lookup from
+  // the bucket anymore. The segment is kept for the bucket to be spliced again.
+  WORLD_ASSERT(index >= world_hashtable_bucket_size(b));
+  struct world_hashtable_entry *bucket = _at(b, index);
+
+  size_t parent = index & ~((size_t)1 << (_segment(index) - 1));
+  struct world_hashtable_entry *cursor = _at(b, parent);
+  for (;;) {
+    struct world_hashtable_entry *next = atomic_load_explicit(&cursor->base.next, memory_order_relaxed);
+    WORLD_ASSERT(next);
+    if (next == bucket) {
+      break;
+    }
+    cursor = next;
   }
+
+  struct world_hashtable_entry *next = atomic_load_explicit(&bucket->base.next, memory_order_relaxed);
+  atomic_store_explicit(&cursor->base.next, next, memory_order_release);
+  return bucket;
 }
 
 size_t world_hashtable_bucket_size(struct world_hashtable_bucket *b)
 {
-  return world_vector_size(&b->buckets);
+  return atomic_load_explicit(&b->size, memory_order_acquire);
 }
 
 struct world_hashtable_entry *world_hashtable_bucket_front(struct world_hashtable_bucket *b)
@@ -85,11 +153,39 @@ struct world_hashtable_entry *world_hashtable_bucket_front(struct world_hashtabl
 
 struct world_hashtable_entry *world_hashtable_bucket_find(struct world_hashtable_bucket *b, world_hash_type hash)
 {
+  size_t size = world_hashtable_bucket_size(b);
+  size_t mask = _mask(size);
   world_hash_type r = world_hash_reverse(hash);
-  size_t index = r & b->mask;
-  if (index >= world_hashtable_bucket_size(b)) {
-    index = r & (b->mask >> 1);
+  size_t index = r & mask;
+  if (index >= size) {
+    index = r & (mask >> 1);
   }
-  struct world_hashtable_entry **position = world_vector_at(&b->buckets, index, sizeof(*position));
-  return *position;
+  return _at(b, index);
+}
+
+static struct world_hashtable_entry *_at(struct world_hashtable_bucket *b, size_t index)
+{
+  size_t s = _segment(index);
+  struct world_hashtable_entry **segment = atomic_load_explicit(&b->segments[s], memory_order_acquire);
+  return segment[index - _segment_base(s)];
+}
+
+static size_t _segment(size_t index)
+{
+  return index ? sizeof(unsigned long long) * CHAR_BIT - __builtin_clzll(index) : 0;
+}
+
+static size_t _segment_base(size_t segment)
+{
+  return segment ? (size_t)1 << (segment - 1) : 0;
+}
+
+static size_t _segment_size(size_t segment)
+{
+  return segment ? (size_t)1 << (segment - 1) : 1;
+}
+
+static size_t _mask(size_t size)
+{
+  return size > 1 ? ((size_t)1 << _segment(size - 1)) - 1 : 0;
 }
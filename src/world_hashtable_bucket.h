@@ -22,22 +22,27 @@
 
 #pragma once
 
+#include <limits.h>
 #include <stddef.h>
 #include "world_hash.h"
-#include "world_vector.h"
+
+#define WORLD_HASHTABLE_BUCKET_N_SEGMENTS (sizeof(size_t) * CHAR_BIT)
 
 struct world_allocator;
 struct world_hashtable_entry;
 
 struct world_hashtable_bucket {
-  struct world_vector buckets;
+  _Atomic(struct world_hashtable_entry **) segments[WORLD_HASHTABLE_BUCKET_N_SEGMENTS];
+  _Atomic(size_t) size;
   struct world_hashtable_entry *front;
-  world_hash_type mask;
 };
 
 void world_hashtable_bucket_init(struct world_hashtable_bucket *b, struct world_allocator *a);
 void world_hashtable_bucket_destroy(struct world_hashtable_bucket *b, struct world_allocator *a);
-void world_hashtable_bucket_append(struct world_hashtable_bucket *b, struct world_allocator *a);
+void world_hashtable_bucket_splice(struct world_hashtable_bucket *b, size_t index, struct world_allocator *a);
+void world_hashtable_bucket_publish(struct world_hashtable_bucket *b, size_t size);
+void world_hashtable_bucket_truncate(struct world_hashtable_bucket *b, size_t size);
+struct world_hashtable_entry *world_hashtable_bucket_unsplice(struct world_hashtable_bucket *b, size_t index);
 size_t world_hashtable_bucket_size(struct world_hashtable_bucket *b);
 struct world_hashtable_entry *world_hashtable_bucket_front(struct world_hashtable_bucket *b);
 struct world_hashtable_entry *world_hashtable_bucket_find(struct world_hashtable_bucket *b, world_hash_type hash);
@@ -21,30 +21,35 @@
  */
 
 #include <stdatomic.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include "world_allocator.h"
 #include "world_assert.h"
 #include "world_byteorder.h"
 #include "world_hashtable_entry.h"
+#include "world_system.h"
 
-static struct world_hashtable_entry *_next_nonbucket(struct world_hashtable_entry *entry);
+static struct world_hashtable_entry *_next_nonbucket(struct world_hashtable_entry *entry, struct world_hashtable_entry *end);
+static struct world_hashtable_entry *_last_version(struct world_hashtable_entry *entry);
+static bool _same_key(struct world_hashtable_entry *x, struct world_hashtable_entry *y);
+static size_t _size(size_t key_size, size_t data_size);
+static size_t _header_size(size_t data_size);
+static void _encode_header(struct world_hashtable_entry *entry, size_t key_size, size_t data_size);
 static world_key_size _key_size(struct world_hashtable_entry *entry);
-static world_key_size _data_size(struct world_hashtable_entry *entry);
+static size_t _data_size(struct world_hashtable_entry *entry);
 static void *_key_base(struct world_hashtable_entry *entry);
 static void *_data_base(struct world_hashtable_entry *entry);
 
 struct world_hashtable_entry *world_hashtable_entry_new(struct world_allocator *a, world_hash_type hash, struct world_buffer key, struct world_buffer data)
 {
-  struct world_hashtable_entry *entry = world_allocator_malloc(a, sizeof(*entry) + key.size + data.size);
+  struct world_hashtable_entry *entry = world_allocator_slab_alloc(a, _size(key.size, data.size));
 
   entry->base.seq = 0;
   entry->base.hash = hash;
   atomic_store_explicit(&entry->base.next, NULL, memory_order_relaxed);
   atomic_store_explicit(&entry->log, NULL, memory_order_relaxed);
-  atomic_store_explicit(&entry->stale, NULL, memory_order_relaxed);
-  entry->header.key_size = world_encode_key_size(key.size);
-  entry->header.data_size = world_encode_data_size(data.size);
+  _encode_header(entry, key.size, data.size);
   memcpy(_key_base(entry), key.base, key.size);
   memcpy(_data_base(entry), data.base, data.size);
 
@@ -53,15 +58,13 @@ struct world_hashtable_entry *world_hashtable_entry_new(struct world_allocator *
 
 struct world_hashtable_entry *world_hashtable_entry_new_void(struct world_allocator *a, world_hash_type hash, struct world_buffer key)
 {
-  struct world_hashtable_entry *entry = world_allocator_malloc(a, sizeof(*entry) + key.size);
+  struct world_hashtable_entry *entry = world_allocator_slab_alloc(a, _size(key.size, 0));
 
   entry->base.seq = 0;
   entry->base.hash = hash;
   atomic_store_explicit(&entry->base.next, NULL, memory_order_relaxed);
   atomic_store_explicit(&entry->log, NULL, memory_order_relaxed);
-  atomic_store_explicit(&entry->stale, NULL, memory_order_relaxed);
-  entry->header.key_size = world_encode_key_size(key.size);
-  entry->header.data_size = world_encode_data_size(0);
+  _encode_header(entry, key.size, 0);
   memcpy(_key_base(entry), key.base, key.size);
 
   return entry;
@@ -69,7 +72,8 @@ struct world_hashtable_entry *world_hashtable_entry_new_void(struct world_alloca
 
 struct world_hashtable_entry *world_hashtable_entry_new_bucket(struct world_allocator *a, world_hash_type hash)
 {
-  struct world_hashtable_entry *entry = world_allocator_malloc(a, sizeof(entry->base));
+  // A bucket only has the base, since there may be as many buckets as entries.
+  struct world_hashtable_entry *entry = world_allocator_slab_alloc(a, sizeof(entry->base));
 
   entry->base.seq = 0;
   entry->base.hash = hash;
@@ -78,9 +82,14 @@ struct world_hashtable_entry *world_hashtable_entry_new_bucket(struct world_allo
   return entry;
 }
 
+void world_hashtable_entry_delete_bucket(struct world_hashtable_entry *entry, struct world_allocator *a)
+{
+  world_allocator_slab_free(a, entry, sizeof(entry->base));
+}
+
 void world_hashtable_entry_delete(struct world_hashtable_entry *entry, struct world_allocator *a)
 {
-  world_allocator_free(a, entry);
+  world_allocator_slab_free(a, entry, _size(_key_size(entry), _data_size(entry)));
 }
 
 bool world_hashtable_entry_is_void(struct world_hashtable_entry *entry)
@@ -93,23 +102,31 @@ bool world_hashtable_entry_is_bucket(struct world_hashtable_entry *entry)
   return entry->base.seq == 0;
 }
 
-struct world_hashtable_entry *world_hashtable_entry_advance(struct world_hashtable_entry **entry, world_sequence seq)
+struct world_hashtable_entry *world_hashtable_entry_advance(struct world_hashtable_entry **entry, struct world_hashtable_entry *end, world_sequence seq)
 {
+  // The walk stops at the bucket `end`, or at the end of the list if it is
+  // NULL. Keys deleted as of the sequence are skipped. The cursor is left on the
+  // version returned, which is never reclaimed while the sequence is pinned,
+  // unlike the older versions and void entries around it.
+  struct world_hashtable_entry *cursor = *entry;
   for (;;) {
-    *entry = _next_nonbucket(*entry);
-    if (!*entry) {
+    cursor = _next_nonbucket(_last_version(cursor), end);
+    if (!cursor) {
+      *entry = NULL;
       return NULL;
     }
-    struct world_hashtable_entry *cursor = *entry;
-    for (;;) {
-      if (cursor->base.seq <= seq) {
-        return cursor;
-      }
-      struct world_hashtable_entry *stale = atomic_load_explicit(&cursor->stale, memory_order_relaxed);
-      if (!stale) {
+    struct world_hashtable_entry *version = cursor;
+    while (version->base.seq > seq) {
+      struct world_hashtable_entry *next = atomic_load_explicit(&version->base.next, memory_order_relaxed);
+      if (!next || world_hashtable_entry_is_bucket(next) || !_same_key(version, next)) {
+        version = NULL;
         break;
       }
-      cursor = stale;
+      version = next;
+    }
+    if (version && !world_hashtable_entry_is_void(version)) {
+      *entry = version;
+      return version;
     }
   }
 }
@@ -137,34 +154,130 @@ struct world_buffer world_hashtable_entry_raw(struct world_hashtable_entry *entr
   WORLD_ASSERT(!world_hashtable_entry_is_bucket(entry));
   struct world_buffer iovec;
   iovec.base = &entry->header;
-  iovec.size = sizeof(entry->header) + _key_size(entry) + _data_size(entry);
+  iovec.size = _header_size(_data_size(entry)) + _key_size(entry) + _data_size(entry);
   return iovec;
 }
 
-static struct world_hashtable_entry *_next_nonbucket(struct world_hashtable_entry *entry)
+size_t world_hashtable_entry_size(struct world_hashtable_entry *entry)
+{
+  WORLD_ASSERT(!world_hashtable_entry_is_bucket(entry));
+  return _size(_key_size(entry), _data_size(entry));
+}
+
+void world_hashtable_entry_overwrite(struct world_hashtable_entry *entry, struct world_buffer data)
+{
+  // The caller is the only writer of the entry, and the size does not change,
+  // so that only the data bytes are guarded by the sequence lock.
+  WORLD_ASSERT(data.size == _data_size(entry));
+  uint64_t seqlock = atomic_load_explicit(&entry->seqlock, memory_order_relaxed);
+  atomic_store_explicit(&entry->seqlock, seqlock + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  memcpy(_data_base(entry), data.base, data.size);
+  atomic_store_explicit(&entry->seqlock, seqlock + 2, memory_order_release);
+}
+
+size_t world_hashtable_entry_copy_data(struct world_hashtable_entry *entry, void *buffer, size_t capacity)
+{
+  // The copy is retried until no overwrite has been in progress meanwhile.
+  size_t size = _data_size(entry);
+  size_t n_copy = size < capacity ? size : capacity;
+  for (;;) {
+    uint64_t before = atomic_load_explicit(&entry->seqlock, memory_order_acquire);
+    if (before % 2) {
+      world_cpu_relax();
+      continue;
+    }
+    memcpy(buffer, _data_base(entry), n_copy);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&entry->seqlock, memory_order_relaxed) == before) {
+      return size;
+    }
+    world_cpu_relax();
+  }
+}
+
+static struct world_hashtable_entry *_next_nonbucket(struct world_hashtable_entry *entry, struct world_hashtable_entry *end)
 {
   do {
     entry = atomic_load_explicit(&entry->base.next, memory_order_relaxed);
+    if (entry == end) {
+      return NULL;
+    }
   } while (entry && world_hashtable_entry_is_bucket(entry));
   return entry;
 }
 
+static struct world_hashtable_entry *_last_version(struct world_hashtable_entry *entry)
+{
+  if (world_hashtable_entry_is_bucket(entry)) {
+    return entry;
+  }
+  for (;;) {
+    struct world_hashtable_entry *next = atomic_load_explicit(&entry->base.next, memory_order_relaxed);
+    if (!next || world_hashtable_entry_is_bucket(next) || !_same_key(entry, next)) {
+      return entry;
+    }
+    entry = next;
+  }
+}
+
+static bool _same_key(struct world_hashtable_entry *x, struct world_hashtable_entry *y)
+{
+  return x->base.hash == y->base.hash &&
+         _key_size(x) == _key_size(y) &&
+         memcmp(_key_base(x), _key_base(y), _key_size(x)) == 0;
+}
+
+static size_t _size(size_t key_size, size_t data_size)
+{
+  // The key follows the header immediately, without the padding at the end of
+  // the structure.
+  return offsetof(struct world_hashtable_entry, header) + _header_size(data_size) + key_size + data_size;
+}
+
+static size_t _header_size(size_t data_size)
+{
+  size_t size = sizeof(((struct world_hashtable_entry *)NULL)->header);
+  if (data_size >= WORLD_DATA_SIZE_ESCAPE) {
+    size += sizeof(world_extended_data_size);
+  }
+  return size;
+}
+
+static void _encode_header(struct world_hashtable_entry *entry, size_t key_size, size_t data_size)
+{
+  entry->header.key_size = world_encode_key_size(key_size);
+  if (data_size < WORLD_DATA_SIZE_ESCAPE) {
+    entry->header.data_size = world_encode_data_size(data_size);
+    return;
+  }
+  entry->header.data_size = world_encode_data_size(WORLD_DATA_SIZE_ESCAPE);
+  world_extended_data_size extended = world_encode_extended_data_size(data_size);
+  memcpy(&entry->header + 1, &extended, sizeof(extended));
+}
+
 static world_key_size _key_size(struct world_hashtable_entry *entry)
 {
   return world_decode_key_size(entry->header.key_size);
 }
 
-static world_key_size _data_size(struct world_hashtable_entry *entry)
+static size_t _data_size(struct world_hashtable_entry *entry)
 {
-  return world_decode_data_size(entry->header.data_size);
+  size_t data_size = world_decode_data_size(entry->header.data_size);
+  if (data_size < WORLD_DATA_SIZE_ESCAPE) {
+    return data_size;
+  }
+  world_extended_data_size extended;
+  memcpy(&extended, &entry->header + 1, sizeof(extended));
+  return world_decode_extended_data_size(extended);
 }
 
 static void *_key_base(struct world_hashtable_entry *entry)
 {
-  return (void *)((uintptr_t)&entry->header + sizeof(entry->header));
+  return (void *)((uintptr_t)&entry->header + _header_size(_data_size(entry)));
 }
 
 static void *_data_base(struct world_hashtable_entry *entry)
 {
-  return (void *)((uintptr_t)&entry->header + sizeof(entry->header) + _key_size(entry));
+  return (void *)((uintptr_t)&entry->header + _header_size(_data_size(entry)) + _key_size(entry));
 }
@@ -23,19 +23,28 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <world.h>
 #include "world_hash.h"
 
 struct world_allocator;
 
+// Versions of a key are kept next to each other in the list, from the newest
+// to the oldest, so that an entry does not need a link to its stale version.
 struct world_hashtable_entry {
   struct {
     world_sequence seq;
     world_hash_type hash;
     _Atomic(struct world_hashtable_entry *)next;
   } base;
-  _Atomic(struct world_hashtable_entry *)log;
-  _Atomic(struct world_hashtable_entry *)stale;
+  // A lean hashtable has no log, and may overwrite the data in place instead.
+  // Readers of the data then retry while the sequence lock is odd or changes.
+  union {
+    _Atomic(struct world_hashtable_entry *)log;
+    _Atomic(uint64_t) seqlock;
+  };
+  // The header is followed by an extended data size if the data size is
+  // escaped, and then by the key and the data.
   struct {
     world_key_size key_size;
     world_data_size data_size;
@@ -46,9 +55,13 @@ struct world_hashtable_entry *world_hashtable_entry_new(struct world_allocator *
 struct world_hashtable_entry *world_hashtable_entry_new_void(struct world_allocator *a, world_hash_type hash, struct world_buffer key);
 struct world_hashtable_entry *world_hashtable_entry_new_bucket(struct world_allocator *a, world_hash_type hash);
 void world_hashtable_entry_delete(struct world_hashtable_entry *entry, struct world_allocator *a);
+void world_hashtable_entry_delete_bucket(struct world_hashtable_entry *entry, struct world_allocator *a);
 bool world_hashtable_entry_is_void(struct world_hashtable_entry *entry);
 bool world_hashtable_entry_is_bucket(struct world_hashtable_entry *entry);
-struct world_hashtable_entry *world_hashtable_entry_advance(struct world_hashtable_entry **entry, world_sequence seq);
+struct world_hashtable_entry *world_hashtable_entry_advance(struct world_hashtable_entry **entry, struct world_hashtable_entry *end, world_sequence seq);
 struct world_buffer world_hashtable_entry_key(struct world_hashtable_entry *entry);
 struct world_buffer world_hashtable_entry_data(struct world_hashtable_entry *entry);
 struct world_buffer world_hashtable_entry_raw(struct world_hashtable_entry *entry);
+size_t world_hashtable_entry_size(struct world_hashtable_entry *entry);
+void world_hashtable_entry_overwrite(struct world_hashtable_entry *entry, struct world_buffer data);
+size_t world_hashtable_entry_copy_data(struct world_hashtable_entry *entry, void *buffer, size_t capacity);
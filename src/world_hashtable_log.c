@@ -46,10 +46,9 @@ void world_hashtable_log_push_back(struct world_hashtable_log *l, struct world_h
 {
   struct world_hashtable_entry *tail = atomic_load_explicit(&l->tail, memory_order_relaxed);
   WORLD_ASSERT(tail);
-  entry->base.seq = tail->base.seq + 1;
-  atomic_thread_fence(memory_order_release);
-  atomic_store_explicit(&tail->log, entry, memory_order_relaxed);
-  atomic_store_explicit(&l->tail, entry, memory_order_relaxed);
+  WORLD_ASSERT(entry->base.seq == tail->base.seq + 1);
+  atomic_store_explicit(&tail->log, entry, memory_order_release);
+  atomic_store_explicit(&l->tail, entry, memory_order_release);
 }
 
 void world_hashtable_log_pop_front(struct world_hashtable_log *l)
@@ -20,6 +20,7 @@
  * SOFTWARE.
  */
 
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,13 +28,13 @@
 #include "world_hashtable_entry.h"
 #include "world_origin.h"
 #include "world_origin_thread.h"
+#include "world_snapshot.h"
 #include "world_system.h"
 
 static bool _validate_conf(const struct world_originconf *conf);
 static struct world_origin_thread *_thread(struct world_origin *origin, int fd);
-static world_sequence _least_sequence(struct world_origin *origin);
 static void _notify(struct world_origin *origin);
-static void _checkpoint(struct world_origin *origin);
+static void _evict(struct world_origin *origin, size_t live);
 
 enum world_error world_origin_open(struct world_origin **o, const struct world_originconf *conf)
 {
@@ -41,19 +42,29 @@ enum world_error world_origin_open(struct world_origin **o, const struct world_o
     return world_error_invalid_argument;
   }
 
-  struct world_allocator allocator;
-  world_allocator_init(&allocator);
-  struct world_origin *origin = world_allocator_malloc(&allocator, sizeof(*origin));
-  memcpy(&origin->allocator, &allocator, sizeof(allocator));
+  // The allocator cannot be moved once initialized, so that the handle itself
+  // is allocated by malloc(3).
+  struct world_origin *origin = malloc(sizeof(*origin));
+  if (!origin) {
+    perror("malloc");
+    abort();
+  }
+  world_allocator_init(&origin->allocator);
 
   memcpy((void *)&origin->conf, conf, sizeof(origin->conf));
-  world_hashtable_init(&origin->hashtable, world_generate_seed(), &origin->allocator);
-  world_circular_init(&origin->garbages, &origin->allocator);
+  struct world_hash_seed seed;
+  world_generate_seed(&seed);
+  world_hashtable_init(&origin->hashtable, origin->conf.hash_function, &seed, origin->conf.expected_cardinality, origin->conf.max_load_factor, &origin->allocator);
+  if (origin->conf.max_memory_bytes) {
+    world_hashtable_enable_eviction(&origin->hashtable);
+  }
 
   origin->threads = world_allocator_calloc(&origin->allocator, origin->conf.n_io_threads, sizeof(*origin->threads));
   for (size_t i = 0; i < origin->conf.n_io_threads; i++) {
     world_origin_thread_init(&origin->threads[i], origin);
   }
+  world_origin_expirer_init(&origin->expirer, origin);
+  world_origin_reclaimer_init(&origin->reclaimer, origin);
 
   *o = origin;
   return world_error_ok;
@@ -61,18 +72,17 @@ enum world_error world_origin_open(struct world_origin **o, const struct world_o
 
 enum world_error world_origin_close(struct world_origin *origin)
 {
+  world_origin_expirer_destroy(&origin->expirer);
+  world_origin_reclaimer_destroy(&origin->reclaimer);
   for (size_t i = 0; i < origin->conf.n_io_threads; i++) {
     world_origin_thread_destroy(&origin->threads[i]);
   }
 
   world_hashtable_destroy(&origin->hashtable);
-  world_circular_destroy(&origin->garbages);
   world_allocator_free(&origin->allocator, origin->threads);
 
-  struct world_allocator allocator;
-  memcpy(&allocator, &origin->allocator, sizeof(allocator));
-  world_allocator_free(&allocator, origin);
-  world_allocator_destroy(&allocator);
+  world_allocator_destroy(&origin->allocator);
+  free(origin);
 
   return world_error_ok;
 }
@@ -111,7 +121,6 @@ enum world_error world_origin_transmit(struct world_origin *origin)
 {
   if (!origin->conf.auto_transmission) {
     _notify(origin);
-    _checkpoint(origin);
   }
 
   return world_error_ok;
@@ -122,16 +131,65 @@ enum world_error world_origin_get(const struct world_origin *origin, struct worl
   return world_hashtable_get((struct world_hashtable *)&origin->hashtable, key, data);
 }
 
+enum world_error world_origin_get_copy(const struct world_origin *origin, struct world_buffer key, void *buffer, size_t capacity, size_t *size)
+{
+  return world_hashtable_get_copy((struct world_hashtable *)&origin->hashtable, key, buffer, capacity, size);
+}
+
+enum world_error world_origin_get_many(const struct world_origin *origin, struct world_read *reads, size_t n_reads)
+{
+  return world_hashtable_get_many((struct world_hashtable *)&origin->hashtable, reads, n_reads);
+}
+
+enum world_error world_origin_get_pinned(const struct world_origin *origin, struct world_buffer key, struct world_pin *pin)
+{
+  return world_hashtable_get_pinned((struct world_hashtable *)&origin->hashtable, key, pin);
+}
+
+enum world_error world_origin_release(const struct world_origin *origin, struct world_pin *pin)
+{
+  if (!pin || pin->slot == WORLD_EPOCH_NO_SLOT) {
+    return world_error_invalid_argument;
+  }
+
+  world_hashtable_release((struct world_hashtable *)&origin->hashtable, pin);
+  return world_error_ok;
+}
+
 enum world_error world_origin_set(struct world_origin *origin, struct world_buffer key, struct world_buffer data)
 {
+  size_t live = world_hashtable_live_bytes(&origin->hashtable);
   enum world_error err = world_hashtable_set(&origin->hashtable, key, data);
   if (err) {
     return err;
   }
+  _evict(origin, live);
+
+  if (origin->conf.auto_transmission) {
+    _notify(origin);
+  }
+
+  return world_error_ok;
+}
+
+enum world_error world_origin_set_ttl(struct world_origin *origin, struct world_buffer key, struct world_buffer data, uint64_t ttl_msec)
+{
+  if (!ttl_msec) {
+    return world_error_invalid_argument;
+  }
+
+  world_sequence seq;
+  size_t live = world_hashtable_live_bytes(&origin->hashtable);
+  enum world_error err = world_hashtable_set_versioned(&origin->hashtable, key, data, &seq);
+  if (err) {
+    return err;
+  }
+
+  world_origin_expirer_schedule(&origin->expirer, key, seq, ttl_msec);
+  _evict(origin, live);
 
   if (origin->conf.auto_transmission) {
     _notify(origin);
-    _checkpoint(origin);
   }
 
   return world_error_ok;
@@ -139,14 +197,15 @@ enum world_error world_origin_set(struct world_origin *origin, struct world_buff
 
 enum world_error world_origin_add(struct world_origin *origin, struct world_buffer key, struct world_buffer data)
 {
+  size_t live = world_hashtable_live_bytes(&origin->hashtable);
   enum world_error err = world_hashtable_add(&origin->hashtable, key, data);
   if (err) {
     return err;
   }
+  _evict(origin, live);
 
   if (origin->conf.auto_transmission) {
     _notify(origin);
-    _checkpoint(origin);
   }
 
   return world_error_ok;
@@ -154,14 +213,15 @@ enum world_error world_origin_add(struct world_origin *origin, struct world_buff
 
 enum world_error world_origin_replace(struct world_origin *origin, struct world_buffer key, struct world_buffer data)
 {
+  size_t live = world_hashtable_live_bytes(&origin->hashtable);
   enum world_error err = world_hashtable_replace(&origin->hashtable, key, data);
   if (err) {
     return err;
   }
+  _evict(origin, live);
 
   if (origin->conf.auto_transmission) {
     _notify(origin);
-    _checkpoint(origin);
   }
 
   return world_error_ok;
@@ -176,28 +236,87 @@ enum world_error world_origin_delete(struct world_origin *origin, struct world_b
 
   if (origin->conf.auto_transmission) {
     _notify(origin);
-    _checkpoint(origin);
   }
 
   return world_error_ok;
 }
 
-static bool _validate_conf(const struct world_originconf *conf)
+enum world_error world_origin_update(struct world_origin *origin, struct world_buffer key, enum world_update (*fn)(void *ctx, const struct world_buffer *current, struct world_buffer *data), void *ctx)
 {
-  if (conf->n_io_threads == 0) {
-    fprintf(stderr, "world_origin_open: n_io_threads should be positive integer");
-    return false;
+  size_t live = world_hashtable_live_bytes(&origin->hashtable);
+  enum world_error err = world_hashtable_update(&origin->hashtable, key, fn, ctx);
+  if (err) {
+    return err;
   }
+  _evict(origin, live);
 
-  return true;
+  if (origin->conf.auto_transmission) {
+    _notify(origin);
+  }
+
+  return world_error_ok;
 }
 
-static struct world_origin_thread *_thread(struct world_origin *origin, int fd)
+enum world_error world_origin_write_batch(struct world_origin *origin, struct world_write *writes, size_t n_writes)
 {
-  return &origin->threads[fd % origin->conf.n_io_threads];
+  size_t live = world_hashtable_live_bytes(&origin->hashtable);
+  enum world_error err = world_hashtable_write_batch(&origin->hashtable, writes, n_writes, NULL);
+  if (err) {
+    return err;
+  }
+  _evict(origin, live);
+
+  if (origin->conf.auto_transmission) {
+    _notify(origin);
+  }
+
+  return world_error_ok;
+}
+
+enum world_error world_origin_snapshot_open(struct world_origin *origin, size_t n_partitions, struct world_snapshot **snapshot)
+{
+  if (n_partitions == 0 || n_partitions > WORLD_MAX_SNAPSHOT_PARTITIONS || !snapshot) {
+    return world_error_invalid_argument;
+  }
+
+  *snapshot = world_snapshot_new(&origin->hashtable, &origin->allocator, n_partitions);
+  return world_error_ok;
+}
+
+enum world_error world_origin_memory(const struct world_origin *origin, struct world_memory *memory)
+{
+  if (!memory) {
+    return world_error_invalid_argument;
+  }
+
+  struct world_allocator *allocator = (struct world_allocator *)&origin->allocator;
+  memory->held = world_allocator_held(allocator);
+  memory->live = world_allocator_live(allocator);
+  memory->dataset = world_hashtable_live_bytes((struct world_hashtable *)&origin->hashtable);
+  memory->stale = world_hashtable_stale_bytes((struct world_hashtable *)&origin->hashtable);
+  return world_error_ok;
+}
+
+enum world_error world_origin_sequence(const struct world_origin *origin, world_sequence *seq)
+{
+  if (!seq) {
+    return world_error_invalid_argument;
+  }
+
+  struct world_hashtable *ht = (struct world_hashtable *)&origin->hashtable;
+  *seq = atomic_load_explicit(&ht->visible, memory_order_acquire);
+  return world_error_ok;
 }
 
-static world_sequence _least_sequence(struct world_origin *origin)
+void world_origin_flush(struct world_origin *origin)
+{
+  // Writes made by the origin itself are transmitted as those by users.
+  if (origin->conf.auto_transmission) {
+    _notify(origin);
+  }
+}
+
+world_sequence world_origin_least_sequence(struct world_origin *origin)
 {
   world_sequence seq = world_hashtable_log(&origin->hashtable)->base.seq;
   for (size_t i = 0; i < origin->conf.n_io_threads; i++) {
@@ -209,20 +328,54 @@ static world_sequence _least_sequence(struct world_origin *origin)
   return seq;
 }
 
+static bool _validate_conf(const struct world_originconf *conf)
+{
+  if (conf->n_io_threads == 0) {
+    fprintf(stderr, "world_origin_open: n_io_threads should be positive integer");
+    return false;
+  }
+
+  if (!world_hash_validate_function(conf->hash_function)) {
+    fprintf(stderr, "world_origin_open: hash_function: invalid value");
+    return false;
+  }
+
+  if (!(conf->max_load_factor >= WORLD_MIN_LOAD_FACTOR)) {
+    fprintf(stderr, "world_origin_open: max_load_factor should be at least WORLD_MIN_LOAD_FACTOR");
+    return false;
+  }
+
+  if ((double)conf->expected_cardinality > (double)WORLD_MAX_BUCKETS * conf->max_load_factor) {
+    fprintf(stderr, "world_origin_open: expected_cardinality: too large");
+    return false;
+  }
+
+  return true;
+}
+
+static struct world_origin_thread *_thread(struct world_origin *origin, int fd)
+{
+  return &origin->threads[fd % origin->conf.n_io_threads];
+}
+
 static void _notify(struct world_origin *origin)
 {
   for (size_t i = 0; i < origin->conf.n_io_threads; i++) {
     world_origin_thread_interrupt(origin->threads + i);
   }
+  world_origin_reclaimer_notify(&origin->reclaimer);
 }
 
-static void _checkpoint(struct world_origin *origin)
+static void _evict(struct world_origin *origin, size_t live)
 {
-  // FIXME ad hoc implementation. there is a bit of a chance of race condition
-  while (world_circular_size(&origin->garbages) > 10000) {
-    world_hashtable_entry_delete(*(void **)world_circular_front(&origin->garbages, sizeof(void *)), &origin->allocator);
-    world_circular_pop_front(&origin->garbages);
+  // A write evicts about as many bytes as it has added to the dataset, so that
+  // the dataset stops growing at the limit. Stale versions piled up by lagging
+  // replicas do not make it evict the whole dataset.
+  if (!origin->conf.max_memory_bytes) {
+    return;
+  }
+  size_t grown = world_hashtable_live_bytes(&origin->hashtable);
+  if (grown > live) {
+    world_hashtable_evict(&origin->hashtable, origin->conf.max_memory_bytes, grown - live);
   }
-
-  world_hashtable_checkpoint(&origin->hashtable, _least_sequence(origin), &origin->garbages);
 }
@@ -24,8 +24,9 @@
 
 #include <world.h>
 #include "world_allocator.h"
-#include "world_circular.h"
 #include "world_hashtable.h"
+#include "world_origin_expirer.h"
+#include "world_origin_reclaimer.h"
 
 struct world_origin_thread;
 
@@ -33,6 +34,10 @@ struct world_origin {
   struct world_allocator allocator;
   const struct world_originconf conf;
   struct world_hashtable hashtable;
-  struct world_circular garbages;
   struct world_origin_thread *threads;
+  struct world_origin_expirer expirer;
+  struct world_origin_reclaimer reclaimer;
 };
+
+void world_origin_flush(struct world_origin *origin);
+world_sequence world_origin_least_sequence(struct world_origin *origin);
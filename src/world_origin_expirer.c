@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "world_origin.h"
+#include "world_origin_expirer.h"
+
+struct _expiry {
+  struct world_timer timer;
+  world_sequence seq;
+  size_t key_size;
+  char key[];
+};
+
+static void *_expirer_main(void *arg);
+static void _expire(struct world_origin_expirer *e, struct world_timer *expired);
+static uint64_t _now_msec(clockid_t clock);
+
+void world_origin_expirer_init(struct world_origin_expirer *e, struct world_origin *origin)
+{
+  int err;
+
+  if ((err = pthread_mutex_init(&e->mtx, NULL))) {
+    fprintf(stderr, "pthread_mutex_init: %s\n", strerror(err));
+    abort();
+  }
+
+  if ((err = pthread_cond_init(&e->cond, NULL))) {
+    fprintf(stderr, "pthread_cond_init: %s\n", strerror(err));
+    abort();
+  }
+
+  world_timer_wheel_init(&e->wheel, _now_msec(CLOCK_MONOTONIC) / WORLD_ORIGIN_EXPIRER_TICK_MSEC);
+  e->running = false;
+  e->stopping = false;
+  e->origin = origin;
+}
+
+void world_origin_expirer_destroy(struct world_origin_expirer *e)
+{
+  pthread_mutex_lock(&e->mtx);
+  e->stopping = true;
+  pthread_cond_signal(&e->cond);
+  pthread_mutex_unlock(&e->mtx);
+
+  if (e->running) {
+    int err = pthread_join(e->thread, NULL);
+    if (err) {
+      fprintf(stderr, "pthread_join: %s\n", strerror(err));
+    }
+  }
+
+  struct world_timer *t = world_timer_wheel_drain(&e->wheel);
+  while (t) {
+    struct world_timer *next = t->next;
+    world_allocator_free(&e->origin->allocator, t);
+    t = next;
+  }
+
+  pthread_cond_destroy(&e->cond);
+  pthread_mutex_destroy(&e->mtx);
+}
+
+void world_origin_expirer_schedule(struct world_origin_expirer *e, struct world_buffer key, world_sequence seq, uint64_t ttl_msec)
+{
+  struct _expiry *expiry = world_allocator_malloc(&e->origin->allocator, sizeof(*expiry) + key.size);
+  uint64_t now = _now_msec(CLOCK_MONOTONIC);
+  if (ttl_msec > UINT64_MAX - now - WORLD_ORIGIN_EXPIRER_TICK_MSEC) {
+    ttl_msec = UINT64_MAX - now - WORLD_ORIGIN_EXPIRER_TICK_MSEC;
+  }
+  expiry->timer.deadline = (now + ttl_msec + WORLD_ORIGIN_EXPIRER_TICK_MSEC - 1) / WORLD_ORIGIN_EXPIRER_TICK_MSEC;
+  expiry->seq = seq;
+  expiry->key_size = key.size;
+  memcpy(expiry->key, key.base, key.size);
+
+  pthread_mutex_lock(&e->mtx);
+  if (!e->running) {
+    int err = pthread_create(&e->thread, NULL, _expirer_main, e);
+    if (err) {
+      fprintf(stderr, "pthread_create: %s\n", strerror(err));
+      abort();
+    }
+    e->running = true;
+  }
+  if (world_timer_wheel_size(&e->wheel) == 0) {
+    // The wheel has not been advanced while it was empty.
+    world_timer_wheel_advance(&e->wheel, now / WORLD_ORIGIN_EXPIRER_TICK_MSEC);
+    pthread_cond_signal(&e->cond);
+  }
+  world_timer_wheel_schedule(&e->wheel, &expiry->timer);
+  pthread_mutex_unlock(&e->mtx);
+}
+
+static void *_expirer_main(void *arg)
+{
+  struct world_origin_expirer *e = arg;
+
+  pthread_mutex_lock(&e->mtx);
+  while (!e->stopping) {
+    if (world_timer_wheel_size(&e->wheel) == 0) {
+      pthread_cond_wait(&e->cond, &e->mtx);
+    } else {
+      uint64_t deadline = _now_msec(CLOCK_REALTIME) + WORLD_ORIGIN_EXPIRER_TICK_MSEC;
+      struct timespec t;
+      t.tv_sec = deadline / 1000;
+      t.tv_nsec = deadline % 1000 * 1000000;
+      int err = pthread_cond_timedwait(&e->cond, &e->mtx, &t);
+      if (err && err != ETIMEDOUT) {
+        fprintf(stderr, "pthread_cond_timedwait: %s\n", strerror(err));
+        abort();
+      }
+    }
+    if (e->stopping) {
+      break;
+    }
+
+    struct world_timer *expired = world_timer_wheel_advance(&e->wheel, _now_msec(CLOCK_MONOTONIC) / WORLD_ORIGIN_EXPIRER_TICK_MSEC);
+    if (expired) {
+      // The keys are deleted without the lock, so that writers scheduling new
+      // expiries never wait for the stripes.
+      pthread_mutex_unlock(&e->mtx);
+      _expire(e, expired);
+      pthread_mutex_lock(&e->mtx);
+    }
+  }
+  pthread_mutex_unlock(&e->mtx);
+
+  return NULL;
+}
+
+static void _expire(struct world_origin_expirer *e, struct world_timer *expired)
+{
+  // A key written again since the expiry was scheduled is left as it is.
+  size_t n_expired = 0;
+  while (expired) {
+    struct _expiry *expiry = (struct _expiry *)expired;
+    expired = expired->next;
+    struct world_buffer key;
+    key.base = expiry->key;
+    key.size = expiry->key_size;
+    if (world_hashtable_expire(&e->origin->hashtable, key, expiry->seq) == world_error_ok) {
+      n_expired++;
+    }
+    world_allocator_free(&e->origin->allocator, expiry);
+  }
+
+  if (n_expired) {
+    world_origin_flush(e->origin);
+  }
+}
+
+static uint64_t _now_msec(clockid_t clock)
+{
+  struct timespec t;
+  if (clock_gettime(clock, &t) == -1) {
+    perror("clock_gettime");
+    abort();
+  }
+  return (uint64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
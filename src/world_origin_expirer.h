@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <world.h>
+#include "world_timer_wheel.h"
+
+#define WORLD_ORIGIN_EXPIRER_TICK_MSEC WORLD_ORIGIN_EXPIRY_RESOLUTION_MSEC
+
+struct world_origin;
+
+// The expirer thread is started on the first key with a TTL, and deletes the
+// expired keys through the log as writers do.
+struct world_origin_expirer {
+  pthread_mutex_t mtx;
+  pthread_cond_t cond;
+  struct world_timer_wheel wheel;
+  pthread_t thread;
+  bool running;
+  bool stopping;
+  struct world_origin *origin;
+};
+
+void world_origin_expirer_init(struct world_origin_expirer *e, struct world_origin *origin);
+void world_origin_expirer_destroy(struct world_origin_expirer *e);
+void world_origin_expirer_schedule(struct world_origin_expirer *e, struct world_buffer key, world_sequence seq, uint64_t ttl_msec);
@@ -22,8 +22,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/errno.h>
+#include <sys/socket.h>
 #include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 #include "world_assert.h"
 #include "world_origin.h"
@@ -31,8 +34,15 @@
 #include "world_origin_thread.h"
 
 static void _origin_io_writer(struct world_io_handler *h);
+static void _write(struct world_origin_handler *oh);
 static void _origin_io_error(struct world_io_handler *h);
-static void _fill_iovec(struct world_origin_handler *oh, struct iovec *iovecs, size_t n_iovecs);
+static bool _greet(struct world_origin_handler *oh);
+static void _sync(struct world_origin_handler *oh);
+static bool _needs_sync(struct world_origin_handler *oh);
+static void _send_control(struct world_origin_handler *oh, uint8_t type, world_sequence seq);
+static uint64_t _now_msec(void);
+static bool _fill_iovec(struct world_origin_handler *oh, struct iovec *iovecs, size_t n_iovecs);
+static bool _sendable(struct world_origin_handler *oh, struct world_hashtable_entry *entry);
 static void _drain_iovec(struct world_origin_handler *oh, struct iovec *iovecs, size_t n_iovecs, size_t n_written);
 
 struct world_origin_handler *world_origin_handler_new(struct world_origin *origin, struct world_origin_thread *thread, int fd)
@@ -46,6 +56,12 @@ struct world_origin_handler *world_origin_handler_new(struct world_origin *origi
   oh->snapshot_cursor = world_hashtable_front(&origin->hashtable);
   oh->log_cursor = world_hashtable_log(&origin->hashtable);
   oh->offset = 0;
+  oh->version = 0;
+  oh->capabilities = 0;
+  oh->greeting_deadline = _now_msec() + origin->conf.greeting_timeout_msec;
+  oh->synced = false;
+  oh->control.size = 0;
+  oh->position = 0;
   oh->origin = origin;
   oh->thread = thread;
 
@@ -65,11 +81,35 @@ world_sequence world_origin_handler_sequence(struct world_origin_handler *oh)
 static void _origin_io_writer(struct world_io_handler *h)
 {
   struct world_origin_handler *oh = (struct world_origin_handler *)h;
+  _write(oh);
+}
 
+static void _write(struct world_origin_handler *oh)
+{
   const size_t n_iovecs = 256;
 
+  if (!oh->version && !_greet(oh)) {
+    world_origin_thread_notify_updated(oh->thread, oh->base.fd);
+    return;
+  }
+
+  // The cursors and the entries sent are kept alive by the sequence we have
+  // published, but the walk from the cursors may pass over stale versions
+  // being reclaimed. We are only in the epoch while we walk, and never while
+  // we are blocked in writev(), which would hold back reclamation.
+  struct world_epoch *epoch = &oh->origin->hashtable.epoch;
+  size_t slot = world_epoch_enter(epoch);
+  _sync(oh);
   struct iovec iovecs[n_iovecs];
-  _fill_iovec(oh, iovecs, n_iovecs);
+  bool sendable = _fill_iovec(oh, iovecs, n_iovecs);
+  world_epoch_leave(epoch, slot);
+  if (iovecs[0].iov_len == 0 && !sendable) {
+    // The frames before the one the replica cannot parse have been sent.
+    // Skipping it would let the replica diverge silently.
+    fprintf(stderr, "world_origin_handler: data too large for the protocol version 1\n");
+    _origin_io_error(&oh->base);
+    return;
+  }
   if (iovecs[0].iov_len == 0) {
     world_origin_thread_notify_updated(oh->thread, oh->base.fd);
     return;
@@ -91,7 +131,9 @@ static void _origin_io_writer(struct world_io_handler *h)
     return;
   }
 
+  slot = world_epoch_enter(epoch);
   _drain_iovec(oh, iovecs, n_iovecs, n_written);
+  world_epoch_leave(epoch, slot);
 }
 
 static void _origin_io_error(struct world_io_handler *h)
@@ -105,25 +147,126 @@ static void _origin_io_error(struct world_io_handler *h)
   world_origin_thread_notify_closed(oh->thread, oh->base.fd);
 }
 
-static void _fill_iovec(struct world_origin_handler *oh, struct iovec *iovecs, size_t n_iovecs)
+static bool _greet(struct world_origin_handler *oh)
+{
+  // The hello is received without blocking, even if the fd is blocking. A
+  // replica which says nothing by the deadline speaks the version 1, and so
+  // does a peer which is not a socket.
+  uint8_t *buffer = oh->control.buffer;
+  ssize_t n_read = recv(oh->base.fd, buffer + oh->control.size, WORLD_PROTOCOL_CONTROL_SIZE - oh->control.size, MSG_DONTWAIT);
+  if (n_read > 0) {
+    oh->control.size += (size_t)n_read;
+  }
+  bool pending = n_read > 0 || (n_read == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK));
+  if (oh->control.size < WORLD_PROTOCOL_CONTROL_SIZE && pending && _now_msec() < oh->greeting_deadline) {
+    return false;
+  }
+
+  struct world_protocol_control hello;
+  world_key_size key_size;
+  world_data_size data_size;
+  memcpy(&key_size, buffer, sizeof(key_size));
+  memcpy(&data_size, buffer + sizeof(key_size), sizeof(data_size));
+  oh->version = 1;
+  if (oh->control.size == WORLD_PROTOCOL_CONTROL_SIZE &&
+      world_decode_key_size(key_size) == 0 &&
+      world_protocol_decode_control(buffer + sizeof(key_size) + sizeof(data_size), world_decode_data_size(data_size), &hello) &&
+      hello.type == WORLD_PROTOCOL_HELLO &&
+      hello.version >= WORLD_PROTOCOL_VERSION) {
+    oh->version = WORLD_PROTOCOL_VERSION;
+    oh->capabilities = hello.capabilities & WORLD_PROTOCOL_CAPABILITIES;
+  }
+  oh->control.size = 0;
+
+  // The dataset is sent as of the sequence where the log cursor stands.
+  if (oh->version == WORLD_PROTOCOL_VERSION) {
+    _send_control(oh, WORLD_PROTOCOL_HELLO, world_origin_handler_sequence(oh));
+  }
+  return true;
+}
+
+static void _sync(struct world_origin_handler *oh)
+{
+  // The sync frame follows the last entry of the dataset, so that the replica
+  // knows where the log starts.
+  if (!_needs_sync(oh) || oh->control.size) {
+    return;
+  }
+  struct world_hashtable_entry *lcursor = atomic_load_explicit(&oh->log_cursor, memory_order_relaxed);
+  struct world_hashtable_entry *scursor = oh->snapshot_cursor;
+  if (scursor && world_hashtable_entry_advance(&scursor, NULL, lcursor->base.seq)) {
+    return;
+  }
+  oh->snapshot_cursor = NULL;
+  oh->synced = true;
+  _send_control(oh, WORLD_PROTOCOL_SYNC, lcursor->base.seq);
+}
+
+static bool _needs_sync(struct world_origin_handler *oh)
 {
+  return (oh->capabilities & WORLD_PROTOCOL_CAPABILITY_SEQUENCE) && !oh->synced;
+}
+
+static void _send_control(struct world_origin_handler *oh, uint8_t type, world_sequence seq)
+{
+  WORLD_ASSERT(oh->control.size == 0 && oh->offset == 0);
+  struct world_protocol_control control;
+  control.type = type;
+  control.version = WORLD_PROTOCOL_VERSION;
+  control.capabilities = oh->capabilities;
+  control.seq = seq;
+  world_protocol_encode_control(oh->control.buffer, &control);
+  oh->control.size = WORLD_PROTOCOL_CONTROL_SIZE;
+}
+
+static uint64_t _now_msec(void)
+{
+  struct timespec t;
+  if (clock_gettime(CLOCK_MONOTONIC, &t) == -1) {
+    perror("clock_gettime");
+    abort();
+  }
+  return (uint64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+static bool _fill_iovec(struct world_origin_handler *oh, struct iovec *iovecs, size_t n_iovecs)
+{
+  // Returns false if it has stopped at a frame the replica cannot parse.
   memset(iovecs, 0, sizeof(struct iovec) * n_iovecs);
 
+  size_t i = 0;
+  if (oh->control.size) {
+    iovecs[i].iov_base = oh->control.buffer;
+    iovecs[i].iov_len = oh->control.size;
+    i++;
+  }
+
+  bool sendable = true;
   struct world_hashtable_entry *scursor = oh->snapshot_cursor;
   struct world_hashtable_entry *lcursor = oh->log_cursor;
-  for (size_t i = 0; i < n_iovecs; i++) {
+  for (; i < n_iovecs; i++) {
     struct world_buffer iovec;
     if (scursor) {
-      struct world_hashtable_entry *entry = world_hashtable_entry_advance(&scursor, lcursor->base.seq);
+      struct world_hashtable_entry *entry = world_hashtable_entry_advance(&scursor, NULL, lcursor->base.seq);
       if (entry) {
+        if (!(sendable = _sendable(oh, entry))) {
+          break;
+        }
         iovec = world_hashtable_entry_raw(entry);
       }
     }
     if (!scursor) {
+      // The log waits for the sync frame after the dataset.
+      if (_needs_sync(oh)) {
+        break;
+      }
       struct world_hashtable_entry *entry = atomic_load_explicit(&lcursor->log, memory_order_relaxed);
       if (!entry) {
         break;
       }
+      if (!(sendable = _sendable(oh, entry))) {
+        break;
+      }
       iovec = world_hashtable_entry_raw(entry);
       lcursor = entry;
     }
@@ -134,11 +277,29 @@ static void _fill_iovec(struct world_origin_handler *oh, struct iovec *iovecs, s
   WORLD_ASSERT(iovecs[0].iov_len >= oh->offset);
   iovecs[0].iov_base = (char *)((uintptr_t)iovecs[0].iov_base + oh->offset);
   iovecs[0].iov_len -= oh->offset;
+  return sendable;
+}
+
+static bool _sendable(struct world_origin_handler *oh, struct world_hashtable_entry *entry)
+{
+  return oh->version == WORLD_PROTOCOL_VERSION || world_hashtable_entry_data(entry).size < WORLD_DATA_SIZE_ESCAPE;
 }
 
 static void _drain_iovec(struct world_origin_handler *oh, struct iovec *iovecs, size_t n_iovecs, size_t n_written)
 {
-  for (size_t i = 0; i < n_iovecs; i++) {
+  world_sequence seq = world_origin_handler_sequence(oh);
+  size_t i = 0;
+  if (oh->control.size) {
+    if (n_written < iovecs[0].iov_len) {
+      oh->offset += n_written;
+      return;
+    }
+    oh->offset = 0;
+    oh->control.size = 0;
+    n_written -= iovecs[0].iov_len;
+    i++;
+  }
+  for (; i < n_iovecs; i++) {
     if (iovecs[i].iov_len == 0) {
       break;
     }
@@ -153,10 +314,14 @@ static void _drain_iovec(struct world_origin_handler *oh, struct iovec *iovecs,
 
     struct world_hashtable_entry *lcursor = atomic_load_explicit(&oh->log_cursor, memory_order_relaxed);
     if (oh->snapshot_cursor &&
-        world_hashtable_entry_advance(&oh->snapshot_cursor, lcursor->base.seq)) {
+        world_hashtable_entry_advance(&oh->snapshot_cursor, NULL, lcursor->base.seq)) {
       continue;
     }
     atomic_store_explicit(&oh->log_cursor, atomic_load_explicit(&lcursor->log, memory_order_relaxed), memory_order_relaxed);
     WORLD_ASSERT(oh->log_cursor);
   }
+
+  if (world_origin_handler_sequence(oh) != seq) {
+    world_origin_thread_notify_advanced(oh->thread, oh);
+  }
 }
@@ -25,8 +25,10 @@
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "world_hashtable_entry.h"
 #include "world_io.h"
+#include "world_protocol.h"
 
 struct world_origin;
 struct world_origin_thread;
@@ -39,6 +41,21 @@ struct world_origin_handler {
 
   size_t offset;
 
+  // The protocol version is settled by the greeting, which waits for a hello
+  // of the replica until the deadline. A control frame to be sent goes before
+  // any entries, and the offset applies to it first.
+  unsigned int version;
+  uint32_t capabilities;
+  uint64_t greeting_deadline;
+  bool synced;
+  struct {
+    uint8_t buffer[WORLD_PROTOCOL_CONTROL_SIZE];
+    size_t size;
+  } control;
+
+  // A position in the queue of the thread, ordered by the sequence.
+  size_t position;
+
   struct world_origin *origin;
   struct world_origin_thread *thread;
 };
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "world_hashtable_entry.h"
+#include "world_origin.h"
+#include "world_origin_reclaimer.h"
+
+static void *_reclaimer_main(void *arg);
+static bool _reclaim(struct world_origin_reclaimer *r);
+
+void world_origin_reclaimer_init(struct world_origin_reclaimer *r, struct world_origin *origin)
+{
+  int err;
+
+  if ((err = pthread_mutex_init(&r->mtx, NULL))) {
+    fprintf(stderr, "pthread_mutex_init: %s\n", strerror(err));
+    abort();
+  }
+
+  if ((err = pthread_cond_init(&r->cond, NULL))) {
+    fprintf(stderr, "pthread_cond_init: %s\n", strerror(err));
+    abort();
+  }
+
+  atomic_init(&r->requested, false);
+  r->stopping = false;
+  r->origin = origin;
+
+  if ((err = pthread_create(&r->thread, NULL, _reclaimer_main, r))) {
+    fprintf(stderr, "pthread_create: %s\n", strerror(err));
+    abort();
+  }
+}
+
+void world_origin_reclaimer_destroy(struct world_origin_reclaimer *r)
+{
+  pthread_mutex_lock(&r->mtx);
+  r->stopping = true;
+  pthread_cond_signal(&r->cond);
+  pthread_mutex_unlock(&r->mtx);
+
+  int err = pthread_join(r->thread, NULL);
+  if (err) {
+    fprintf(stderr, "pthread_join: %s\n", strerror(err));
+  }
+
+  pthread_cond_destroy(&r->cond);
+  pthread_mutex_destroy(&r->mtx);
+}
+
+void world_origin_reclaimer_notify(struct world_origin_reclaimer *r)
+{
+  // Writers find the reclaimer already requested most of the time, and then
+  // take no lock. It clears the request before it starts reclaiming, so that
+  // it sees whatever they have written.
+  if (atomic_load(&r->requested)) {
+    return;
+  }
+  pthread_mutex_lock(&r->mtx);
+  atomic_store(&r->requested, true);
+  pthread_cond_signal(&r->cond);
+  pthread_mutex_unlock(&r->mtx);
+}
+
+static void *_reclaimer_main(void *arg)
+{
+  struct world_origin_reclaimer *r = arg;
+
+  bool behind = false;
+  pthread_mutex_lock(&r->mtx);
+  while (!r->stopping) {
+    if (!atomic_load(&r->requested) && !behind) {
+      pthread_cond_wait(&r->cond, &r->mtx);
+    } else if (!atomic_load(&r->requested)) {
+      struct timespec t;
+      if (clock_gettime(CLOCK_REALTIME, &t) == -1) {
+        perror("clock_gettime");
+        abort();
+      }
+      t.tv_nsec += WORLD_ORIGIN_RECLAIMER_INTERVAL_MSEC * 1000000;
+      if (t.tv_nsec >= 1000000000) {
+        t.tv_sec++;
+        t.tv_nsec -= 1000000000;
+      }
+      int err = pthread_cond_timedwait(&r->cond, &r->mtx, &t);
+      if (err && err != ETIMEDOUT) {
+        fprintf(stderr, "pthread_cond_timedwait: %s\n", strerror(err));
+        abort();
+      }
+    }
+    if (r->stopping) {
+      break;
+    }
+    atomic_store(&r->requested, false);
+
+    pthread_mutex_unlock(&r->mtx);
+    behind = _reclaim(r);
+    pthread_mutex_lock(&r->mtx);
+  }
+  pthread_mutex_unlock(&r->mtx);
+
+  return NULL;
+}
+
+static bool _reclaim(struct world_origin_reclaimer *r)
+{
+  // Each checkpoint does a limited amount of work, so that writers take the
+  // locks in between. The I/O threads publish the sequences they have sent up
+  // to, and stay in the epoch while they walk the list, so that whatever they
+  // may still read is not freed.
+  struct world_hashtable *ht = &r->origin->hashtable;
+  world_sequence seq = world_origin_least_sequence(r->origin);
+  while (!world_hashtable_checkpoint(ht, seq, NULL)) {
+  }
+  return seq < world_hashtable_log(ht)->base.seq;
+}
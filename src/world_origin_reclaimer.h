@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define WORLD_ORIGIN_RECLAIMER_INTERVAL_MSEC 10
+
+struct world_origin;
+
+// The reclaimer thread trims the log and frees garbages on behalf of writers,
+// which only wake it up. While some replicas are behind, it also looks again
+// at intervals, since they catch up without any further writes.
+struct world_origin_reclaimer {
+  pthread_mutex_t mtx;
+  pthread_cond_t cond;
+  pthread_t thread;
+  _Atomic(bool) requested;
+  bool stopping;
+  struct world_origin *origin;
+};
+
+void world_origin_reclaimer_init(struct world_origin_reclaimer *r, struct world_origin *origin);
+void world_origin_reclaimer_destroy(struct world_origin_reclaimer *r);
+void world_origin_reclaimer_notify(struct world_origin_reclaimer *r);
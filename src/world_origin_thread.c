@@ -31,6 +31,7 @@ static void _stop(struct world_origin_thread *ot);
 static void *_origin_main(void *arg);
 static void _detach_closed_handlers(struct world_origin_thread *ot);
 static void _enable_updated_handlers(struct world_origin_thread *ot);
+static world_sequence _least_sequence(struct world_origin_thread *ot);
 
 static void _dispatcher_init(struct world_origin_thread_dispatcher *dp, struct world_allocator *a);
 static void _dispatcher_destroy(struct world_origin_thread_dispatcher *dp);
@@ -39,6 +40,13 @@ static void _dispatcher_detach(struct world_origin_thread_dispatcher *dp, int fd
 static void _dispatcher_interrupt(struct world_origin_thread_dispatcher *dp);
 static struct world_origin_handler **_dispatcher_get_handler(struct world_origin_thread_dispatcher *dp, int fd);
 
+static void _queue_push(struct world_vector *queue, struct world_origin_handler *oh);
+static void _queue_remove(struct world_vector *queue, struct world_origin_handler *oh);
+static void _queue_sift_up(struct world_vector *queue, size_t i);
+static void _queue_sift_down(struct world_vector *queue, size_t i);
+static struct world_origin_handler *_queue_at(struct world_vector *queue, size_t i);
+static void _queue_set(struct world_vector *queue, size_t i, struct world_origin_handler *oh);
+
 void world_origin_thread_init(struct world_origin_thread *ot, struct world_origin *origin)
 {
   _dispatcher_init(&ot->dispatcher, &origin->allocator);
@@ -46,6 +54,7 @@ void world_origin_thread_init(struct world_origin_thread *ot, struct world_origi
   world_circular_init(&ot->updated, &origin->allocator);
 
   ot->origin = origin;
+  atomic_init(&ot->least, world_hashtable_log(&origin->hashtable)->base.seq);
 
   int err = pthread_create(&ot->thread, NULL, _origin_main, ot);
   if (err) {
@@ -99,20 +108,15 @@ void world_origin_thread_notify_updated(struct world_origin_thread *ot, int fd)
   world_circular_push_back(&ot->updated, &fd, sizeof(fd));
 }
 
+void world_origin_thread_notify_advanced(struct world_origin_thread *ot, struct world_origin_handler *oh)
+{
+  // Sequences only go forward.
+  _queue_sift_down(&ot->dispatcher.queue, oh->position);
+}
+
 world_sequence world_origin_thread_least_sequence(struct world_origin_thread *ot)
 {
-  world_sequence seq = world_hashtable_log(&ot->origin->hashtable)->base.seq;
-  for (size_t i = 0; i < world_vector_size(&ot->dispatcher.handlers); i++) {
-    struct world_origin_handler **handler = world_vector_at(&ot->dispatcher.handlers, i, sizeof(*handler));
-    if (!*handler) {
-      continue;
-    }
-    world_sequence seq_handler = world_origin_handler_sequence(*handler);
-    if (seq > seq_handler) {
-      seq = seq_handler;
-    }
-  }
-  return seq;
+  return atomic_load_explicit(&ot->least, memory_order_acquire);
 }
 
 static void _stop(struct world_origin_thread *ot)
@@ -136,6 +140,7 @@ static void *_origin_main(void *arg)
     world_io_multiplexer_dispatch(&ot->dispatcher.multiplexer);
     _enable_updated_handlers(ot);
     _detach_closed_handlers(ot);
+    atomic_store_explicit(&ot->least, _least_sequence(ot), memory_order_release);
 
     world_mutex_unlock(&ot->dispatcher.mtx);
   }
@@ -173,10 +178,22 @@ static void _enable_updated_handlers(struct world_origin_thread *ot)
   }
 }
 
+static world_sequence _least_sequence(struct world_origin_thread *ot)
+{
+  // A handler attached later starts from the end of the log, which is never
+  // older than the sequence published before.
+  struct world_vector *queue = &ot->dispatcher.queue;
+  if (world_vector_size(queue) == 0) {
+    return world_hashtable_log(&ot->origin->hashtable)->base.seq;
+  }
+  return world_origin_handler_sequence(_queue_at(queue, 0));
+}
+
 static void _dispatcher_init(struct world_origin_thread_dispatcher *dp, struct world_allocator *a)
 {
   world_mutex_init(&dp->mtx);
   world_vector_init(&dp->handlers, a);
+  world_vector_init(&dp->queue, a);
   world_io_multiplexer_init(&dp->multiplexer, a);
   world_io_interrupter_init(&dp->interrupter);
 
@@ -195,6 +212,7 @@ static void _dispatcher_destroy(struct world_origin_thread_dispatcher *dp)
 
   world_mutex_destroy(&dp->mtx);
   world_vector_destroy(&dp->handlers);
+  world_vector_destroy(&dp->queue);
   world_io_multiplexer_destroy(&dp->multiplexer);
   world_io_interrupter_destroy(&dp->interrupter);
 }
@@ -212,6 +230,7 @@ static void _dispatcher_attach(struct world_origin_thread_dispatcher *dp, int fd
     return;
   }
   *handler = world_origin_handler_new(ot->origin, ot, fd);
+  _queue_push(&dp->queue, *handler);
   world_io_multiplexer_attach(&dp->multiplexer, &(*handler)->base);
   (*handler)->base.writer(&(*handler)->base);
 }
@@ -223,6 +242,7 @@ static void _dispatcher_detach(struct world_origin_thread_dispatcher *dp, int fd
     return;
   }
   world_io_multiplexer_detach(&dp->multiplexer, &(*handler)->base);
+  _queue_remove(&dp->queue, *handler);
   world_origin_handler_delete(*handler);
   *handler = NULL;
 }
@@ -239,3 +259,72 @@ static struct world_origin_handler **_dispatcher_get_handler(struct world_origin
   }
   return world_vector_at(&dp->handlers, fd, sizeof(struct world_origin_handler *));
 }
+
+static void _queue_push(struct world_vector *queue, struct world_origin_handler *oh)
+{
+  oh->position = world_vector_size(queue);
+  world_vector_push_back(queue, &oh, sizeof(oh));
+  _queue_sift_up(queue, oh->position);
+}
+
+static void _queue_remove(struct world_vector *queue, struct world_origin_handler *oh)
+{
+  size_t i = oh->position;
+  struct world_origin_handler *last = *(struct world_origin_handler **)world_vector_back(queue, sizeof(last));
+  world_vector_pop_back(queue);
+  if (last == oh) {
+    return;
+  }
+  _queue_set(queue, i, last);
+  _queue_sift_up(queue, i);
+  _queue_sift_down(queue, last->position);
+}
+
+static void _queue_sift_up(struct world_vector *queue, size_t i)
+{
+  struct world_origin_handler *oh = _queue_at(queue, i);
+  world_sequence seq = world_origin_handler_sequence(oh);
+  while (i > 0) {
+    struct world_origin_handler *parent = _queue_at(queue, (i - 1) / 2);
+    if (world_origin_handler_sequence(parent) <= seq) {
+      break;
+    }
+    _queue_set(queue, i, parent);
+    i = (i - 1) / 2;
+  }
+  _queue_set(queue, i, oh);
+}
+
+static void _queue_sift_down(struct world_vector *queue, size_t i)
+{
+  size_t n = world_vector_size(queue);
+  struct world_origin_handler *oh = _queue_at(queue, i);
+  world_sequence seq = world_origin_handler_sequence(oh);
+  for (;;) {
+    size_t child = i * 2 + 1;
+    if (child >= n) {
+      break;
+    }
+    if (child + 1 < n &&
+        world_origin_handler_sequence(_queue_at(queue, child + 1)) < world_origin_handler_sequence(_queue_at(queue, child))) {
+      child++;
+    }
+    if (seq <= world_origin_handler_sequence(_queue_at(queue, child))) {
+      break;
+    }
+    _queue_set(queue, i, _queue_at(queue, child));
+    i = child;
+  }
+  _queue_set(queue, i, oh);
+}
+
+static struct world_origin_handler *_queue_at(struct world_vector *queue, size_t i)
+{
+  return *(struct world_origin_handler **)world_vector_at(queue, i, sizeof(struct world_origin_handler *));
+}
+
+static void _queue_set(struct world_vector *queue, size_t i, struct world_origin_handler *oh)
+{
+  *(struct world_origin_handler **)world_vector_at(queue, i, sizeof(oh)) = oh;
+  oh->position = i;
+}
@@ -23,17 +23,22 @@
 #pragma once
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <world.h>
 #include "world_circular.h"
 #include "world_io.h"
 #include "world_mutex.h"
 #include "world_vector.h"
 
 struct world_origin;
+struct world_origin_handler;
 
 struct world_origin_thread {
   struct world_origin_thread_dispatcher {
     struct world_mutex mtx;
     struct world_vector handlers;
+    // A min-heap of the handlers by their sequences.
+    struct world_vector queue;
     struct world_io_multiplexer multiplexer;
     struct world_io_interrupter interrupter;
   } dispatcher;
@@ -43,6 +48,10 @@ struct world_origin_thread {
 
   pthread_t thread;
 
+  // The least sequence of the handlers, published by the thread itself after
+  // each dispatch, when none of them is looking at an older entry any more.
+  _Atomic(world_sequence) least;
+
   struct world_origin *origin;
 };
 
@@ -53,4 +62,5 @@ void world_origin_thread_detach(struct world_origin_thread *ot, int fd);
 void world_origin_thread_interrupt(struct world_origin_thread *ot);
 void world_origin_thread_notify_closed(struct world_origin_thread *ot, int fd);
 void world_origin_thread_notify_updated(struct world_origin_thread *ot, int fd);
+void world_origin_thread_notify_advanced(struct world_origin_thread *ot, struct world_origin_handler *oh);
 world_sequence world_origin_thread_least_sequence(struct world_origin_thread *ot);
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <world.h>
+#include "world_byteorder.h"
+
+// The protocol version 1 consists of bare frames of a key size, a data size,
+// a key and a data. The version 2 begins with a handshake: a replica says
+// hello with its version and capabilities, and an origin which hears it in
+// time answers with the common ones and the sequence of the dataset it is
+// going to send. Otherwise the origin falls back to the version 1.
+//
+// Data sizes of WORLD_DATA_SIZE_ESCAPE or more are only sent by the version
+// 2, since the version 1 has no escape. An origin closes a connection of the
+// version 1 rather than send such a data.
+//
+// Control frames are those with an empty key, which the version 1 never
+// sends. Their data has a fixed layout of a type, a version, capabilities and
+// a sequence, all in network byte order.
+//
+// With the sequence capability, the origin sends a sync frame once the dataset
+// has been sent, and then each frame of the log has the next sequence.
+#define WORLD_PROTOCOL_VERSION 2
+#define WORLD_PROTOCOL_HELLO 1
+#define WORLD_PROTOCOL_SYNC 2
+#define WORLD_PROTOCOL_CAPABILITY_SEQUENCE (UINT32_C(1) << 0)
+#define WORLD_PROTOCOL_CAPABILITIES WORLD_PROTOCOL_CAPABILITY_SEQUENCE
+#define WORLD_PROTOCOL_CONTROL_DATA_SIZE 16
+#define WORLD_PROTOCOL_CONTROL_SIZE (sizeof(world_key_size) + sizeof(world_data_size) + WORLD_PROTOCOL_CONTROL_DATA_SIZE)
+
+struct world_protocol_control {
+  uint8_t type;
+  uint8_t version;
+  uint32_t capabilities;
+  world_sequence seq;
+};
+
+static inline void world_protocol_encode_control(uint8_t frame[WORLD_PROTOCOL_CONTROL_SIZE], const struct world_protocol_control *control);
+static inline bool world_protocol_decode_control(const uint8_t *data, size_t size, struct world_protocol_control *control);
+
+static inline void world_protocol_encode_control(uint8_t frame[WORLD_PROTOCOL_CONTROL_SIZE], const struct world_protocol_control *control)
+{
+  world_key_size key_size = world_encode_key_size(0);
+  world_data_size data_size = world_encode_data_size(WORLD_PROTOCOL_CONTROL_DATA_SIZE);
+  memcpy(frame, &key_size, sizeof(key_size));
+  memcpy(frame + sizeof(key_size), &data_size, sizeof(data_size));
+
+  uint8_t *data = frame + sizeof(key_size) + sizeof(data_size);
+  memset(data, 0, WORLD_PROTOCOL_CONTROL_DATA_SIZE);
+  data[0] = control->type;
+  data[1] = control->version;
+  for (size_t i = 0; i < 4; i++) {
+    data[4 + i] = (uint8_t)(control->capabilities >> (24 - 8 * i));
+  }
+  for (size_t i = 0; i < 8; i++) {
+    data[8 + i] = (uint8_t)(control->seq >> (56 - 8 * i));
+  }
+}
+
+static inline bool world_protocol_decode_control(const uint8_t *data, size_t size, struct world_protocol_control *control)
+{
+  // Control frames of a later version may be longer, and the rest is ignored.
+  if (size < WORLD_PROTOCOL_CONTROL_DATA_SIZE) {
+    return false;
+  }
+  control->type = data[0];
+  control->version = data[1];
+  control->capabilities = 0;
+  for (size_t i = 0; i < 4; i++) {
+    control->capabilities = control->capabilities << 8 | data[4 + i];
+  }
+  control->seq = 0;
+  for (size_t i = 0; i < 8; i++) {
+    control->seq = control->seq << 8 | data[8 + i];
+  }
+  return true;
+}
@@ -25,9 +25,18 @@
 #include <string.h>
 #include "world_hash.h"
 #include "world_replica.h"
+#include "world_snapshot.h"
 #include "world_system.h"
 
+struct _bounded {
+  struct world_buffer bound;
+  bool prefix;
+  bool (*fn)(void *ctx, struct world_buffer key, struct world_buffer data);
+  void *ctx;
+};
+
 static bool _validate_conf(const struct world_replicaconf *conf);
+static bool _bounded(void *ctx, struct world_buffer key, struct world_buffer data);
 
 enum world_error world_replica_open(struct world_replica **r, const struct world_replicaconf *conf)
 {
@@ -35,13 +44,31 @@ enum world_error world_replica_open(struct world_replica **r, const struct world
     return world_error_invalid_argument;
   }
 
-  struct world_allocator allocator;
-  world_allocator_init(&allocator);
-  struct world_replica *replica = world_allocator_malloc(&allocator, sizeof(*replica));
-  memcpy(&replica->allocator, &allocator, sizeof(allocator));
+  // The allocator cannot be moved once initialized, so that the handle itself
+  // is allocated by malloc(3).
+  struct world_replica *replica = malloc(sizeof(*replica));
+  if (!replica) {
+    perror("malloc");
+    abort();
+  }
+  world_allocator_init(&replica->allocator);
 
   memcpy((void *)&replica->conf, conf, sizeof(replica->conf));
-  world_hashtable_init(&replica->hashtable, world_generate_seed(), &replica->allocator);
+  struct world_hash_seed seed;
+  world_generate_seed(&seed);
+  world_hashtable_init(&replica->hashtable, replica->conf.hash_function, &seed, replica->conf.expected_cardinality, replica->conf.max_load_factor, &replica->allocator);
+  if (replica->conf.lean) {
+    world_hashtable_enable_lean(&replica->hashtable);
+  }
+  if (replica->conf.in_place) {
+    world_hashtable_enable_in_place(&replica->hashtable);
+  }
+  if (replica->conf.ordered_index) {
+    world_skiplist_init(&replica->index, &replica->hashtable.epoch, &replica->allocator);
+    if (replica->conf.in_place) {
+      world_skiplist_enable_copy(&replica->index);
+    }
+  }
   world_replica_thread_init(&replica->thread, replica);
 
   *r = replica;
@@ -51,12 +78,13 @@ enum world_error world_replica_open(struct world_replica **r, const struct world
 enum world_error world_replica_close(struct world_replica *replica)
 {
   world_replica_thread_destroy(&replica->thread);
+  if (replica->conf.ordered_index) {
+    world_skiplist_destroy(&replica->index);
+  }
   world_hashtable_destroy(&replica->hashtable);
 
-  struct world_allocator allocator;
-  memcpy(&allocator, &replica->allocator, sizeof(allocator));
-  world_allocator_free(&allocator, replica);
-  world_allocator_destroy(&allocator);
+  world_allocator_destroy(&replica->allocator);
+  free(replica);
 
   return world_error_ok;
 }
@@ -66,6 +94,106 @@ enum world_error world_replica_get(const struct world_replica *replica, struct w
   return world_hashtable_get((struct world_hashtable *)&replica->hashtable, key, data);
 }
 
+enum world_error world_replica_get_copy(const struct world_replica *replica, struct world_buffer key, void *buffer, size_t capacity, size_t *size)
+{
+  return world_hashtable_get_copy((struct world_hashtable *)&replica->hashtable, key, buffer, capacity, size);
+}
+
+enum world_error world_replica_get_many(const struct world_replica *replica, struct world_read *reads, size_t n_reads)
+{
+  return world_hashtable_get_many((struct world_hashtable *)&replica->hashtable, reads, n_reads);
+}
+
+enum world_error world_replica_get_pinned(const struct world_replica *replica, struct world_buffer key, struct world_pin *pin)
+{
+  return world_hashtable_get_pinned((struct world_hashtable *)&replica->hashtable, key, pin);
+}
+
+enum world_error world_replica_release(const struct world_replica *replica, struct world_pin *pin)
+{
+  if (!pin || pin->slot == WORLD_EPOCH_NO_SLOT) {
+    return world_error_invalid_argument;
+  }
+
+  world_hashtable_release((struct world_hashtable *)&replica->hashtable, pin);
+  return world_error_ok;
+}
+
+enum world_error world_replica_range(const struct world_replica *replica, struct world_buffer lower, struct world_buffer upper, bool (*fn)(void *ctx, struct world_buffer key, struct world_buffer data), void *ctx)
+{
+  if (!replica->conf.ordered_index || !fn) {
+    return world_error_invalid_argument;
+  }
+
+  struct _bounded bounded;
+  bounded.bound = upper;
+  bounded.prefix = false;
+  bounded.fn = fn;
+  bounded.ctx = ctx;
+  world_skiplist_scan((struct world_skiplist *)&replica->index, lower, _bounded, &bounded);
+  return world_error_ok;
+}
+
+enum world_error world_replica_prefix(const struct world_replica *replica, struct world_buffer prefix, bool (*fn)(void *ctx, struct world_buffer key, struct world_buffer data), void *ctx)
+{
+  if (!replica->conf.ordered_index || !fn) {
+    return world_error_invalid_argument;
+  }
+
+  // The keys with the prefix are contiguous from the prefix itself.
+  struct _bounded bounded;
+  bounded.bound = prefix;
+  bounded.prefix = true;
+  bounded.fn = fn;
+  bounded.ctx = ctx;
+  world_skiplist_scan((struct world_skiplist *)&replica->index, prefix, _bounded, &bounded);
+  return world_error_ok;
+}
+
+enum world_error world_replica_snapshot_open(struct world_replica *replica, size_t n_partitions, struct world_snapshot **snapshot)
+{
+  if (replica->conf.lean || n_partitions == 0 || n_partitions > WORLD_MAX_SNAPSHOT_PARTITIONS || !snapshot) {
+    return world_error_invalid_argument;
+  }
+
+  *snapshot = world_snapshot_new(&replica->hashtable, &replica->allocator, n_partitions);
+  return world_error_ok;
+}
+
+enum world_error world_replica_memory(const struct world_replica *replica, struct world_memory *memory)
+{
+  if (!memory) {
+    return world_error_invalid_argument;
+  }
+
+  struct world_allocator *allocator = (struct world_allocator *)&replica->allocator;
+  memory->held = world_allocator_held(allocator);
+  memory->live = world_allocator_live(allocator);
+  memory->dataset = world_hashtable_live_bytes((struct world_hashtable *)&replica->hashtable);
+  memory->stale = world_hashtable_stale_bytes((struct world_hashtable *)&replica->hashtable);
+  return world_error_ok;
+}
+
+enum world_error world_replica_sequence(const struct world_replica *replica, world_sequence *seq)
+{
+  if (!seq) {
+    return world_error_invalid_argument;
+  }
+
+  *seq = world_replica_handler_sequence((struct world_replica_handler *)&replica->thread.handler);
+  return world_error_ok;
+}
+
+enum world_error world_replica_protocol_version(const struct world_replica *replica, unsigned int *version)
+{
+  if (!version) {
+    return world_error_invalid_argument;
+  }
+
+  *version = world_replica_handler_version((struct world_replica_handler *)&replica->thread.handler);
+  return world_error_ok;
+}
+
 static bool _validate_conf(const struct world_replicaconf *conf)
 {
   if (!world_check_fd(conf->fd)) {
@@ -73,5 +201,39 @@ static bool _validate_conf(const struct world_replicaconf *conf)
     return false;
   }
 
+  if (!world_hash_validate_function(conf->hash_function)) {
+    fprintf(stderr, "world_replica_open: hash_function: invalid value");
+    return false;
+  }
+
+  if (!(conf->max_load_factor >= WORLD_MIN_LOAD_FACTOR)) {
+    fprintf(stderr, "world_replica_open: max_load_factor should be at least WORLD_MIN_LOAD_FACTOR");
+    return false;
+  }
+
+  if ((double)conf->expected_cardinality > (double)WORLD_MAX_BUCKETS * conf->max_load_factor) {
+    fprintf(stderr, "world_replica_open: expected_cardinality: too large");
+    return false;
+  }
+
+  if (conf->in_place && !conf->lean) {
+    fprintf(stderr, "world_replica_open: in_place requires lean");
+    return false;
+  }
+
   return true;
 }
+
+static bool _bounded(void *ctx, struct world_buffer key, struct world_buffer data)
+{
+  struct _bounded *bounded = ctx;
+  struct world_buffer bound = bounded->bound;
+  if (bounded->prefix) {
+    if (key.size < bound.size || (bound.size && memcmp(key.base, bound.base, bound.size) != 0)) {
+      return false;
+    }
+  } else if (bound.base && world_skiplist_compare(key, bound) >= 0) {
+    return false;
+  }
+  return bounded->fn(bounded->ctx, key, data);
+}
@@ -26,10 +26,12 @@
 #include "world_allocator.h"
 #include "world_hashtable.h"
 #include "world_replica_thread.h"
+#include "world_skiplist.h"
 
 struct world_replica {
   struct world_allocator allocator;
   const struct world_replicaconf conf;
   struct world_hashtable hashtable;
+  struct world_skiplist index;
   struct world_replica_thread thread;
 };
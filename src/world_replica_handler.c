@@ -20,31 +20,32 @@
  * SOFTWARE.
  */
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/errno.h>
-#include <sys/uio.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include "world_assert.h"
 #include "world_byteorder.h"
 #include "world_hashtable.h"
 #include "world_hashtable_entry.h"
+#include "world_protocol.h"
 #include "world_replica.h"
 #include "world_replica_handler.h"
 
 static void _replica_io_reader(struct world_io_handler *h);
 static void _replica_io_error(struct world_io_handler *h);
-static void _reserve_body_buffer(struct world_replica_handler *rh);
-static size_t _key_size(struct world_replica_handler *rh);
-static size_t _data_size(struct world_replica_handler *rh);
-static size_t _body_size(struct world_replica_handler *rh);
-static bool _key_size_is_filled(struct world_replica_handler *rh);
-static bool _data_size_is_filled(struct world_replica_handler *rh);
-static bool _header_is_filled(struct world_replica_handler *rh);
-static bool _body_is_filled(struct world_replica_handler *rh);
-static void _fill_iovec(struct world_replica_handler *rh, struct iovec iovecs[3]);
-static void _drain_iovec(struct world_replica_handler *rh, struct iovec iovecs[3], size_t n_read);
-static void _apply_log(struct world_replica_handler *rh);
+static void _greet(struct world_replica_handler *rh);
+static void _apply_control(struct world_replica_handler *rh, const uint8_t *data, size_t size, world_sequence *seq);
+static void _reserve_receive_buffer(struct world_replica_handler *rh);
+static void _compact_receive_buffer(struct world_replica_handler *rh);
+static bool _frame_size(struct world_replica_handler *rh, size_t *frame_size);
+static bool _decode_header(struct world_replica_handler *rh, size_t *header_size, size_t *key_size, size_t *data_size);
+static void _apply_frames(struct world_replica_handler *rh);
+static void _apply_writes(struct world_replica_handler *rh);
 
 void world_replica_handler_init(struct world_replica_handler *rh, struct world_replica *replica)
 {
@@ -52,32 +53,47 @@ void world_replica_handler_init(struct world_replica_handler *rh, struct world_r
   rh->base.reader = _replica_io_reader;
   rh->base.writer = NULL;
   rh->base.error = _replica_io_error;
-  rh->key_size.buffer = 0;
-  rh->key_size.offset = 0;
-  rh->data_size.buffer = 0;
-  rh->data_size.offset = 0;
-  rh->body.buffer = NULL;
-  rh->body.capacity = 0;
-  rh->body.offset = 0;
+  rh->receive.buffer = world_allocator_malloc(&replica->allocator, WORLD_REPLICA_HANDLER_RECEIVE_BUFFER_SIZE);
+  rh->receive.capacity = WORLD_REPLICA_HANDLER_RECEIVE_BUFFER_SIZE;
+  rh->receive.head = 0;
+  rh->receive.tail = 0;
+  world_vector_init(&rh->writes, &replica->allocator);
+  world_vector_init(&rh->linked, &replica->allocator);
+  atomic_init(&rh->sequence, 0);
+  rh->synced = false;
+  atomic_init(&rh->version, 0);
   rh->replica = replica;
+
+  _greet(rh);
+}
+
+world_sequence world_replica_handler_sequence(struct world_replica_handler *rh)
+{
+  return atomic_load_explicit(&rh->sequence, memory_order_acquire);
+}
+
+unsigned int world_replica_handler_version(struct world_replica_handler *rh)
+{
+  return atomic_load_explicit(&rh->version, memory_order_relaxed);
 }
 
 void world_replica_handler_destroy(struct world_replica_handler *rh)
 {
-  world_allocator_free(&rh->replica->allocator, rh->body.buffer);
+  world_vector_destroy(&rh->linked);
+  world_vector_destroy(&rh->writes);
+  world_allocator_free(&rh->replica->allocator, rh->receive.buffer);
 }
 
 static void _replica_io_reader(struct world_io_handler *h)
 {
   struct world_replica_handler *rh = (struct world_replica_handler *)h;
 
-  _reserve_body_buffer(rh);
-
-  struct iovec iovecs[3];
-  memset(iovecs, 0, sizeof(iovecs));
-  _fill_iovec(rh, iovecs);
+  _reserve_receive_buffer(rh);
 
-  ssize_t n_read = readv(rh->replica->conf.fd, iovecs, 3);
+  // A single read takes as many frames as the buffer holds, rather than a
+  // header and then a body per frame.
+  void *base = (void *)((uintptr_t)rh->receive.buffer + rh->receive.tail);
+  ssize_t n_read = read(rh->replica->conf.fd, base, rh->receive.capacity - rh->receive.tail);
   if (n_read == 0) {
     _replica_io_error(h);
     return;
@@ -85,12 +101,14 @@ static void _replica_io_reader(struct world_io_handler *h)
     if (errno == EINTR || errno == EAGAIN) {
       return;
     }
-    perror("readv");
+    perror("read");
     _replica_io_error(h);
     return;
   }
+  rh->receive.tail += (size_t)n_read;
 
-  _drain_iovec(rh, iovecs, n_read);
+  _apply_frames(rh);
+  _compact_receive_buffer(rh);
 }
 
 static void _replica_io_error(struct world_io_handler *h)
@@ -100,117 +118,190 @@ static void _replica_io_error(struct world_io_handler *h)
   world_replica_thread_stop(&rh->replica->thread);
 }
 
-static void _reserve_body_buffer(struct world_replica_handler *rh)
+static void _greet(struct world_replica_handler *rh)
 {
-  if (!_header_is_filled(rh)) {
-    return;
-  }
-  size_t body_size = _body_size(rh);
-  if (rh->body.capacity >= body_size) {
-    return;
-  }
-  rh->body.buffer = world_allocator_realloc(&rh->replica->allocator, rh->body.buffer, body_size);
-}
+  // The hello fits in the socket buffer of a fresh connection. An origin of
+  // the version 1 never reads it, and a failure to send it only leaves the replica on
+  // the version 1 as well.
+  struct world_protocol_control hello;
+  hello.type = WORLD_PROTOCOL_HELLO;
+  hello.version = WORLD_PROTOCOL_VERSION;
+  hello.capabilities = WORLD_PROTOCOL_CAPABILITIES;
+  hello.seq = 0;
+  uint8_t frame[WORLD_PROTOCOL_CONTROL_SIZE];
+  world_protocol_encode_control(frame, &hello);
 
-static size_t _key_size(struct world_replica_handler *rh)
-{
-  WORLD_ASSERT(_key_size_is_filled(rh));
-  return world_decode_key_size(rh->key_size.buffer);
+  int flags = MSG_DONTWAIT;
+#if defined(MSG_NOSIGNAL)
+  flags |= MSG_NOSIGNAL;
+#endif
+  send(rh->base.fd, frame, sizeof(frame), flags);
 }
 
-static size_t _data_size(struct world_replica_handler *rh)
+static void _apply_control(struct world_replica_handler *rh, const uint8_t *data, size_t size, world_sequence *seq)
 {
-  WORLD_ASSERT(_data_size_is_filled(rh));
-  return world_decode_data_size(rh->data_size.buffer);
+  // Unknown control frames are skipped. The hello only tells the version,
+  // and the capabilities the sync frame depends on.
+  struct world_protocol_control control;
+  if (!world_protocol_decode_control(data, size, &control)) {
+    return;
+  }
+  if (control.type == WORLD_PROTOCOL_HELLO) {
+    atomic_store_explicit(&rh->version, control.version, memory_order_relaxed);
+  } else if (control.type == WORLD_PROTOCOL_SYNC) {
+    rh->synced = true;
+    *seq = control.seq;
+  }
 }
 
-static size_t _body_size(struct world_replica_handler *rh)
+static void _reserve_receive_buffer(struct world_replica_handler *rh)
 {
-  return _key_size(rh) + _data_size(rh);
+  // The buffer is compacted after every read, so that only a frame larger than
+  // the buffer leaves no room for the next read.
+  size_t frame_size;
+  if (!_frame_size(rh, &frame_size) || rh->receive.capacity >= frame_size) {
+    return;
+  }
+  WORLD_ASSERT(rh->receive.head == 0);
+  rh->receive.buffer = world_allocator_realloc(&rh->replica->allocator, rh->receive.buffer, frame_size);
+  rh->receive.capacity = frame_size;
 }
 
-static bool _key_size_is_filled(struct world_replica_handler *rh)
+static void _compact_receive_buffer(struct world_replica_handler *rh)
 {
-  return rh->key_size.offset == sizeof(rh->key_size.buffer);
-}
+  size_t n_pending = rh->receive.tail - rh->receive.head;
+  if (rh->receive.head > 0) {
+    memmove(rh->receive.buffer, (void *)((uintptr_t)rh->receive.buffer + rh->receive.head), n_pending);
+    rh->receive.head = 0;
+    rh->receive.tail = n_pending;
+  }
 
-static bool _data_size_is_filled(struct world_replica_handler *rh)
-{
-  return rh->data_size.offset == sizeof(rh->data_size.buffer);
+  // A buffer grown for a large frame goes back to the default size once the
+  // frame has been applied, rather than holding the largest one ever received.
+  if (rh->receive.capacity > WORLD_REPLICA_HANDLER_RECEIVE_BUFFER_SIZE && n_pending <= WORLD_REPLICA_HANDLER_RECEIVE_BUFFER_SIZE) {
+    rh->receive.buffer = world_allocator_realloc(&rh->replica->allocator, rh->receive.buffer, WORLD_REPLICA_HANDLER_RECEIVE_BUFFER_SIZE);
+    rh->receive.capacity = WORLD_REPLICA_HANDLER_RECEIVE_BUFFER_SIZE;
+  }
 }
 
-static bool _header_is_filled(struct world_replica_handler *rh)
+static bool _frame_size(struct world_replica_handler *rh, size_t *frame_size)
 {
-  return _key_size_is_filled(rh) &&
-         _data_size_is_filled(rh);
+  size_t header_size, key_size, data_size;
+  if (!_decode_header(rh, &header_size, &key_size, &data_size)) {
+    return false;
+  }
+  *frame_size = header_size + key_size + data_size;
+  return true;
 }
 
-static bool _body_is_filled(struct world_replica_handler *rh)
+static bool _decode_header(struct world_replica_handler *rh, size_t *header_size, size_t *key_size, size_t *data_size)
 {
-  return rh->body.offset && rh->body.offset == _body_size(rh);
-}
+  // The header is decoded by copy, since it may not be aligned in the buffer.
+  const uint8_t *frame = (const uint8_t *)rh->receive.buffer + rh->receive.head;
+  size_t n_pending = rh->receive.tail - rh->receive.head;
 
-static void _fill_iovec(struct world_replica_handler *rh, struct iovec iovecs[3])
-{
-  if (_header_is_filled(rh)) {
-    iovecs[2].iov_base = (void *)((uintptr_t)rh->body.buffer + rh->body.offset);
-    iovecs[2].iov_len = _body_size(rh) - rh->body.offset;
-  } else {
-    iovecs[0].iov_base = (void *)((uintptr_t)&rh->key_size.buffer + rh->key_size.offset);
-    iovecs[0].iov_len = sizeof(rh->key_size.buffer) - rh->key_size.offset;
-    iovecs[1].iov_base = (void *)((uintptr_t)&rh->data_size.buffer + rh->data_size.offset);
-    iovecs[1].iov_len = sizeof(rh->data_size.buffer) - rh->data_size.offset;
+  world_key_size encoded_key_size;
+  world_data_size encoded_data_size;
+  *header_size = sizeof(encoded_key_size) + sizeof(encoded_data_size);
+  if (n_pending < *header_size) {
+    return false;
+  }
+  memcpy(&encoded_key_size, frame, sizeof(encoded_key_size));
+  memcpy(&encoded_data_size, frame + sizeof(encoded_key_size), sizeof(encoded_data_size));
+  *key_size = world_decode_key_size(encoded_key_size);
+  *data_size = world_decode_data_size(encoded_data_size);
+
+  if (*data_size == WORLD_DATA_SIZE_ESCAPE) {
+    world_extended_data_size encoded_extended_data_size;
+    if (n_pending < *header_size + sizeof(encoded_extended_data_size)) {
+      return false;
+    }
+    memcpy(&encoded_extended_data_size, frame + *header_size, sizeof(encoded_extended_data_size));
+    *header_size += sizeof(encoded_extended_data_size);
+    *data_size = world_decode_extended_data_size(encoded_extended_data_size);
   }
+  return true;
 }
 
-static void _drain_iovec(struct world_replica_handler *rh, struct iovec iovecs[3], size_t n_read)
+static void _apply_frames(struct world_replica_handler *rh)
 {
-  size_t n_read_key_size = iovecs[0].iov_len < n_read ? iovecs[0].iov_len : n_read;
-  rh->key_size.offset += n_read_key_size;
-  n_read -= n_read_key_size;
-
-  size_t n_read_data_size = iovecs[1].iov_len < n_read ? iovecs[1].iov_len : n_read;
-  rh->data_size.offset += n_read_data_size;
-  n_read -= n_read_data_size;
-
-  size_t n_read_body = iovecs[2].iov_len < n_read ? iovecs[2].iov_len : n_read;
-  rh->body.offset += n_read_body;
-  n_read -= n_read_body;
-
-  if (_body_is_filled(rh)) {
-    _apply_log(rh);
-    rh->key_size.offset = 0;
-    rh->data_size.offset = 0;
-    rh->body.offset = 0;
+  // The frames stay in the buffer until they are applied, so that the writes
+  // refer to them rather than to copies.
+  world_vector_clear(&rh->writes);
+  world_sequence seq = atomic_load_explicit(&rh->sequence, memory_order_relaxed);
+  size_t header_size, key_size, data_size;
+  while (_decode_header(rh, &header_size, &key_size, &data_size) &&
+         rh->receive.tail - rh->receive.head >= header_size + key_size + data_size) {
+    const uint8_t *frame = (const uint8_t *)rh->receive.buffer + rh->receive.head;
+    rh->receive.head += header_size + key_size + data_size;
+    if (key_size == 0) {
+      _apply_control(rh, frame + header_size, data_size, &seq);
+      continue;
+    }
+    if (atomic_load_explicit(&rh->version, memory_order_relaxed) == 0) {
+      atomic_store_explicit(&rh->version, 1, memory_order_relaxed);
+    }
+    if (rh->synced) {
+      seq++;
+    }
+
+    struct world_write w;
+    w.key.base = (void *)((uintptr_t)frame + header_size);
+    w.key.size = key_size;
+    w.data.base = data_size ? (void *)((uintptr_t)w.key.base + key_size) : NULL;
+    w.data.size = data_size;
+    w.operation = data_size ? world_operation_set : world_operation_delete;
+    w.error = world_error_ok;
+    world_vector_push_back(&rh->writes, &w, sizeof(w));
+  }
+  if (world_vector_size(&rh->writes) > 0) {
+    _apply_writes(rh);
   }
 
-  WORLD_ASSERT(n_read == 0);
+  // The sequence is published once the writes are visible. Each frame after
+  // the sync frame stands for the next sequence of the origin.
+  atomic_store_explicit(&rh->sequence, seq, memory_order_release);
 }
 
-static void _apply_log(struct world_replica_handler *rh)
+static void _apply_writes(struct world_replica_handler *rh)
 {
-  WORLD_ASSERT(_body_is_filled(rh));
-
-  size_t key_size = _key_size(rh);
-  size_t data_size = _data_size(rh);
-
-  struct world_buffer key, data;
-  key.base = rh->body.buffer;
-  key.size = key_size;
-  if (data_size) {
-    data.base = (void *)((uintptr_t)rh->body.buffer + key_size);
-    data.size = data_size;
-    world_hashtable_set(&rh->replica->hashtable, key, data);
-  } else {
-    data.base = NULL;
-    data.size = 0;
-    world_hashtable_delete(&rh->replica->hashtable, key);
+  // The writes of a read are linked under a single acquisition of the locks,
+  // and readers see all of them at once. Then the replica checkpoints once.
+  struct world_hashtable *ht = &rh->replica->hashtable;
+  struct world_write *writes = world_vector_at(&rh->writes, 0, sizeof(*writes));
+  size_t n_writes = world_vector_size(&rh->writes);
+  world_vector_resize(&rh->linked, n_writes, sizeof(struct world_hashtable_entry *));
+  struct world_hashtable_entry **linked = world_vector_front(&rh->linked);
+  world_hashtable_write_batch(ht, writes, n_writes, linked);
+
+  if (rh->replica->conf.ordered_index) {
+    // The entries superseded by a lean hashtable are not tagged for
+    // reclamation until the checkpoint below, which runs on this thread after
+    // the index no longer refers to them.
+    for (size_t i = 0; i < n_writes; i++) {
+      if (!linked[i]) {
+        continue;
+      }
+      if (world_hashtable_entry_is_void(linked[i])) {
+        world_skiplist_delete(&rh->replica->index, writes[i].key);
+      } else {
+        world_skiplist_set(&rh->replica->index, linked[i]);
+      }
+    }
   }
 
-  world_sequence seq = world_hashtable_log(&rh->replica->hashtable)->base.seq;
-  world_hashtable_checkpoint(&rh->replica->hashtable, seq, NULL);
+  // A checkpoint does a limited amount of work, and a batch may leave more
+  // than that.
+  world_sequence seq = atomic_load_explicit(&ht->visible, memory_order_relaxed);
+  while (!world_hashtable_checkpoint(ht, seq, NULL)) {
+  }
 
   if (rh->replica->conf.callback) {
-    rh->replica->conf.callback(key, data);
+    for (size_t i = 0; i < n_writes; i++) {
+      if (writes[i].error != world_error_ok) {
+        continue;
+      }
+      rh->replica->conf.callback(writes[i].key, writes[i].data);
+    }
   }
 }
@@ -22,31 +22,45 @@
 
 #pragma once
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <world.h>
 #include "world_io.h"
+#include "world_vector.h"
+
+#define WORLD_REPLICA_HANDLER_RECEIVE_BUFFER_SIZE (64 * 1024)
 
 struct world_replica_handler {
   struct world_io_handler base;
 
-  struct {
-    world_key_size buffer;
-    size_t offset;
-  } key_size;
-
-  struct {
-    world_data_size buffer;
-    size_t offset;
-  } data_size;
-
+  // The frames received but not yet applied are in [head, tail) of the
+  // buffer. A partial frame is moved to the front before the next read.
   struct {
     void *buffer;
     size_t capacity;
-    size_t offset;
-  } body;
+    size_t head;
+    size_t tail;
+  } receive;
+
+  // Writes decoded from the frames of a read, which are applied as a batch,
+  // and the entries linked for them.
+  struct world_vector writes;
+  struct world_vector linked;
+
+  // The sequence of the origin which the replica has caught up with, known
+  // once an origin of the protocol version 2 has sent the sync frame.
+  _Atomic(world_sequence) sequence;
+  bool synced;
+
+  // The protocol version is settled by the first frame, which is a hello if
+  // the origin speaks the version 2.
+  atomic_uint version;
 
   struct world_replica *replica;
 };
 
 void world_replica_handler_init(struct world_replica_handler *rh, struct world_replica *replica);
 void world_replica_handler_destroy(struct world_replica_handler *rh);
+world_sequence world_replica_handler_sequence(struct world_replica_handler *rh);
+unsigned int world_replica_handler_version(struct world_replica_handler *rh);
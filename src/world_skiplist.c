@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+#include "world_allocator.h"
+#include "world_epoch.h"
+#include "world_hashtable_entry.h"
+#include "world_skiplist.h"
+#include "world_vector.h"
+
+struct _retired {
+  uint64_t epoch;
+  struct world_skiplist_node *node;
+};
+
+static struct world_skiplist_node *_new_node(struct world_skiplist *sl, size_t level);
+static size_t _random_level(struct world_skiplist *sl);
+static struct world_skiplist_node *_find(struct world_skiplist *sl, struct world_buffer key, struct world_skiplist_node **preds);
+static struct world_buffer _key(struct world_skiplist_node *node);
+static void _reclaim_retired(struct world_skiplist *sl);
+
+void world_skiplist_init(struct world_skiplist *sl, struct world_epoch *e, struct world_allocator *a)
+{
+  sl->allocator = a;
+  sl->epoch = e;
+  sl->head = _new_node(sl, WORLD_SKIPLIST_MAX_LEVEL);
+  atomic_init(&sl->head->entry, NULL);
+  world_circular_init(&sl->retired, a);
+  sl->random = 0x9E3779B97F4A7C15ull;
+  sl->copy = false;
+}
+
+void world_skiplist_enable_copy(struct world_skiplist *sl)
+{
+  sl->copy = true;
+}
+
+void world_skiplist_destroy(struct world_skiplist *sl)
+{
+  struct _retired *retired = NULL;
+  while ((retired = world_circular_front(&sl->retired, sizeof(*retired)))) {
+    world_allocator_free(sl->allocator, retired->node);
+    world_circular_pop_front(&sl->retired);
+  }
+  world_circular_destroy(&sl->retired);
+
+  struct world_skiplist_node *node = sl->head;
+  while (node) {
+    struct world_skiplist_node *next = atomic_load_explicit(&node->next[0], memory_order_relaxed);
+    world_allocator_free(sl->allocator, node);
+    node = next;
+  }
+}
+
+void world_skiplist_set(struct world_skiplist *sl, struct world_hashtable_entry *entry)
+{
+  struct world_skiplist_node *preds[WORLD_SKIPLIST_MAX_LEVEL];
+  struct world_skiplist_node *node = _find(sl, world_hashtable_entry_key(entry), preds);
+  if (node && world_skiplist_compare(_key(node), world_hashtable_entry_key(entry)) == 0) {
+    atomic_store_explicit(&node->entry, entry, memory_order_release);
+    _reclaim_retired(sl);
+    return;
+  }
+
+  // The node is linked from the bottom up, so that a reader which finds it at
+  // any level also finds it at the lower ones.
+  size_t level = _random_level(sl);
+  node = _new_node(sl, level);
+  atomic_init(&node->entry, entry);
+  for (size_t i = 0; i < level; i++) {
+    atomic_init(&node->next[i], atomic_load_explicit(&preds[i]->next[i], memory_order_relaxed));
+  }
+  for (size_t i = 0; i < level; i++) {
+    atomic_store_explicit(&preds[i]->next[i], node, memory_order_release);
+  }
+
+  // Nodes that readers still held back when they were deleted are reclaimed
+  // by later sets too, not only by later deletes.
+  _reclaim_retired(sl);
+}
+
+void world_skiplist_delete(struct world_skiplist *sl, struct world_buffer key)
+{
+  struct world_skiplist_node *preds[WORLD_SKIPLIST_MAX_LEVEL];
+  struct world_skiplist_node *node = _find(sl, key, preds);
+  if (node && world_skiplist_compare(_key(node), key) == 0) {
+    // Readers standing on the node still reach its successors, until it is
+    // reclaimed.
+    for (size_t i = node->level; i-- > 0;) {
+      atomic_store_explicit(&preds[i]->next[i], atomic_load_explicit(&node->next[i], memory_order_relaxed), memory_order_release);
+    }
+    struct _retired retired;
+    retired.epoch = world_epoch_advance(sl->epoch);
+    retired.node = node;
+    world_circular_push_back(&sl->retired, &retired, sizeof(retired));
+  }
+
+  _reclaim_retired(sl);
+}
+
+void world_skiplist_scan(struct world_skiplist *sl, struct world_buffer lower, bool (*fn)(void *ctx, struct world_buffer key, struct world_buffer data), void *ctx)
+{
+  // The copies are made into a buffer of the scan, so that scans of several
+  // threads do not share it.
+  struct world_vector scratch;
+  if (sl->copy) {
+    world_vector_init(&scratch, sl->allocator);
+  }
+  size_t slot = world_epoch_enter(sl->epoch);
+  struct world_skiplist_node *node = _find(sl, lower, NULL);
+  while (node) {
+    struct world_hashtable_entry *entry = atomic_load_explicit(&node->entry, memory_order_acquire);
+    struct world_buffer data = world_hashtable_entry_data(entry);
+    if (sl->copy) {
+      world_vector_resize(&scratch, data.size, 1);
+      void *copy = world_vector_front(&scratch);
+      world_hashtable_entry_copy_data(entry, copy, data.size);
+      data.base = copy;
+    }
+    if (!fn(ctx, world_hashtable_entry_key(entry), data)) {
+      break;
+    }
+    node = atomic_load_explicit(&node->next[0], memory_order_acquire);
+  }
+  world_epoch_leave(sl->epoch, slot);
+  if (sl->copy) {
+    world_vector_destroy(&scratch);
+  }
+}
+
+int world_skiplist_compare(struct world_buffer x, struct world_buffer y)
+{
+  size_t size = x.size < y.size ? x.size : y.size;
+  int cmp = size ? memcmp(x.base, y.base, size) : 0;
+  if (cmp) {
+    return cmp;
+  }
+  return (x.size > y.size) - (x.size < y.size);
+}
+
+static struct world_skiplist_node *_new_node(struct world_skiplist *sl, size_t level)
+{
+  struct world_skiplist_node *node = world_allocator_malloc(sl->allocator, sizeof(*node) + sizeof(node->next[0]) * level);
+  node->level = level;
+  for (size_t i = 0; i < level; i++) {
+    atomic_init(&node->next[i], NULL);
+  }
+  return node;
+}
+
+static size_t _random_level(struct world_skiplist *sl)
+{
+  // xorshift64, with a quarter of the nodes promoted to each upper level.
+  sl->random ^= sl->random << 13;
+  sl->random ^= sl->random >> 7;
+  sl->random ^= sl->random << 17;
+  size_t level = 1 + __builtin_ctzll(sl->random | 1ull << 62) / 2;
+  return level < WORLD_SKIPLIST_MAX_LEVEL ? level : WORLD_SKIPLIST_MAX_LEVEL;
+}
+
+static struct world_skiplist_node *_find(struct world_skiplist *sl, struct world_buffer key, struct world_skiplist_node **preds)
+{
+  // Returns the first node not less than the key. The predecessors at each
+  // level are stored, unless `preds` is NULL.
+  struct world_skiplist_node *pred = sl->head;
+  struct world_skiplist_node *node = NULL;
+  for (size_t i = WORLD_SKIPLIST_MAX_LEVEL; i-- > 0;) {
+    for (;;) {
+      node = atomic_load_explicit(&pred->next[i], memory_order_acquire);
+      if (!node || world_skiplist_compare(_key(node), key) >= 0) {
+        break;
+      }
+      pred = node;
+    }
+    if (preds) {
+      preds[i] = pred;
+    }
+  }
+  return node;
+}
+
+static struct world_buffer _key(struct world_skiplist_node *node)
+{
+  return world_hashtable_entry_key(atomic_load_explicit(&node->entry, memory_order_acquire));
+}
+
+static void _reclaim_retired(struct world_skiplist *sl)
+{
+  if (!world_circular_size(&sl->retired)) {
+    return;
+  }
+
+  uint64_t epoch = world_epoch_least(sl->epoch);
+  struct _retired *retired = NULL;
+  while ((retired = world_circular_front(&sl->retired, sizeof(*retired)))) {
+    if (retired->epoch >= epoch) {
+      break;
+    }
+    world_allocator_free(sl->allocator, retired->node);
+    world_circular_pop_front(&sl->retired);
+  }
+}
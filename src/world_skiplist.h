@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <world.h>
+#include "world_circular.h"
+
+#define WORLD_SKIPLIST_MAX_LEVEL 16
+
+struct world_allocator;
+struct world_epoch;
+struct world_hashtable_entry;
+
+// A node refers to the newest entry of the key in the hashtable, which is
+// reclaimed by the same epoch as the nodes.
+struct world_skiplist_node {
+  _Atomic(struct world_hashtable_entry *) entry;
+  size_t level;
+  _Atomic(struct world_skiplist_node *) next[];
+};
+
+// The skiplist has a single writer and lock-free readers.
+struct world_skiplist {
+  struct world_allocator *allocator;
+  struct world_epoch *epoch;
+  struct world_skiplist_node *head;
+  struct world_circular retired;
+  uint64_t random;
+  // Scans copy the data of entries which may be overwritten in place.
+  bool copy;
+};
+
+void world_skiplist_init(struct world_skiplist *sl, struct world_epoch *e, struct world_allocator *a);
+void world_skiplist_destroy(struct world_skiplist *sl);
+void world_skiplist_enable_copy(struct world_skiplist *sl);
+void world_skiplist_set(struct world_skiplist *sl, struct world_hashtable_entry *entry);
+void world_skiplist_delete(struct world_skiplist *sl, struct world_buffer key);
+void world_skiplist_scan(struct world_skiplist *sl, struct world_buffer lower, bool (*fn)(void *ctx, struct world_buffer key, struct world_buffer data), void *ctx);
+int world_skiplist_compare(struct world_buffer x, struct world_buffer y);
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "world_allocator.h"
+#include "world_hashtable.h"
+#include "world_hashtable_entry.h"
+#include "world_snapshot.h"
+
+struct world_snapshot *world_snapshot_new(struct world_hashtable *ht, struct world_allocator *a, size_t n_partitions)
+{
+  struct world_snapshot *s = world_allocator_malloc(a, sizeof(*s) + sizeof(s->partitions[0]) * n_partitions);
+  s->hashtable = ht;
+  s->allocator = a;
+  s->seq = world_hashtable_acquire_sequence(ht);
+  s->n_partitions = n_partitions;
+  for (size_t i = 0; i < n_partitions; i++) {
+    world_hashtable_partition(ht, i, n_partitions, &s->partitions[i].cursor, &s->partitions[i].end);
+  }
+  return s;
+}
+
+enum world_error world_snapshot_next(struct world_snapshot *snapshot, size_t partition, struct world_buffer *key, struct world_buffer *data)
+{
+  if (!snapshot || partition >= snapshot->n_partitions) {
+    return world_error_invalid_argument;
+  }
+
+  struct world_snapshot_partition *p = &snapshot->partitions[partition];
+  if (!p->cursor) {
+    return world_error_no_such_key;
+  }
+
+  struct world_hashtable_entry *entry = world_hashtable_advance(snapshot->hashtable, &p->cursor, p->end, snapshot->seq);
+  if (!entry) {
+    return world_error_no_such_key;
+  }
+
+  if (key) {
+    *key = world_hashtable_entry_key(entry);
+  }
+  if (data) {
+    *data = world_hashtable_entry_data(entry);
+  }
+  return world_error_ok;
+}
+
+enum world_error world_snapshot_close(struct world_snapshot *snapshot)
+{
+  if (!snapshot) {
+    return world_error_invalid_argument;
+  }
+
+  world_hashtable_release_sequence(snapshot->hashtable, snapshot->seq);
+  world_allocator_free(snapshot->allocator, snapshot);
+  return world_error_ok;
+}
@@ -23,6 +23,7 @@
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sched.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/errno.h>
@@ -69,3 +70,15 @@ bool world_set_tcp_nodelay(int fd)
 
   return true;
 }
+
+void world_cpu_relax(void)
+{
+  // A spinning thread leaves the core to the one it is waiting for.
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield");
+#else
+  sched_yield();
+#endif
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+#include "world_timer_wheel.h"
+
+#define WORLD_TIMER_WHEEL_SPAN ((uint64_t)1 << (WORLD_TIMER_WHEEL_SLOT_BITS * WORLD_TIMER_WHEEL_N_LEVELS))
+
+static void _place(struct world_timer_wheel *w, struct world_timer *t, uint64_t deadline);
+static void _cascade(struct world_timer_wheel *w, size_t level);
+static uint64_t _next_tick(struct world_timer_wheel *w);
+
+void world_timer_wheel_init(struct world_timer_wheel *w, uint64_t now)
+{
+  w->now = now;
+  w->n_timers = 0;
+  memset(w->slots, 0, sizeof(w->slots));
+}
+
+size_t world_timer_wheel_size(struct world_timer_wheel *w)
+{
+  return w->n_timers;
+}
+
+void world_timer_wheel_schedule(struct world_timer_wheel *w, struct world_timer *t)
+{
+  // Past deadlines expire on the next tick.
+  w->n_timers++;
+  _place(w, t, t->deadline > w->now ? t->deadline : w->now + 1);
+}
+
+struct world_timer *world_timer_wheel_advance(struct world_timer_wheel *w, uint64_t now)
+{
+  // Returns the timers whose deadlines have been reached, linked by `next`.
+  struct world_timer *expired = NULL;
+  while (w->now < now) {
+    // The ticks on which no slot is due are skipped at once.
+    uint64_t next = _next_tick(w);
+    if (next > now) {
+      w->now = now;
+      break;
+    }
+    w->now = next;
+    for (size_t level = 1; level < WORLD_TIMER_WHEEL_N_LEVELS; level++) {
+      if (w->now & (((uint64_t)1 << (WORLD_TIMER_WHEEL_SLOT_BITS * level)) - 1)) {
+        break;
+      }
+      _cascade(w, level);
+    }
+
+    struct world_timer **slot = &w->slots[0][w->now & (WORLD_TIMER_WHEEL_N_SLOTS - 1)];
+    struct world_timer *t = *slot;
+    *slot = NULL;
+    while (t) {
+      struct world_timer *next = t->next;
+      if (t->deadline > w->now) {
+        // The deadline was beyond the span of the wheel.
+        _place(w, t, t->deadline);
+      } else {
+        t->next = expired;
+        expired = t;
+        w->n_timers--;
+      }
+      t = next;
+    }
+  }
+  return expired;
+}
+
+struct world_timer *world_timer_wheel_drain(struct world_timer_wheel *w)
+{
+  struct world_timer *drained = NULL;
+  for (size_t level = 0; level < WORLD_TIMER_WHEEL_N_LEVELS; level++) {
+    for (size_t i = 0; i < WORLD_TIMER_WHEEL_N_SLOTS; i++) {
+      struct world_timer *t = w->slots[level][i];
+      while (t) {
+        struct world_timer *next = t->next;
+        t->next = drained;
+        drained = t;
+        t = next;
+      }
+      w->slots[level][i] = NULL;
+    }
+  }
+  w->n_timers = 0;
+  return drained;
+}
+
+static void _place(struct world_timer_wheel *w, struct world_timer *t, uint64_t deadline)
+{
+  // A timer goes to the lowest level on which its deadline and the current
+  // tick share all the upper bits. A timer due on the current tick goes to the
+  // slot about to be expired, since cascading precedes expiring.
+  if (deadline < w->now) {
+    deadline = w->now;
+  } else if (deadline - w->now >= WORLD_TIMER_WHEEL_SPAN) {
+    deadline = w->now + WORLD_TIMER_WHEEL_SPAN - 1;
+  }
+  size_t level = 0;
+  while (level < WORLD_TIMER_WHEEL_N_LEVELS - 1 &&
+         (deadline ^ w->now) >> (WORLD_TIMER_WHEEL_SLOT_BITS * (level + 1))) {
+    level++;
+  }
+  struct world_timer **slot = &w->slots[level][(deadline >> (WORLD_TIMER_WHEEL_SLOT_BITS * level)) & (WORLD_TIMER_WHEEL_N_SLOTS - 1)];
+  t->next = *slot;
+  *slot = t;
+}
+
+static void _cascade(struct world_timer_wheel *w, size_t level)
+{
+  struct world_timer **slot = &w->slots[level][(w->now >> (WORLD_TIMER_WHEEL_SLOT_BITS * level)) & (WORLD_TIMER_WHEEL_N_SLOTS - 1)];
+  struct world_timer *t = *slot;
+  *slot = NULL;
+  while (t) {
+    struct world_timer *next = t->next;
+    _place(w, t, t->deadline);
+    t = next;
+  }
+}
+
+static uint64_t _next_tick(struct world_timer_wheel *w)
+{
+  // A slot is due on the next tick whose bits of the level point to it, and
+  // whose lower bits are all zero.
+  uint64_t next = UINT64_MAX;
+  if (w->n_timers == 0) {
+    return next;
+  }
+  for (size_t level = 0; level < WORLD_TIMER_WHEEL_N_LEVELS; level++) {
+    uint64_t unit = (uint64_t)1 << (WORLD_TIMER_WHEEL_SLOT_BITS * level);
+    uint64_t period = unit << WORLD_TIMER_WHEEL_SLOT_BITS;
+    for (size_t i = 0; i < WORLD_TIMER_WHEEL_N_SLOTS; i++) {
+      if (!w->slots[level][i]) {
+        continue;
+      }
+      uint64_t tick = w->now / period * period + i * unit;
+      if (tick <= w->now) {
+        tick += period;
+      }
+      if (next > tick) {
+        next = tick;
+      }
+    }
+  }
+  return next;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WORLD_TIMER_WHEEL_SLOT_BITS 6
+#define WORLD_TIMER_WHEEL_N_SLOTS (1 << WORLD_TIMER_WHEEL_SLOT_BITS)
+#define WORLD_TIMER_WHEEL_N_LEVELS 6
+
+// A timer is embedded at the beginning of whatever expires with it.
+struct world_timer {
+  struct world_timer *next;
+  uint64_t deadline;
+};
+
+// A hierarchical timer wheel in ticks. Each level spans the whole of a slot of
+// the level below, so that scheduling is O(1) and a timer is cascaded at most
+// once per level before it expires.
+struct world_timer_wheel {
+  uint64_t now;
+  size_t n_timers;
+  struct world_timer *slots[WORLD_TIMER_WHEEL_N_LEVELS][WORLD_TIMER_WHEEL_N_SLOTS];
+};
+
+void world_timer_wheel_init(struct world_timer_wheel *w, uint64_t now);
+size_t world_timer_wheel_size(struct world_timer_wheel *w);
+void world_timer_wheel_schedule(struct world_timer_wheel *w, struct world_timer *t);
+struct world_timer *world_timer_wheel_advance(struct world_timer_wheel *w, uint64_t now);
+struct world_timer *world_timer_wheel_drain(struct world_timer_wheel *w);
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <world.h>
+#include "../helper.h"
+
+int main(int argc, char **argv)
+{
+  size_t cardinality = 1 << 20;
+  size_t key_size = 8;
+  size_t data_size = 16;
+
+  {
+    int c;
+    while ((c = getopt(argc, argv, "cdk")) != -1) {
+      switch (c) {
+      case 'c':
+        cardinality = atoi(argv[optind]);
+        optind++;
+        break;
+      case 'd':
+        data_size = atoi(argv[optind]);
+        optind++;
+        break;
+      case 'k':
+        key_size = atoi(argv[optind]);
+        optind++;
+        break;
+      }
+    }
+  }
+
+  printf("cardinality (-c) ... %zu\n", cardinality);
+  printf("key size    (-k) ... %zu\n", key_size);
+  printf("data size   (-d) ... %zu\n", data_size);
+
+  char *key_buf = calloc(1, key_size);
+  char *data_buf = calloc(1, data_size);
+  if (!key_buf || !data_buf) {
+    perror("calloc");
+    abort();
+  }
+
+  struct world_originconf oc;
+  world_originconf_init(&oc);
+  oc.auto_transmission = false;
+  oc.expected_cardinality = cardinality;
+  struct world_origin *origin = NULL;
+  ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
+
+  struct world_memory empty;
+  ASSERT(world_origin_memory(origin, &empty) == world_error_ok);
+
+  for (size_t i = 0; i < cardinality; i++) {
+    struct world_buffer key, data;
+    memcpy(key_buf, &i, sizeof(i) < key_size ? sizeof(i) : key_size);
+    key.base = key_buf;
+    key.size = key_size;
+    data.base = data_buf;
+    data.size = data_size;
+    ASSERT(world_origin_set(origin, key, data) == world_error_ok);
+  }
+  ASSERT(world_origin_transmit(origin) == world_error_ok);
+
+  // The buckets are built in advance, so that the difference is the entries.
+  struct world_memory full;
+  ASSERT(world_origin_memory(origin, &full) == world_error_ok);
+  printf("payload ..................... %zu bytes/key\n", key_size + data_size);
+  printf("live ........................ %.1f bytes/key\n", (double)(full.live - empty.live) / cardinality);
+  printf("held ........................ %.1f bytes/key\n", (double)(full.held - empty.held) / cardinality);
+
+  ASSERT(world_origin_close(origin) == world_error_ok);
+
+  free(data_buf);
+  free(key_buf);
+
+  return TEST_STATUS;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "../../src/world_hash.h"
+
+static double _now(void)
+{
+  struct timeval t;
+  if (gettimeofday(&t, NULL) == -1) {
+    perror("gettimeofday");
+    abort();
+  }
+  return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+int main(int argc, char **argv)
+{
+  size_t total = 1 << 30;
+
+  {
+    int c;
+    while ((c = getopt(argc, argv, "n")) != -1) {
+      switch (c) {
+      case 'n':
+        total = atoi(argv[optind]);
+        optind++;
+        break;
+      }
+    }
+  }
+
+  printf("bytes hashed per run (-n) ... %zu\n", total);
+
+  static const struct {
+    const char *name;
+    enum world_hash_function function;
+  } functions[] = {
+    {"murmur1", world_hash_function_murmur1},
+    {"xxh64", world_hash_function_xxh64},
+    {"siphash", world_hash_function_siphash},
+  };
+
+  struct world_hash_seed seed;
+  world_generate_seed(&seed);
+
+  char *buf = malloc(1024 + 64);
+  if (!buf) {
+    perror("malloc");
+    abort();
+  }
+  for (size_t i = 0; i < 1024 + 64; i++) {
+    buf[i] = (char)rand();
+  }
+
+  printf("%-8s", "size");
+  for (size_t f = 0; f < sizeof(functions) / sizeof(*functions); f++) {
+    printf(" %22s", functions[f].name);
+  }
+  printf("\n");
+
+  // The keys are shifted by one byte every time, so that the result depends on
+  // unaligned reads as it does in practice.
+  volatile world_hash_type sink = 0;
+  for (size_t size = 8; size <= 1024; size *= 2) {
+    printf("%-8zu", size);
+    size_t n = total / size;
+    for (size_t f = 0; f < sizeof(functions) / sizeof(*functions); f++) {
+      world_hash_type h = 0;
+      double t_0 = _now();
+      for (size_t i = 0; i < n; i++) {
+        h ^= world_hash(functions[f].function, buf + (i & 63), size, &seed);
+      }
+      double t_1 = _now();
+      sink ^= h;
+      printf(" %7.2f ns %6.2f GB/s", (t_1 - t_0) / n * 1e9, total / (t_1 - t_0) * 1e-9);
+    }
+    printf("\n");
+  }
+
+  free(buf);
+
+  return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <world.h>
+#include "../helper.h"
+
+static double _now(void)
+{
+  struct timeval t;
+  if (gettimeofday(&t, NULL) == -1) {
+    perror("gettimeofday");
+    abort();
+  }
+  return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+int main(int argc, char **argv)
+{
+  size_t cardinality = 1 << 22;
+  size_t batch_size = 128;
+  size_t n_ops = 1 << 22;
+
+  {
+    int c;
+    while ((c = getopt(argc, argv, "bcn")) != -1) {
+      switch (c) {
+      case 'b':
+        batch_size = atoi(argv[optind]);
+        optind++;
+        break;
+      case 'c':
+        cardinality = atoi(argv[optind]);
+        optind++;
+        break;
+      case 'n':
+        n_ops = atoi(argv[optind]);
+        optind++;
+        break;
+      }
+    }
+  }
+
+  printf("cardinality        (-c) ... %zu\n", cardinality);
+  printf("batch size         (-b) ... %zu\n", batch_size);
+  printf("# of operations    (-n) ... %zu\n", n_ops);
+
+  struct world_originconf oc;
+  world_originconf_init(&oc);
+  oc.auto_transmission = false;
+  oc.expected_cardinality = cardinality;
+  struct world_origin *origin = NULL;
+  ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
+
+  uint64_t *keys = calloc(cardinality, sizeof(*keys));
+  struct world_read *reads = calloc(batch_size, sizeof(*reads));
+  if (!keys || !reads) {
+    perror("calloc");
+    abort();
+  }
+  for (size_t i = 0; i < cardinality; i++) {
+    struct world_buffer key;
+    keys[i] = i;
+    key.base = &keys[i];
+    key.size = sizeof(keys[i]);
+    ASSERT(world_origin_set(origin, key, key) == world_error_ok);
+  }
+  ASSERT(world_origin_transmit(origin) == world_error_ok);
+
+  // Keys are looked up in a random order, so that most lookups miss the cache.
+  srand(0);
+  for (size_t i = cardinality - 1; i > 0; i--) {
+    size_t j = (size_t)rand() % (i + 1);
+    uint64_t tmp = keys[i];
+    keys[i] = keys[j];
+    keys[j] = tmp;
+  }
+
+  double t_0 = _now();
+  for (size_t i = 0; i < n_ops; i++) {
+    struct world_buffer key;
+    key.base = &keys[i % cardinality];
+    key.size = sizeof(keys[0]);
+    ASSERT(world_origin_get(origin, key, NULL) == world_error_ok);
+  }
+  double t_1 = _now();
+  printf("get      ... %.3f M op/s\n", n_ops / (t_1 - t_0) * 1e-6);
+
+  t_0 = _now();
+  for (size_t i = 0; i < n_ops; i += batch_size) {
+    size_t n_reads = n_ops - i < batch_size ? n_ops - i : batch_size;
+    for (size_t j = 0; j < n_reads; j++) {
+      reads[j].key.base = &keys[(i + j) % cardinality];
+      reads[j].key.size = sizeof(keys[0]);
+    }
+    ASSERT(world_origin_get_many(origin, reads, n_reads) == world_error_ok);
+    for (size_t j = 0; j < n_reads; j++) {
+      ASSERT(reads[j].error == world_error_ok);
+    }
+  }
+  t_1 = _now();
+  printf("get_many ... %.3f M op/s\n", n_ops / (t_1 - t_0) * 1e-6);
+
+  ASSERT(world_origin_close(origin) == world_error_ok);
+
+  free(reads);
+  free(keys);
+
+  return TEST_STATUS;
+}
@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <world.h>
+#include "../helper.h"
+
+struct _writer {
+  pthread_t thread;
+  struct world_origin *origin;
+  const char *keys;
+  size_t n_keys;
+  size_t key_size;
+  size_t data_size;
+  size_t n_ops;
+  size_t batch_size;
+  bool write_batch;
+};
+
+static void _write_batch(struct _writer *w, char *buf)
+{
+  // All the writes of a batch share the same data, since they are applied
+  // before the buffer is reused.
+  struct world_write *writes = calloc(w->batch_size, sizeof(*writes));
+  if (!writes) {
+    perror("calloc");
+    abort();
+  }
+
+  for (size_t i = 0; i < w->n_ops; i += w->batch_size) {
+    size_t n_writes = w->n_ops - i < w->batch_size ? w->n_ops - i : w->batch_size;
+    memcpy(buf, &i, sizeof(i) < w->data_size ? sizeof(i) : w->data_size);
+    for (size_t j = 0; j < n_writes; j++) {
+      writes[j].operation = world_operation_set;
+      writes[j].key.base = w->keys + ((i + j) % w->n_keys) * w->key_size;
+      writes[j].key.size = w->key_size;
+      writes[j].data.base = buf;
+      writes[j].data.size = w->data_size;
+    }
+    ASSERT(world_origin_write_batch(w->origin, writes, n_writes) == world_error_ok);
+    ASSERT(world_origin_transmit(w->origin) == world_error_ok);
+  }
+
+  free(writes);
+}
+
+static void *_writer_main(void *arg)
+{
+  struct _writer *w = arg;
+
+  char *buf = calloc(1, w->data_size);
+  if (!buf) {
+    perror("calloc");
+    abort();
+  }
+
+  if (w->write_batch) {
+    _write_batch(w, buf);
+    free(buf);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < w->n_ops; i++) {
+    struct world_buffer key, data;
+    key.base = w->keys + (i % w->n_keys) * w->key_size;
+    key.size = w->key_size;
+    data.base = buf;
+    data.size = w->data_size;
+    memcpy(buf, &i, sizeof(i) < w->data_size ? sizeof(i) : w->data_size);
+    ASSERT(world_origin_set(w->origin, key, data) == world_error_ok);
+    if ((i + 1) % w->batch_size == 0) {
+      ASSERT(world_origin_transmit(w->origin) == world_error_ok);
+    }
+  }
+
+  free(buf);
+  return NULL;
+}
+
+static const void *_generate_key(size_t count, size_t size)
+{
+  void *buf = calloc(count, size);
+  if (!buf) {
+    perror("calloc");
+    abort();
+  }
+
+  int fd = open("/dev/urandom", O_RDONLY);
+  if (fd == -1) {
+    perror("open");
+    abort();
+  }
+
+  ssize_t n_read = read(fd, buf, count * size);
+  if ((size_t)n_read != count * size) {
+    perror("read");
+    abort();
+  }
+
+  close(fd);
+
+  return buf;
+}
+
+static double _now(void)
+{
+  struct timeval t;
+  if (gettimeofday(&t, NULL) == -1) {
+    perror("gettimeofday");
+    abort();
+  }
+  return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+int main(int argc, char **argv)
+{
+  size_t max_threads = 32;
+  size_t cardinality = 65536;
+  size_t key_size = 16;
+  size_t data_size = 64;
+  size_t n_ops = 1 << 20;
+  size_t batch_size = 1024;
+  bool write_batch = false;
+
+  {
+    int c;
+    while ((c = getopt(argc, argv, "bcdkntw")) != -1) {
+      switch (c) {
+      case 'b':
+        batch_size = atoi(argv[optind]);
+        optind++;
+        break;
+      case 'c':
+        cardinality = atoi(argv[optind]);
+        optind++;
+        break;
+      case 'd':
+        data_size = atoi(argv[optind]);
+        optind++;
+        break;
+      case 'k':
+        key_size = atoi(argv[optind]);
+        optind++;
+        break;
+      case 'n':
+        n_ops = atoi(argv[optind]);
+        optind++;
+        break;
+      case 't':
+        max_threads = atoi(argv[optind]);
+        optind++;
+        break;
+      case 'w':
+        write_batch = true;
+        break;
+      }
+    }
+  }
+
+  printf("max # of writer threads (-t) ... %zu\n", max_threads);
+  printf("cardinality             (-c) ... %zu\n", cardinality);
+  printf("key size                (-k) ... %zu\n", key_size);
+  printf("data size               (-d) ... %zu\n", data_size);
+  printf("# of operations         (-n) ... %zu\n", n_ops);
+  printf("batch size              (-b) ... %zu\n", batch_size);
+  printf("batch API               (-w) ... %s\n", write_batch ? "yes" : "no");
+
+  const char *keys = _generate_key(cardinality, key_size);
+
+  struct _writer *writers = calloc(max_threads, sizeof(*writers));
+  if (!writers) {
+    perror("calloc");
+    abort();
+  }
+
+  double base = 0;
+  for (size_t n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+    struct world_originconf oc;
+    world_originconf_init(&oc);
+    oc.auto_transmission = false;
+    struct world_origin *origin = NULL;
+    ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
+
+    // Each writer owns a disjoint part of the key set, and the total amount of
+    // work does not depend on the number of writers.
+    double t_0 = _now();
+    for (size_t i = 0; i < n_threads; i++) {
+      writers[i].origin = origin;
+      writers[i].keys = keys + cardinality / n_threads * i * key_size;
+      writers[i].n_keys = cardinality / n_threads;
+      writers[i].key_size = key_size;
+      writers[i].data_size = data_size;
+      writers[i].n_ops = n_ops / n_threads;
+      writers[i].batch_size = batch_size;
+      writers[i].write_batch = write_batch;
+      ASSERT(pthread_create(&writers[i].thread, NULL, _writer_main, &writers[i]) == 0);
+    }
+    for (size_t i = 0; i < n_threads; i++) {
+      ASSERT(pthread_join(writers[i].thread, NULL) == 0);
+    }
+    double t_1 = _now();
+
+    double throughput = n_ops / n_threads * n_threads / (t_1 - t_0);
+    if (n_threads == 1) {
+      base = throughput;
+    }
+    printf("%2zu writers: %.3f M op/s (x%.2f)\n", n_threads, throughput * 1e-6, throughput / base);
+
+    ASSERT(world_origin_close(origin) == world_error_ok);
+  }
+
+  free(writers);
+  free((void *)keys);
+
+  return TEST_STATUS;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <world.h>
+#include "../helper.h"
+
+int main(void)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    perror("socketpair");
+    abort();
+  }
+
+  struct world_originconf oc;
+  world_originconf_init(&oc);
+  oc.max_memory_bytes = 64 << 10;
+
+  struct world_replicaconf rc;
+  world_replicaconf_init(&rc);
+  rc.fd = fds[0];
+
+  struct world_origin *origin;
+  ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
+  struct world_replica *replica;
+  ASSERT(world_replica_open(&replica, &rc) == world_error_ok);
+  ASSERT(world_origin_attach(origin, fds[1]) == world_error_ok);
+
+  const uint32_t n_keys = 2000;
+  char payload[100];
+  memset(payload, 'x', sizeof(payload));
+  struct world_buffer key, data;
+  data.base = payload;
+  data.size = sizeof(payload);
+
+  // The key 0 is read all along, so it is never evicted.
+  uint32_t hot = 0;
+  struct world_buffer hot_key = {&hot, sizeof(hot)};
+  for (uint32_t i = 0; i < n_keys; i++) {
+    key.base = &i;
+    key.size = sizeof(i);
+    ASSERT(world_origin_set(origin, key, data) == world_error_ok);
+    for (size_t j = 0; j < 8; j++) {
+      EXPECT(world_origin_get(origin, hot_key, NULL) == world_error_ok);
+    }
+  }
+
+  struct world_memory memory;
+  ASSERT(world_origin_memory(origin, &memory) == world_error_ok);
+  EXPECT(memory.dataset > 0);
+  EXPECT(memory.dataset <= oc.max_memory_bytes);
+
+  world_test_sleep_msec(200);
+
+  // Evictions are transmitted as deletions.
+  size_t n_origin = 0, n_replica = 0;
+  for (uint32_t i = 0; i < n_keys; i++) {
+    key.base = &i;
+    key.size = sizeof(i);
+    n_origin += world_origin_get(origin, key, NULL) == world_error_ok;
+    n_replica += world_replica_get(replica, key, NULL) == world_error_ok;
+  }
+  EXPECT(n_origin < n_keys);
+  EXPECT(n_origin == n_replica);
+  EXPECT(world_origin_get(origin, hot_key, NULL) == world_error_ok);
+  EXPECT(world_replica_get(replica, hot_key, NULL) == world_error_ok);
+
+  ASSERT(world_origin_close(origin) == world_error_ok);
+  world_replica_close(replica);
+
+  return TEST_STATUS;
+}
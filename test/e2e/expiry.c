@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <world.h>
+#include "../helper.h"
+
+int main(void)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    perror("socketpair");
+    abort();
+  }
+
+  struct world_originconf oc;
+  world_originconf_init(&oc);
+
+  struct world_replicaconf rc;
+  world_replicaconf_init(&rc);
+  rc.fd = fds[0];
+
+  struct world_origin *origin;
+  ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
+  struct world_replica *replica;
+  ASSERT(world_replica_open(&replica, &rc) == world_error_ok);
+  ASSERT(world_origin_attach(origin, fds[1]) == world_error_ok);
+
+  struct world_buffer foo = {"foo", 4};
+  struct world_buffer bar = {"bar", 4};
+  struct world_buffer baz = {"baz", 4};
+  struct world_buffer data = {"Lorem ipsum", 12};
+
+  ASSERT(world_origin_set_ttl(origin, foo, data, 0) == world_error_invalid_argument);
+  ASSERT(world_origin_set_ttl(origin, foo, data, 50) == world_error_ok);
+  ASSERT(world_origin_set_ttl(origin, bar, data, 50) == world_error_ok);
+  ASSERT(world_origin_set_ttl(origin, baz, data, 10000) == world_error_ok);
+
+  // Writing a key again cancels its expiry.
+  ASSERT(world_origin_set(origin, bar, data) == world_error_ok);
+
+  EXPECT(world_origin_get(origin, foo, NULL) == world_error_ok);
+
+  world_test_sleep_msec(500);
+
+  // The expired key is deleted from both the origin and the replica.
+  EXPECT(world_origin_get(origin, foo, NULL) == world_error_no_such_key);
+  EXPECT(world_replica_get(replica, foo, NULL) == world_error_no_such_key);
+  EXPECT(world_origin_get(origin, bar, NULL) == world_error_ok);
+  EXPECT(world_replica_get(replica, bar, NULL) == world_error_ok);
+  EXPECT(world_origin_get(origin, baz, NULL) == world_error_ok);
+  EXPECT(world_replica_get(replica, baz, NULL) == world_error_ok);
+
+  ASSERT(world_origin_close(origin) == world_error_ok);
+  world_replica_close(replica);
+
+  return TEST_STATUS;
+}
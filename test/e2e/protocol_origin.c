@@ -39,6 +39,8 @@ int main(void)
 
   struct world_originconf oc;
   world_originconf_init(&oc);
+  // We speak the protocol version 1, which never says hello.
+  oc.greeting_timeout_msec = 20;
 
   struct world_origin *origin;
   ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
@@ -80,5 +82,20 @@ int main(void)
   EXPECT(memcmp(&buf[4], key.base, key.size) == 0);
   EXPECT(memcmp(&buf[8], data.base, data.size) == 0);
 
+  // A data too large for the version 1 closes the connection rather than
+  // being sent.
+  static char large[65535];
+  memset(large, 'x', sizeof(large));
+  data.base = large;
+  data.size = sizeof(large);
+  ASSERT(world_origin_set(origin, key, data) == world_error_ok);
+
+  world_test_sleep_msec(100);
+
+  n_read = read(fds[0], buf, sizeof(buf));
+  EXPECT(n_read == 0);
+
+  ASSERT(world_origin_close(origin) == world_error_ok);
+
   return TEST_STATUS;
 }
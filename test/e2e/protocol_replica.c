@@ -20,6 +20,7 @@
  * SOFTWARE.
  */
 
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +30,11 @@
 #include "../../src/world_byteorder.h"
 #include "../helper.h"
 
+static void _callback(struct world_buffer key, struct world_buffer data);
+
+static atomic_size_t n_callbacks;
+static atomic_size_t n_deleted;
+
 int main(void)
 {
   int fds[2];
@@ -40,10 +46,15 @@ int main(void)
   struct world_replicaconf rc;
   world_replicaconf_init(&rc);
   rc.fd = fds[0];
+  rc.callback = _callback;
 
   struct world_replica *replica;
   ASSERT(world_replica_open(&replica, &rc) == world_error_ok);
 
+  unsigned int version;
+  ASSERT(world_replica_protocol_version(replica, &version) == world_error_ok);
+  EXPECT(version == 0);
+
   struct world_buffer key, data;
   key.base = "foo";
   key.size = strlen(key.base) + 1;
@@ -82,5 +93,45 @@ int main(void)
   ASSERT(found.size == data.size);
   ASSERT(memcmp(found.base, data.base, data.size) == 0);
 
+  // We speak the protocol version 1, which sends no hello back.
+  ASSERT(world_replica_protocol_version(replica, &version) == world_error_ok);
+  EXPECT(version == 1);
+  world_sequence seq;
+  ASSERT(world_replica_sequence(replica, &seq) == world_error_ok);
+  EXPECT(seq == 0);
+  EXPECT(atomic_load(&n_callbacks) == 1);
+
+  // The callback is not invoked for a deletion of a key that does not exist.
+  const char *keys[] = {"bar", "foo"};
+  size_t size = 0;
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+    key_size.raw = world_encode_key_size(strlen(keys[i]) + 1);
+    memcpy(&buf[size], key_size.buf, sizeof(key_size));
+    data_size.raw = world_encode_data_size(0);
+    memcpy(&buf[size + 2], data_size.buf, sizeof(data_size));
+    memcpy(&buf[size + 4], keys[i], strlen(keys[i]) + 1);
+    size += 4 + strlen(keys[i]) + 1;
+  }
+  n_written = write(fds[1], buf, size);
+  if (n_written == -1) {
+    perror("write");
+    abort();
+  }
+
+  world_test_sleep_msec(100);
+
+  ASSERT(world_replica_get(replica, key, NULL) == world_error_no_such_key);
+  EXPECT(atomic_load(&n_callbacks) == 2);
+  EXPECT(atomic_load(&n_deleted) == 1);
+
   return TEST_STATUS;
 }
+
+static void _callback(struct world_buffer key, struct world_buffer data)
+{
+  (void)key;
+  atomic_fetch_add(&n_callbacks, 1);
+  if (data.size == 0) {
+    atomic_fetch_add(&n_deleted, 1);
+  }
+}
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <world.h>
+#include "../../src/world_byteorder.h"
+#include "../../src/world_protocol.h"
+#include "../helper.h"
+
+static void test_protocol_handshake(void);
+static void test_protocol_late_handshake(void);
+static void test_protocol_sequence(void);
+static void _expect_control(const uint8_t *frame, uint8_t type, world_sequence seq);
+static void _expect_entry(const uint8_t *frame, struct world_buffer key, struct world_buffer data);
+
+int main(void)
+{
+  test_protocol_handshake();
+  test_protocol_late_handshake();
+  test_protocol_sequence();
+
+  return TEST_STATUS;
+}
+
+static void test_protocol_handshake(void)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    perror("socketpair");
+    abort();
+  }
+
+  struct world_originconf oc;
+  world_originconf_init(&oc);
+
+  struct world_origin *origin;
+  ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
+
+  struct world_buffer foo, bar, data;
+  foo.base = "foo";
+  foo.size = strlen(foo.base) + 1;
+  bar.base = "bar";
+  bar.size = strlen(bar.base) + 1;
+  data.base = "Lorem ipsum";
+  data.size = strlen(data.base) + 1;
+  ASSERT(world_origin_set(origin, foo, data) == world_error_ok);
+
+  // The replica says hello before the origin starts sending.
+  struct world_protocol_control hello;
+  hello.type = WORLD_PROTOCOL_HELLO;
+  hello.version = WORLD_PROTOCOL_VERSION;
+  hello.capabilities = WORLD_PROTOCOL_CAPABILITIES;
+  hello.seq = 0;
+  uint8_t frame[WORLD_PROTOCOL_CONTROL_SIZE];
+  world_protocol_encode_control(frame, &hello);
+  ASSERT(write(fds[0], frame, sizeof(frame)) == sizeof(frame));
+  ASSERT(world_origin_attach(origin, fds[1]) == world_error_ok);
+
+  world_test_sleep_msec(100);
+
+  // The hello is answered, the dataset follows, and then the sync frame.
+  uint8_t buf[4096];
+  ssize_t n_read = read(fds[0], buf, sizeof(buf));
+  ASSERT(n_read == 60);
+  _expect_control(&buf[0], WORLD_PROTOCOL_HELLO, 1);
+  _expect_entry(&buf[20], foo, data);
+  _expect_control(&buf[40], WORLD_PROTOCOL_SYNC, 1);
+
+  // The log follows the sync frame without control frames.
+  ASSERT(world_origin_set(origin, bar, data) == world_error_ok);
+
+  world_test_sleep_msec(100);
+
+  n_read = read(fds[0], buf, sizeof(buf));
+  ASSERT(n_read == 20);
+  _expect_entry(&buf[0], bar, data);
+
+  ASSERT(world_origin_close(origin) == world_error_ok);
+  close(fds[0]);
+}
+
+static void test_protocol_late_handshake(void)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    perror("socketpair");
+    abort();
+  }
+
+  struct world_originconf oc;
+  world_originconf_init(&oc);
+
+  struct world_origin *origin;
+  ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
+
+  struct world_buffer foo, data;
+  foo.base = "foo";
+  foo.size = strlen(foo.base) + 1;
+  data.base = "Lorem ipsum";
+  data.size = strlen(data.base) + 1;
+  ASSERT(world_origin_set(origin, foo, data) == world_error_ok);
+  ASSERT(world_origin_attach(origin, fds[1]) == world_error_ok);
+
+  // The origin waits for a hello said well after the attach, and split into
+  // several writes.
+  world_test_sleep_msec(100);
+
+  struct world_protocol_control hello;
+  hello.type = WORLD_PROTOCOL_HELLO;
+  hello.version = WORLD_PROTOCOL_VERSION;
+  hello.capabilities = WORLD_PROTOCOL_CAPABILITIES;
+  hello.seq = 0;
+  uint8_t frame[WORLD_PROTOCOL_CONTROL_SIZE];
+  world_protocol_encode_control(frame, &hello);
+  ASSERT(write(fds[0], frame, 7) == 7);
+  world_test_sleep_msec(50);
+  ASSERT(write(fds[0], frame + 7, sizeof(frame) - 7) == sizeof(frame) - 7);
+
+  world_test_sleep_msec(100);
+
+  uint8_t buf[4096];
+  ssize_t n_read = read(fds[0], buf, sizeof(buf));
+  ASSERT(n_read == 60);
+  _expect_control(&buf[0], WORLD_PROTOCOL_HELLO, 1);
+  _expect_entry(&buf[20], foo, data);
+  _expect_control(&buf[40], WORLD_PROTOCOL_SYNC, 1);
+
+  ASSERT(world_origin_close(origin) == world_error_ok);
+  close(fds[0]);
+}
+
+static void test_protocol_sequence(void)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    perror("socketpair");
+    abort();
+  }
+
+  struct world_originconf oc;
+  world_originconf_init(&oc);
+
+  struct world_origin *origin;
+  ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
+
+  struct world_replicaconf rc;
+  world_replicaconf_init(&rc);
+  rc.fd = fds[0];
+
+  struct world_replica *replica;
+  ASSERT(world_replica_open(&replica, &rc) == world_error_ok);
+
+  world_sequence origin_seq, replica_seq;
+  ASSERT(world_origin_sequence(origin, NULL) == world_error_invalid_argument);
+  ASSERT(world_replica_sequence(replica, NULL) == world_error_invalid_argument);
+  ASSERT(world_replica_sequence(replica, &replica_seq) == world_error_ok);
+  EXPECT(replica_seq == 0);
+
+  // The dataset is sent as of the sequence of the last write before the
+  // attach, including a key deleted meanwhile.
+  char key_base[16], data_base[16];
+  struct world_buffer key, data;
+  key.base = key_base;
+  data.base = data_base;
+  for (size_t i = 0; i < 100; i++) {
+    key.size = (size_t)snprintf(key_base, sizeof(key_base), "key%zu", i % 30) + 1;
+    data.size = (size_t)snprintf(data_base, sizeof(data_base), "data%zu", i) + 1;
+    ASSERT(world_origin_set(origin, key, data) == world_error_ok);
+  }
+  ASSERT(world_origin_delete(origin, key) == world_error_ok);
+  ASSERT(world_origin_attach(origin, fds[1]) == world_error_ok);
+
+  world_test_sleep_msec(100);
+
+  ASSERT(world_origin_sequence(origin, &origin_seq) == world_error_ok);
+  ASSERT(world_replica_sequence(replica, &replica_seq) == world_error_ok);
+  EXPECT(origin_seq == 101);
+  EXPECT(replica_seq == origin_seq);
+  unsigned int version;
+  ASSERT(world_replica_protocol_version(replica, &version) == world_error_ok);
+  EXPECT(version == WORLD_PROTOCOL_VERSION);
+
+  // Each frame of the log moves the sequence forward.
+  for (size_t i = 0; i < 50; i++) {
+    key.size = (size_t)snprintf(key_base, sizeof(key_base), "key%zu", i) + 1;
+    data.size = (size_t)snprintf(data_base, sizeof(data_base), "data%zu", i) + 1;
+    ASSERT(world_origin_set(origin, key, data) == world_error_ok);
+  }
+
+  world_test_sleep_msec(100);
+
+  ASSERT(world_origin_sequence(origin, &origin_seq) == world_error_ok);
+  ASSERT(world_replica_sequence(replica, &replica_seq) == world_error_ok);
+  EXPECT(origin_seq == 151);
+  EXPECT(replica_seq == origin_seq);
+
+  struct world_buffer found;
+  EXPECT(world_replica_get(replica, key, &found) == world_error_ok);
+  EXPECT(found.size == data.size && memcmp(found.base, data.base, data.size) == 0);
+
+  ASSERT(world_replica_close(replica) == world_error_ok);
+  ASSERT(world_origin_close(origin) == world_error_ok);
+}
+
+static void _expect_control(const uint8_t *frame, uint8_t type, world_sequence seq)
+{
+  world_key_size key_size;
+  world_data_size data_size;
+  memcpy(&key_size, frame, sizeof(key_size));
+  memcpy(&data_size, frame + sizeof(key_size), sizeof(data_size));
+  EXPECT(world_decode_key_size(key_size) == 0);
+  EXPECT(world_decode_data_size(data_size) == WORLD_PROTOCOL_CONTROL_DATA_SIZE);
+
+  struct world_protocol_control control;
+  ASSERT(world_protocol_decode_control(frame + 4, WORLD_PROTOCOL_CONTROL_DATA_SIZE, &control));
+  EXPECT(control.type == type);
+  EXPECT(control.version == WORLD_PROTOCOL_VERSION);
+  EXPECT(control.capabilities == WORLD_PROTOCOL_CAPABILITY_SEQUENCE);
+  EXPECT(control.seq == seq);
+}
+
+static void _expect_entry(const uint8_t *frame, struct world_buffer key, struct world_buffer data)
+{
+  world_key_size key_size;
+  world_data_size data_size;
+  memcpy(&key_size, frame, sizeof(key_size));
+  memcpy(&data_size, frame + sizeof(key_size), sizeof(data_size));
+  EXPECT(world_decode_key_size(key_size) == key.size);
+  EXPECT(world_decode_data_size(data_size) == data.size);
+  EXPECT(memcmp(frame + 4, key.base, key.size) == 0);
+  EXPECT(memcmp(frame + 4 + key.size, data.base, data.size) == 0);
+}
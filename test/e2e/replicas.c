@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <world.h>
+#include "../helper.h"
+
+#define N_REPLICAS 8
+#define N_WRITES 10000
+#define N_KEYS 16
+
+struct _scanner {
+  struct world_replica *replica;
+  atomic_bool *done;
+};
+
+static void _set_all(struct world_origin *origin);
+static void _wait(struct world_origin *origin, struct world_replica *replica);
+static bool _count(void *ctx, struct world_buffer key, struct world_buffer data);
+static void *_scanner_main(void *arg);
+static bool _check(void *ctx, struct world_buffer key, struct world_buffer data);
+
+int main(void)
+{
+  struct world_originconf oc;
+  world_originconf_init(&oc);
+  oc.n_io_threads = 2;
+
+  struct world_origin *origin;
+  ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
+
+  struct world_replica *replicas[N_REPLICAS];
+  for (size_t i = 0; i < N_REPLICAS; i++) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+      perror("socketpair");
+      abort();
+    }
+    struct world_replicaconf rc;
+    world_replicaconf_init(&rc);
+    rc.fd = fds[0];
+    // Every other replica is lean, with an ordered index to keep up to date,
+    // and half of them overwrite the data in place.
+    rc.lean = i % 2;
+    rc.ordered_index = i % 2;
+    rc.in_place = i % 4 == 3;
+    ASSERT(world_replica_open(&replicas[i], &rc) == world_error_ok);
+    ASSERT(world_origin_attach(origin, fds[1]) == world_error_ok);
+  }
+
+  // The ordered indices of the lean replicas are scanned while they apply the
+  // writes, and the versions superseded meanwhile are never freed under them.
+  atomic_bool done;
+  atomic_init(&done, false);
+  pthread_t threads[N_REPLICAS / 2];
+  struct _scanner scanners[N_REPLICAS / 2];
+  for (size_t i = 0; i < N_REPLICAS / 2; i++) {
+    scanners[i].replica = replicas[i * 2 + 1];
+    scanners[i].done = &done;
+    ASSERT(pthread_create(&threads[i], NULL, _scanner_main, &scanners[i]) == 0);
+  }
+  _set_all(origin);
+  for (size_t i = 0; i < N_REPLICAS; i++) {
+    _wait(origin, replicas[i]);
+  }
+  atomic_store(&done, true);
+  for (size_t i = 0; i < N_REPLICAS / 2; i++) {
+    ASSERT(pthread_join(threads[i], NULL) == 0);
+  }
+
+  // The versions the scanners have held back are reclaimed by the replicas as
+  // they apply more writes.
+  _set_all(origin);
+  for (size_t i = 0; i < N_REPLICAS; i++) {
+    _wait(origin, replicas[i]);
+    for (uint32_t k = 0; k < N_KEYS; k++) {
+      struct world_buffer key = {&k, sizeof(k)};
+      struct world_buffer found;
+      ASSERT(world_replica_get(replicas[i], key, &found) == world_error_ok);
+      uint32_t expected = N_WRITES - N_KEYS + k;
+      EXPECT(found.size == sizeof(expected));
+      EXPECT(memcmp(found.base, &expected, sizeof(expected)) == 0);
+    }
+  }
+
+  // Lean replicas keep only the newest versions, and so cannot open snapshots.
+  // Those overwriting in place are read by copies.
+  for (size_t i = 1; i < N_REPLICAS; i += 2) {
+    struct world_memory memory;
+    ASSERT(world_replica_memory(replicas[i], &memory) == world_error_ok);
+    EXPECT(memory.stale < 1000);
+    struct world_snapshot *snapshot;
+    EXPECT(world_replica_snapshot_open(replicas[i], 1, &snapshot) == world_error_invalid_argument);
+    size_t n_keys = 0;
+    struct world_buffer unbounded = {NULL, 0};
+    ASSERT(world_replica_range(replicas[i], unbounded, unbounded, _count, &n_keys) == world_error_ok);
+    EXPECT(n_keys == N_KEYS);
+    for (uint32_t k = 0; k < N_KEYS; k++) {
+      struct world_buffer key = {&k, sizeof(k)};
+      uint32_t copied;
+      size_t size;
+      ASSERT(world_replica_get_copy(replicas[i], key, &copied, sizeof(copied), &size) == world_error_ok);
+      EXPECT(size == sizeof(copied) && copied == N_WRITES - N_KEYS + k);
+    }
+  }
+
+  world_test_sleep_msec(100);
+  struct world_memory memory;
+  ASSERT(world_origin_memory(origin, &memory) == world_error_ok);
+  EXPECT(memory.stale < 1000);
+
+  ASSERT(world_origin_close(origin) == world_error_ok);
+  for (size_t i = 0; i < N_REPLICAS; i++) {
+    world_replica_close(replicas[i]);
+  }
+
+  return TEST_STATUS;
+}
+
+static void _set_all(struct world_origin *origin)
+{
+  // Stale versions are reclaimed once every replica has received them, while
+  // the replicas proceed at their own paces. Some keys are deleted, if they
+  // exist yet, just before they are set again.
+  for (uint32_t i = 0; i < N_WRITES; i++) {
+    uint32_t k = i % N_KEYS;
+    struct world_buffer key = {&k, sizeof(k)};
+    struct world_buffer data = {&i, sizeof(i)};
+    ASSERT(world_origin_set(origin, key, data) == world_error_ok);
+    if (i % 5 == 0 && i + 1 < N_WRITES) {
+      uint32_t next = (i + 1) % N_KEYS;
+      struct world_buffer next_key = {&next, sizeof(next)};
+      world_origin_delete(origin, next_key);
+    }
+  }
+}
+
+static void _wait(struct world_origin *origin, struct world_replica *replica)
+{
+  // The replicas take a while to catch up on a busy machine.
+  world_sequence expected, seq = 0;
+  ASSERT(world_origin_sequence(origin, &expected) == world_error_ok);
+  for (size_t retry = 0; retry < 100 && seq != expected; retry++) {
+    world_test_sleep_msec(100);
+    ASSERT(world_replica_sequence(replica, &seq) == world_error_ok);
+  }
+  ASSERT(seq == expected);
+}
+
+static bool _count(void *ctx, struct world_buffer key, struct world_buffer data)
+{
+  (void)key;
+  (void)data;
+  ++*(size_t *)ctx;
+  return true;
+}
+
+static void *_scanner_main(void *arg)
+{
+  struct _scanner *scanner = arg;
+  struct world_buffer unbounded = {NULL, 0};
+  while (!atomic_load(scanner->done)) {
+    ASSERT(world_replica_range(scanner->replica, unbounded, unbounded, _check, NULL) == world_error_ok);
+  }
+  return NULL;
+}
+
+static bool _check(void *ctx, struct world_buffer key, struct world_buffer data)
+{
+  // Every data written for a key is congruent to the key.
+  (void)ctx;
+  uint32_t k, v;
+  ASSERT(key.size == sizeof(k) && data.size == sizeof(v));
+  memcpy(&k, key.base, sizeof(k));
+  memcpy(&v, data.base, sizeof(v));
+  EXPECT(k < N_KEYS && v % N_KEYS == k);
+  return true;
+}
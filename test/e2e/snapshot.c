@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <world.h>
+#include "../helper.h"
+
+#define N 10000
+#define N_PARTITIONS 4
+
+struct _scanner {
+  pthread_t thread;
+  struct world_snapshot *snapshot;
+  size_t partition;
+  size_t (*expected)(size_t);
+  bool *seen;
+  size_t n;
+};
+
+static void _wait(struct world_replica *replica, size_t n);
+static size_t _scan(struct world_snapshot *snapshot, size_t (*expected)(size_t), bool *seen);
+static void *_scanner_main(void *arg);
+static size_t _iterate(struct world_snapshot *snapshot, size_t partition, size_t (*expected)(size_t), bool *seen);
+static size_t _expected_before(size_t i);
+static size_t _expected_after(size_t i);
+
+int main(void)
+{
+  struct world_originconf oc;
+  world_originconf_init(&oc);
+
+  struct world_origin *origin;
+  ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
+
+  bool *seen = calloc(N, sizeof(*seen));
+  if (!seen) {
+    perror("calloc");
+    abort();
+  }
+
+  for (size_t i = 0; i < N; i += 2) {
+    size_t value = i;
+    struct world_buffer key = {&i, sizeof(i)};
+    struct world_buffer data = {&value, sizeof(value)};
+    ASSERT(world_origin_set(origin, key, data) == world_error_ok);
+  }
+
+  struct world_snapshot *snapshot;
+  ASSERT(world_origin_snapshot_open(origin, 0, &snapshot) == world_error_invalid_argument);
+  ASSERT(world_origin_snapshot_open(origin, WORLD_MAX_SNAPSHOT_PARTITIONS + 1, &snapshot) == world_error_invalid_argument);
+  ASSERT(world_origin_snapshot_open(origin, 1, &snapshot) == world_error_ok);
+
+  // The writes after the opening, which are checkpointed along the way, are
+  // not seen by the snapshot.
+  for (size_t round = 1; round <= 3; round++) {
+    for (size_t i = 0; i < N; i += 2) {
+      size_t value = i + round;
+      struct world_buffer key = {&i, sizeof(i)};
+      struct world_buffer data = {&value, sizeof(value)};
+      ASSERT(world_origin_set(origin, key, data) == world_error_ok);
+    }
+  }
+  for (size_t i = 0; i < N; i++) {
+    size_t value = i + 3;
+    struct world_buffer key = {&i, sizeof(i)};
+    struct world_buffer data = {&value, sizeof(value)};
+    if (i % 4 == 0) {
+      ASSERT(world_origin_delete(origin, key) == world_error_ok);
+    } else if (i % 2 == 1) {
+      ASSERT(world_origin_add(origin, key, data) == world_error_ok);
+    }
+  }
+
+  EXPECT(_iterate(snapshot, 0, _expected_before, seen) == N / 2);
+  ASSERT(world_snapshot_next(snapshot, 0, NULL, NULL) == world_error_no_such_key);
+  ASSERT(world_snapshot_next(snapshot, 1, NULL, NULL) == world_error_invalid_argument);
+  ASSERT(world_snapshot_close(snapshot) == world_error_ok);
+
+  // The partitions are scanned in parallel.
+  memset(seen, 0, N * sizeof(*seen));
+  ASSERT(world_origin_snapshot_open(origin, N_PARTITIONS, &snapshot) == world_error_ok);
+  EXPECT(_scan(snapshot, _expected_after, seen) == N / 2 + N / 4);
+  ASSERT(world_snapshot_close(snapshot) == world_error_ok);
+
+  // So are those of a replica.
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    perror("socketpair");
+    abort();
+  }
+  struct world_replicaconf rc;
+  world_replicaconf_init(&rc);
+  rc.fd = fds[0];
+  struct world_replica *replica;
+  ASSERT(world_replica_open(&replica, &rc) == world_error_ok);
+  ASSERT(world_origin_attach(origin, fds[1]) == world_error_ok);
+
+  _wait(replica, N / 2 + N / 4);
+
+  memset(seen, 0, N * sizeof(*seen));
+  ASSERT(world_replica_snapshot_open(replica, N_PARTITIONS, &snapshot) == world_error_ok);
+  EXPECT(_scan(snapshot, _expected_after, seen) == N / 2 + N / 4);
+  ASSERT(world_snapshot_close(snapshot) == world_error_ok);
+
+  free(seen);
+  ASSERT(world_origin_close(origin) == world_error_ok);
+  world_replica_close(replica);
+
+  return TEST_STATUS;
+}
+
+static void _wait(struct world_replica *replica, size_t n)
+{
+  // The dataset takes a while to be transmitted on a busy machine.
+  size_t n_found = 0;
+  for (size_t retry = 0; retry < 100 && n_found != n; retry++) {
+    world_test_sleep_msec(100);
+    n_found = 0;
+    for (size_t i = 0; i < N; i++) {
+      struct world_buffer key = {&i, sizeof(i)};
+      if (world_replica_get(replica, key, NULL) == world_error_ok) {
+        n_found++;
+      }
+    }
+  }
+  ASSERT(n_found == n);
+}
+
+static size_t _scan(struct world_snapshot *snapshot, size_t (*expected)(size_t), bool *seen)
+{
+  // The partitions are disjoint, so that the scanners never mark the same key.
+  struct _scanner scanners[N_PARTITIONS];
+  for (size_t i = 0; i < N_PARTITIONS; i++) {
+    scanners[i].snapshot = snapshot;
+    scanners[i].partition = i;
+    scanners[i].expected = expected;
+    scanners[i].seen = seen;
+    ASSERT(pthread_create(&scanners[i].thread, NULL, _scanner_main, &scanners[i]) == 0);
+  }
+  size_t n = 0;
+  for (size_t i = 0; i < N_PARTITIONS; i++) {
+    ASSERT(pthread_join(scanners[i].thread, NULL) == 0);
+    n += scanners[i].n;
+  }
+  return n;
+}
+
+static void *_scanner_main(void *arg)
+{
+  struct _scanner *scanner = arg;
+  scanner->n = _iterate(scanner->snapshot, scanner->partition, scanner->expected, scanner->seen);
+  return NULL;
+}
+
+static size_t _iterate(struct world_snapshot *snapshot, size_t partition, size_t (*expected)(size_t), bool *seen)
+{
+  size_t n = 0;
+  struct world_buffer key, data;
+  while (world_snapshot_next(snapshot, partition, &key, &data) == world_error_ok) {
+    size_t i, value;
+    ASSERT(key.size == sizeof(i));
+    ASSERT(data.size == sizeof(value));
+    memcpy(&i, key.base, sizeof(i));
+    memcpy(&value, data.base, sizeof(value));
+    ASSERT(i < N);
+    EXPECT(!seen[i]);
+    EXPECT(value == expected(i));
+    seen[i] = true;
+    n++;
+  }
+  return n;
+}
+
+static size_t _expected_before(size_t i)
+{
+  return i % 2 == 0 ? i : SIZE_MAX;
+}
+
+static size_t _expected_after(size_t i)
+{
+  return i % 4 == 0 ? SIZE_MAX : i + 3;
+}
@@ -20,13 +20,18 @@
  * SOFTWARE.
  */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <world.h>
+#include "../../src/world_replica.h"
 #include "../helper.h"
 
+static bool _count(void *ctx, struct world_buffer key, struct world_buffer data);
+static void _wait(struct world_origin *origin, struct world_replica *replica);
+
 int main(void)
 {
   int fds[2];
@@ -41,10 +46,27 @@ int main(void)
   struct world_replicaconf rc;
   world_replicaconf_init(&rc);
   rc.fd = fds[0];
+  rc.ordered_index = true;
 
   struct world_origin *origin;
-  ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
   struct world_replica *replica;
+
+  // The buckets built in advance are bounded.
+  oc.max_load_factor = WORLD_MIN_LOAD_FACTOR / 2;
+  EXPECT(world_origin_open(&origin, &oc) == world_error_invalid_argument);
+  oc.max_load_factor = 1.0f;
+  oc.expected_cardinality = SIZE_MAX;
+  EXPECT(world_origin_open(&origin, &oc) == world_error_invalid_argument);
+  oc.expected_cardinality = 0;
+  rc.max_load_factor = 0.0f;
+  EXPECT(world_replica_open(&replica, &rc) == world_error_invalid_argument);
+  rc.max_load_factor = WORLD_MIN_LOAD_FACTOR;
+  rc.expected_cardinality = WORLD_MAX_BUCKETS;
+  EXPECT(world_replica_open(&replica, &rc) == world_error_invalid_argument);
+  rc.max_load_factor = 1.0f;
+  rc.expected_cardinality = 0;
+
+  ASSERT(world_origin_open(&origin, &oc) == world_error_ok);
   ASSERT(world_replica_open(&replica, &rc) == world_error_ok);
 
   struct world_buffer key, data, found;
@@ -58,7 +80,7 @@ int main(void)
 
   ASSERT(world_origin_attach(origin, fds[1]) == world_error_ok);
 
-  world_test_sleep_msec(100);
+  _wait(origin, replica);
 
   ASSERT(world_replica_get(replica, key, &found) == world_error_ok);
   ASSERT(found.size == data.size);
@@ -71,14 +93,156 @@ int main(void)
 
   ASSERT(world_origin_set(origin, key, data) == world_error_ok);
 
-  world_test_sleep_msec(100);
+  _wait(origin, replica);
 
   ASSERT(world_replica_get(replica, key, &found) == world_error_ok);
   ASSERT(found.size == data.size);
   ASSERT(memcmp(found.base, data.base, data.size) == 0);
 
+  // Data sizes around the escape of the wire format, and a large one that
+  // takes many writes to be transmitted.
+  const size_t data_sizes[] = {65534, 65535, 65536, 4 << 20};
+  for (size_t i = 0; i < sizeof(data_sizes) / sizeof(data_sizes[0]); i++) {
+    char *buf = malloc(data_sizes[i]);
+    if (!buf) {
+      perror("malloc");
+      abort();
+    }
+    for (size_t j = 0; j < data_sizes[i]; j++) {
+      buf[j] = (char)(i + j);
+    }
+
+    key.base = &data_sizes[i];
+    key.size = sizeof(data_sizes[i]);
+    data.base = buf;
+    data.size = data_sizes[i];
+
+    ASSERT(world_origin_set(origin, key, data) == world_error_ok);
+
+    _wait(origin, replica);
+
+    ASSERT(world_replica_get(replica, key, &found) == world_error_ok);
+    ASSERT(found.size == data.size);
+    ASSERT(memcmp(found.base, data.base, data.size) == 0);
+
+    free(buf);
+  }
+
+  // The receive buffer grown for the large data shrinks once it is applied,
+  // i.e. before the next write is applied.
+  key.base = "qux";
+  key.size = strlen(key.base) + 1;
+  ASSERT(world_origin_set(origin, key, key) == world_error_ok);
+  _wait(origin, replica);
+  EXPECT(replica->thread.handler.receive.capacity == WORLD_REPLICA_HANDLER_RECEIVE_BUFFER_SIZE);
+
+  // A batch of writes is transmitted at once.
+  struct world_write writes[2];
+  memset(writes, 0, sizeof(writes));
+  writes[0].operation = world_operation_delete;
+  writes[0].key.base = "foo";
+  writes[0].key.size = strlen(writes[0].key.base) + 1;
+  writes[1].operation = world_operation_add;
+  writes[1].key.base = "baz";
+  writes[1].key.size = strlen(writes[1].key.base) + 1;
+  writes[1].data.base = "consectetur adipiscing elit";
+  writes[1].data.size = strlen(writes[1].data.base) + 1;
+  ASSERT(world_origin_write_batch(origin, writes, 2) == world_error_ok);
+  EXPECT(writes[0].error == world_error_ok);
+  EXPECT(writes[1].error == world_error_ok);
+
+  _wait(origin, replica);
+
+  ASSERT(world_replica_get(replica, writes[0].key, NULL) == world_error_no_such_key);
+  ASSERT(world_replica_get(replica, writes[1].key, &found) == world_error_ok);
+  ASSERT(found.size == writes[1].data.size);
+  ASSERT(memcmp(found.base, writes[1].data.base, found.size) == 0);
+
+  // The keys are iterated in bytewise order.
+  size_t n = 0;
+  struct world_buffer prefix = {"ba", 2};
+  ASSERT(world_replica_prefix(replica, prefix, _count, &n) == world_error_ok);
+  EXPECT(n == 2);
+  n = 0;
+  struct world_buffer lower = {"bar", 4};
+  struct world_buffer upper = {"baz", 4};
+  ASSERT(world_replica_range(replica, lower, upper, _count, &n) == world_error_ok);
+  EXPECT(n == 1);
+  n = 0;
+  // Some of the integer keys may follow, depending on the byte order.
+  upper.base = NULL;
+  ASSERT(world_replica_range(replica, lower, upper, _count, &n) == world_error_ok);
+  EXPECT(n >= 2);
+
+  key.size = WORLD_MAX_KEY_SIZE + 1;
+  ASSERT(world_origin_set(origin, key, data) == world_error_invalid_argument);
+
+  // A pinned data survives later writes of the key until it is released, and
+  // a copy is taken from the latest version.
+  struct world_pin pin;
+  key.base = "foo";
+  key.size = strlen(key.base) + 1;
+  data.base = "Lorem ipsum";
+  data.size = strlen(data.base) + 1;
+  ASSERT(world_origin_set(origin, key, data) == world_error_ok);
+  ASSERT(world_origin_get_pinned(origin, key, &pin) == world_error_ok);
+  data.base = "dolor sit amet";
+  data.size = strlen(data.base) + 1;
+  for (size_t i = 0; i < 1000; i++) {
+    ASSERT(world_origin_set(origin, key, data) == world_error_ok);
+  }
+  world_test_sleep_msec(100);
+  EXPECT(pin.data.size == strlen("Lorem ipsum") + 1);
+  EXPECT(memcmp(pin.data.base, "Lorem ipsum", pin.data.size) == 0);
+  ASSERT(world_origin_release(origin, &pin) == world_error_ok);
+  EXPECT(world_origin_release(origin, &pin) == world_error_invalid_argument);
+
+  char copy[8];
+  size_t size;
+  ASSERT(world_origin_get_copy(origin, key, copy, sizeof(copy), &size) == world_error_ok);
+  EXPECT(size == data.size);
+  EXPECT(memcmp(copy, data.base, sizeof(copy)) == 0);
+
+  // Stale versions are reclaimed in the background once the replica has
+  // received them.
+  key.base = "foo";
+  key.size = strlen(key.base) + 1;
+  data.base = "Lorem ipsum";
+  data.size = strlen(data.base) + 1;
+  for (size_t i = 0; i < 10000; i++) {
+    ASSERT(world_origin_set(origin, key, data) == world_error_ok);
+  }
+  _wait(origin, replica);
+  struct world_memory memory;
+  ASSERT(world_origin_memory(origin, &memory) == world_error_ok);
+  for (size_t retry = 0; retry < 100 && memory.stale >= 1000; retry++) {
+    world_test_sleep_msec(100);
+    ASSERT(world_origin_memory(origin, &memory) == world_error_ok);
+  }
+  EXPECT(memory.stale < 1000);
+
   ASSERT(world_origin_close(origin) == world_error_ok);
   world_replica_close(replica);
 
   return TEST_STATUS;
 }
+
+static bool _count(void *ctx, struct world_buffer key, struct world_buffer data)
+{
+  (void)key;
+  (void)data;
+  (*(size_t *)ctx)++;
+  return true;
+}
+
+static void _wait(struct world_origin *origin, struct world_replica *replica)
+{
+  // A large data takes a while to be transmitted on a busy machine.
+  world_sequence expected, seq = 0;
+  ASSERT(world_origin_sequence(origin, &expected) == world_error_ok);
+  for (size_t retry = 0; retry < 1000 && seq != expected; retry++) {
+    world_test_sleep_msec(10);
+    ASSERT(world_replica_sequence(replica, &seq) == world_error_ok);
+  }
+  ASSERT(seq == expected);
+}
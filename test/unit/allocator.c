@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include "../../src/world_allocator.h"
+#include "../helper.h"
+
+static void test_allocator_slab(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  EXPECT(world_allocator_held(&allocator) == 0);
+  EXPECT(world_allocator_live(&allocator) == 0);
+
+  void *ps[4096];
+  size_t live = 0;
+  for (size_t size = 1; size <= 4096; size++) {
+    ps[size - 1] = world_allocator_slab_alloc(&allocator, size);
+    EXPECT((uintptr_t)ps[size - 1] % sizeof(void *) == 0);
+    memset(ps[size - 1], (int)size, size);
+    live += size;
+  }
+  EXPECT(world_allocator_live(&allocator) == live);
+  EXPECT(world_allocator_held(&allocator) >= live);
+
+  for (size_t size = 1; size <= 4096; size++) {
+    const unsigned char *p = ps[size - 1];
+    for (size_t i = 0; i < size; i++) {
+      if (p[i] != (unsigned char)size) {
+        EXPECT(p[i] == (unsigned char)size);
+        break;
+      }
+    }
+    world_allocator_slab_free(&allocator, ps[size - 1], size);
+  }
+  EXPECT(world_allocator_live(&allocator) == 0);
+
+  // Objects freed should be reused.
+  size_t held = world_allocator_held(&allocator);
+  for (size_t i = 0; i < 100000; i++) {
+    void *p = world_allocator_slab_alloc(&allocator, 64);
+    world_allocator_slab_free(&allocator, p, 64);
+  }
+  EXPECT(world_allocator_held(&allocator) == held);
+
+  // Chunks emptied are returned to the system.
+  static void *qs[65536];
+  for (size_t i = 0; i < 65536; i++) {
+    qs[i] = world_allocator_slab_alloc(&allocator, 64);
+  }
+  size_t peak = world_allocator_held(&allocator);
+  EXPECT(peak >= held + 65536 * 64);
+  for (size_t i = 0; i < 65536; i++) {
+    world_allocator_slab_free(&allocator, qs[i], 64);
+  }
+  EXPECT(world_allocator_held(&allocator) < held + (peak - held) / 8);
+
+  world_allocator_destroy(&allocator);
+}
+
+#define N_THREADS 4
+#define N_OBJECTS 10000
+
+struct _thread {
+  pthread_t thread;
+  struct world_allocator *allocator;
+  void *objects[N_OBJECTS];
+};
+
+static size_t _size(size_t i)
+{
+  return 1 + i * 7 % 600;
+}
+
+static void *_thread_main(void *arg)
+{
+  struct _thread *t = arg;
+  for (size_t i = 0; i < N_OBJECTS; i++) {
+    t->objects[i] = world_allocator_slab_alloc(t->allocator, _size(i));
+    memset(t->objects[i], (int)i, _size(i));
+  }
+  // Frees the half, and leaves the others to the main thread.
+  for (size_t i = 0; i < N_OBJECTS; i += 2) {
+    world_allocator_slab_free(t->allocator, t->objects[i], _size(i));
+  }
+  return NULL;
+}
+
+static void test_allocator_threads(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  static struct _thread threads[N_THREADS];
+  for (size_t i = 0; i < N_THREADS; i++) {
+    threads[i].allocator = &allocator;
+    ASSERT(pthread_create(&threads[i].thread, NULL, _thread_main, &threads[i]) == 0);
+  }
+  for (size_t i = 0; i < N_THREADS; i++) {
+    ASSERT(pthread_join(threads[i].thread, NULL) == 0);
+  }
+
+  size_t live = 0;
+  for (size_t i = 1; i < N_OBJECTS; i += 2) {
+    live += _size(i) * N_THREADS;
+  }
+  EXPECT(world_allocator_live(&allocator) == live);
+
+  for (size_t t = 0; t < N_THREADS; t++) {
+    for (size_t i = 1; i < N_OBJECTS; i += 2) {
+      const unsigned char *p = threads[t].objects[i];
+      EXPECT(p[0] == (unsigned char)i && p[_size(i) - 1] == (unsigned char)i);
+      world_allocator_slab_free(&allocator, threads[t].objects[i], _size(i));
+    }
+  }
+  EXPECT(world_allocator_live(&allocator) == 0);
+
+  world_allocator_destroy(&allocator);
+}
+
+int main(void)
+{
+  test_allocator_slab();
+  test_allocator_threads();
+  return TEST_STATUS;
+}
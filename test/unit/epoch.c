@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "../../src/world_epoch.h"
+#include "../helper.h"
+
+static void test_epoch_least(void)
+{
+  struct world_epoch e;
+  world_epoch_init(&e);
+
+  // No readers: the least epoch is the current one.
+  uint64_t epoch = world_epoch_least(&e);
+  EXPECT(world_epoch_advance(&e) == epoch);
+  EXPECT(world_epoch_least(&e) == epoch + 1);
+
+  // A reader holds back the least epoch until it leaves.
+  size_t slot = world_epoch_enter(&e);
+  uint64_t tag = world_epoch_advance(&e);
+  EXPECT(world_epoch_least(&e) == epoch + 1);
+  EXPECT(world_epoch_least(&e) <= tag);
+  world_epoch_leave(&e, slot);
+  EXPECT(world_epoch_least(&e) > tag);
+
+  world_epoch_destroy(&e);
+}
+
+static void test_epoch_slots(void)
+{
+  struct world_epoch e;
+  world_epoch_init(&e);
+
+  // Nested readers occupy distinct slots, and more slots are added once the
+  // first block is full.
+  size_t slots[WORLD_EPOCH_N_SLOTS * 3];
+  for (size_t i = 0; i < WORLD_EPOCH_N_SLOTS * 3; i++) {
+    slots[i] = world_epoch_enter(&e);
+    for (size_t j = 0; j < i; j++) {
+      EXPECT(slots[i] != slots[j]);
+    }
+  }
+  uint64_t tag = world_epoch_advance(&e);
+  EXPECT(world_epoch_least(&e) <= tag);
+  for (size_t i = 0; i < WORLD_EPOCH_N_SLOTS * 3 - 1; i++) {
+    world_epoch_leave(&e, slots[i]);
+  }
+
+  // A reader in an added block still holds back the least epoch.
+  EXPECT(slots[WORLD_EPOCH_N_SLOTS * 3 - 1] >= WORLD_EPOCH_N_SLOTS);
+  EXPECT(world_epoch_least(&e) <= tag);
+  world_epoch_leave(&e, slots[WORLD_EPOCH_N_SLOTS * 3 - 1]);
+  EXPECT(world_epoch_least(&e) > tag);
+
+  // Freed slots are reused rather than added.
+  size_t slot = world_epoch_enter(&e);
+  EXPECT(slot < WORLD_EPOCH_N_SLOTS * 3);
+  world_epoch_leave(&e, slot);
+
+  world_epoch_destroy(&e);
+}
+
+int main(void)
+{
+  test_epoch_least();
+  test_epoch_slots();
+  return TEST_STATUS;
+}
@@ -20,68 +20,107 @@
  * SOFTWARE.
  */
 
+#include <stdint.h>
 #include "../../src/world_hash.h"
 #include "../helper.h"
 
 static void test_world_hash_reverse(void)
 {
-  EXPECT(world_hash_reverse(0x00000000) == 0x00000000);
-  EXPECT(world_hash_reverse(0xFFFFFFFF) == 0xFFFFFFFF);
+  EXPECT(world_hash_reverse(0x0000000000000000) == 0x0000000000000000);
+  EXPECT(world_hash_reverse(0x00000000FFFFFFFF) == 0xFFFFFFFF00000000);
 
-  EXPECT(world_hash_reverse(0x00000001) == 0x80000000);
-  EXPECT(world_hash_reverse(0x00000002) == 0x40000000);
-  EXPECT(world_hash_reverse(0x00000003) == 0xC0000000);
-  EXPECT(world_hash_reverse(0x00000004) == 0x20000000);
-  EXPECT(world_hash_reverse(0x00000005) == 0xA0000000);
-  EXPECT(world_hash_reverse(0x00000006) == 0x60000000);
-  EXPECT(world_hash_reverse(0x00000007) == 0xE0000000);
-  EXPECT(world_hash_reverse(0x00000008) == 0x10000000);
-  EXPECT(world_hash_reverse(0x00000009) == 0x90000000);
-  EXPECT(world_hash_reverse(0x0000000A) == 0x50000000);
-  EXPECT(world_hash_reverse(0x0000000B) == 0xD0000000);
-  EXPECT(world_hash_reverse(0x0000000C) == 0x30000000);
-  EXPECT(world_hash_reverse(0x0000000D) == 0xB0000000);
-  EXPECT(world_hash_reverse(0x0000000E) == 0x70000000);
-  EXPECT(world_hash_reverse(0x0000000F) == 0xF0000000);
+  EXPECT(world_hash_reverse(0x0000000000000001) == 0x8000000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000002) == 0x4000000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000003) == 0xC000000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000004) == 0x2000000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000005) == 0xA000000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000006) == 0x6000000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000007) == 0xE000000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000008) == 0x1000000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000009) == 0x9000000000000000);
+  EXPECT(world_hash_reverse(0x000000000000000A) == 0x5000000000000000);
+  EXPECT(world_hash_reverse(0x000000000000000B) == 0xD000000000000000);
+  EXPECT(world_hash_reverse(0x000000000000000C) == 0x3000000000000000);
+  EXPECT(world_hash_reverse(0x000000000000000D) == 0xB000000000000000);
+  EXPECT(world_hash_reverse(0x000000000000000E) == 0x7000000000000000);
+  EXPECT(world_hash_reverse(0x000000000000000F) == 0xF000000000000000);
 
-  EXPECT(world_hash_reverse(0x00000001) == 0x80000000);
-  EXPECT(world_hash_reverse(0x00000002) == 0x40000000);
-  EXPECT(world_hash_reverse(0x00000004) == 0x20000000);
-  EXPECT(world_hash_reverse(0x00000008) == 0x10000000);
-  EXPECT(world_hash_reverse(0x00000010) == 0x08000000);
-  EXPECT(world_hash_reverse(0x00000020) == 0x04000000);
-  EXPECT(world_hash_reverse(0x00000040) == 0x02000000);
-  EXPECT(world_hash_reverse(0x00000080) == 0x01000000);
-  EXPECT(world_hash_reverse(0x00000100) == 0x00800000);
-  EXPECT(world_hash_reverse(0x00000200) == 0x00400000);
-  EXPECT(world_hash_reverse(0x00000400) == 0x00200000);
-  EXPECT(world_hash_reverse(0x00000800) == 0x00100000);
-  EXPECT(world_hash_reverse(0x00001000) == 0x00080000);
-  EXPECT(world_hash_reverse(0x00002000) == 0x00040000);
-  EXPECT(world_hash_reverse(0x00004000) == 0x00020000);
-  EXPECT(world_hash_reverse(0x00008000) == 0x00010000);
-  EXPECT(world_hash_reverse(0x00010000) == 0x00008000);
-  EXPECT(world_hash_reverse(0x00020000) == 0x00004000);
-  EXPECT(world_hash_reverse(0x00040000) == 0x00002000);
-  EXPECT(world_hash_reverse(0x00080000) == 0x00001000);
-  EXPECT(world_hash_reverse(0x00100000) == 0x00000800);
-  EXPECT(world_hash_reverse(0x00200000) == 0x00000400);
-  EXPECT(world_hash_reverse(0x00400000) == 0x00000200);
-  EXPECT(world_hash_reverse(0x00800000) == 0x00000100);
-  EXPECT(world_hash_reverse(0x01000000) == 0x00000080);
-  EXPECT(world_hash_reverse(0x02000000) == 0x00000040);
-  EXPECT(world_hash_reverse(0x04000000) == 0x00000020);
-  EXPECT(world_hash_reverse(0x08000000) == 0x00000010);
-  EXPECT(world_hash_reverse(0x10000000) == 0x00000008);
-  EXPECT(world_hash_reverse(0x20000000) == 0x00000004);
-  EXPECT(world_hash_reverse(0x40000000) == 0x00000002);
-  EXPECT(world_hash_reverse(0x80000000) == 0x00000001);
+  EXPECT(world_hash_reverse(0x0000000000000001) == 0x8000000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000002) == 0x4000000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000004) == 0x2000000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000008) == 0x1000000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000010) == 0x0800000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000020) == 0x0400000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000040) == 0x0200000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000080) == 0x0100000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000100) == 0x0080000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000200) == 0x0040000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000400) == 0x0020000000000000);
+  EXPECT(world_hash_reverse(0x0000000000000800) == 0x0010000000000000);
+  EXPECT(world_hash_reverse(0x0000000000001000) == 0x0008000000000000);
+  EXPECT(world_hash_reverse(0x0000000000002000) == 0x0004000000000000);
+  EXPECT(world_hash_reverse(0x0000000000004000) == 0x0002000000000000);
+  EXPECT(world_hash_reverse(0x0000000000008000) == 0x0001000000000000);
+  EXPECT(world_hash_reverse(0x0000000000010000) == 0x0000800000000000);
+  EXPECT(world_hash_reverse(0x0000000000020000) == 0x0000400000000000);
+  EXPECT(world_hash_reverse(0x0000000000040000) == 0x0000200000000000);
+  EXPECT(world_hash_reverse(0x0000000000080000) == 0x0000100000000000);
+  EXPECT(world_hash_reverse(0x0000000000100000) == 0x0000080000000000);
+  EXPECT(world_hash_reverse(0x0000000000200000) == 0x0000040000000000);
+  EXPECT(world_hash_reverse(0x0000000000400000) == 0x0000020000000000);
+  EXPECT(world_hash_reverse(0x0000000000800000) == 0x0000010000000000);
+  EXPECT(world_hash_reverse(0x0000000001000000) == 0x0000008000000000);
+  EXPECT(world_hash_reverse(0x0000000002000000) == 0x0000004000000000);
+  EXPECT(world_hash_reverse(0x0000000004000000) == 0x0000002000000000);
+  EXPECT(world_hash_reverse(0x0000000008000000) == 0x0000001000000000);
+  EXPECT(world_hash_reverse(0x0000000010000000) == 0x0000000800000000);
+  EXPECT(world_hash_reverse(0x0000000020000000) == 0x0000000400000000);
+  EXPECT(world_hash_reverse(0x0000000040000000) == 0x0000000200000000);
+  EXPECT(world_hash_reverse(0x0000000080000000) == 0x0000000100000000);
 
-  EXPECT(world_hash_reverse(0xDEADBEEF) == 0xF77DB57B);
+  EXPECT(world_hash_reverse(0x00000000DEADBEEF) == 0xF77DB57B00000000);
+
+  EXPECT(world_hash_reverse(0xFFFFFFFFFFFFFFFF) == 0xFFFFFFFFFFFFFFFF);
+  EXPECT(world_hash_reverse(0x8000000000000000) == 0x0000000000000001);
+  EXPECT(world_hash_reverse(0x0000000100000000) == 0x0000000080000000);
+  EXPECT(world_hash_reverse(0xDEADBEEF00000000) == 0x00000000F77DB57B);
+  EXPECT(world_hash_reverse(world_hash_reverse(0x0123456789ABCDEF)) == 0x0123456789ABCDEF);
+}
+
+static void test_world_hash_xxh64(void)
+{
+  EXPECT(world_hash_xxh64("", 0, 0) == 0xEF46DB3751D8E999ull);
+  EXPECT(world_hash_xxh64("a", 1, 0) == 0xD24EC4F1A98C6E5Bull);
+  EXPECT(world_hash_xxh64("abc", 3, 0) == 0x44BC2CF5AD770999ull);
+}
+
+static void test_world_hash_siphash(void)
+{
+  // Test vectors in the appendix of the SipHash paper
+  struct world_hash_seed seed;
+  seed.k0 = 0x0706050403020100ull;
+  seed.k1 = 0x0F0E0D0C0B0A0908ull;
+  uint8_t message[64];
+  for (size_t i = 0; i < sizeof(message); i++) {
+    message[i] = i;
+  }
+  EXPECT(world_hash_siphash(message, 0, &seed) == 0x726FDB47DD0E0E31ull);
+  EXPECT(world_hash_siphash(message, 1, &seed) == 0x74F839C593DC67FDull);
+  EXPECT(world_hash_siphash(message, 15, &seed) == 0xA129CA6149BE45E5ull);
+}
+
+static void test_world_hash_murmur1(void)
+{
+  // The 32-bit result lies in the upper half.
+  EXPECT((world_hash_murmur1("foo", 3, 0) & 0xFFFFFFFFull) == 0);
+  EXPECT(world_hash_murmur1("foo", 3, 0) != world_hash_murmur1("bar", 3, 0));
 }
 
 int main(void)
 {
   test_world_hash_reverse();
+  test_world_hash_xxh64();
+  test_world_hash_siphash();
+  test_world_hash_murmur1();
   return TEST_STATUS;
 }
@@ -20,18 +20,25 @@
  * SOFTWARE.
  */
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <string.h>
 #include "../../src/world_allocator.h"
+#include "../../src/world_circular.h"
 #include "../../src/world_hashtable.h"
+#include "../../src/world_hashtable_entry.h"
 #include "../helper.h"
 
-static void test_hashtable_manipulation(void)
+static const struct world_hash_seed seed = {0, 0};
+
+static void test_hashtable_manipulation(enum world_hash_function function)
 {
   struct world_allocator allocator;
   world_allocator_init(&allocator);
 
   struct world_hashtable ht;
-  world_hashtable_init(&ht, 0, &allocator);
+  world_hashtable_init(&ht, function, &seed, 0, 1.0f, &allocator);
 
   struct world_buffer key, data, found;
 
@@ -117,8 +124,873 @@ static void test_hashtable_manipulation(void)
   world_hashtable_destroy(&ht);
 }
 
+static void test_hashtable_capacity(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct world_hashtable ht;
+
+  // Buckets are built in advance for the expected cardinality.
+  world_hashtable_init(&ht, world_hash_function_xxh64, &seed, 100000, 0.5f, &allocator);
+  EXPECT(world_hashtable_bucket_size(&ht.bucket) == 262144);
+  world_hashtable_destroy(&ht);
+
+  // Buckets are doubled when the load factor exceeds the maximum.
+  world_hashtable_init(&ht, world_hash_function_xxh64, &seed, 0, 2.0f, &allocator);
+  EXPECT(world_hashtable_bucket_size(&ht.bucket) == 256);
+  for (uint32_t i = 0; i < 10000; i++) {
+    struct world_buffer key;
+    key.base = &i;
+    key.size = sizeof(i);
+    ASSERT(world_hashtable_set(&ht, key, key) == world_error_ok);
+  }
+  EXPECT(world_hashtable_bucket_size(&ht.bucket) == 8192);
+  for (uint32_t i = 0; i < 10000; i++) {
+    struct world_buffer key, found;
+    key.base = &i;
+    key.size = sizeof(i);
+    ASSERT(world_hashtable_get(&ht, key, &found) == world_error_ok);
+    EXPECT(memcmp(found.base, &i, sizeof(i)) == 0);
+  }
+
+  // Buckets are halved when the load factor falls below a quarter of the
+  // maximum, but not below the initial size.
+  for (uint32_t i = 0; i < 10000; i++) {
+    struct world_buffer key;
+    key.base = &i;
+    key.size = sizeof(i);
+    ASSERT(world_hashtable_delete(&ht, key) == world_error_ok);
+    if (i == 7000) {
+      EXPECT(world_hashtable_bucket_size(&ht.bucket) == 4096);
+    }
+  }
+  EXPECT(world_hashtable_bucket_size(&ht.bucket) == 256);
+
+  // A checkpoint does a limited amount of work at once, and the following ones
+  // go on with the rest.
+  EXPECT(!world_hashtable_checkpoint(&ht, world_hashtable_log_greatest_sequence(&ht.log), NULL));
+  EXPECT(world_circular_size(&ht.unspliced) > 0);
+  EXPECT(world_vector_size(&ht.garbages) > 0);
+  size_t n_checkpoints = 1;
+  while (!world_hashtable_checkpoint(&ht, world_hashtable_log_greatest_sequence(&ht.log), NULL)) {
+    n_checkpoints++;
+  }
+  EXPECT(n_checkpoints >= 20000 / WORLD_HASHTABLE_CHECKPOINT_BUDGET);
+  EXPECT(world_circular_size(&ht.unspliced) == 0);
+  EXPECT(world_circular_size(&ht.retired) == 0);
+  for (uint32_t i = 0; i < 10000; i += 2) {
+    struct world_buffer key;
+    key.base = &i;
+    key.size = sizeof(i);
+    ASSERT(world_hashtable_set(&ht, key, key) == world_error_ok);
+  }
+  EXPECT(world_hashtable_bucket_size(&ht.bucket) == 4096);
+  for (uint32_t i = 0; i < 10000; i++) {
+    struct world_buffer key;
+    key.base = &i;
+    key.size = sizeof(i);
+    EXPECT(world_hashtable_get(&ht, key, NULL) == (i % 2 ? world_error_no_such_key : world_error_ok));
+  }
+  world_hashtable_destroy(&ht);
+
+  world_allocator_destroy(&allocator);
+}
+
+static void test_hashtable_get_many(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct world_hashtable ht;
+  world_hashtable_init(&ht, world_hash_function_xxh64, &seed, 0, 1.0f, &allocator);
+
+  // Every other key exists, and there are more keys than a prefetch group.
+  const uint32_t n = 3 * WORLD_HASHTABLE_N_PREFETCHES + 1;
+  uint32_t keys[n];
+  struct world_read reads[n];
+  for (uint32_t i = 0; i < n; i++) {
+    keys[i] = i;
+    reads[i].key.base = &keys[i];
+    reads[i].key.size = sizeof(keys[i]);
+    if (i % 2 == 0) {
+      ASSERT(world_hashtable_set(&ht, reads[i].key, reads[i].key) == world_error_ok);
+    }
+  }
+
+  ASSERT(world_hashtable_get_many(&ht, reads, n) == world_error_ok);
+  for (uint32_t i = 0; i < n; i++) {
+    if (i % 2 == 0) {
+      EXPECT(reads[i].error == world_error_ok);
+      EXPECT(reads[i].data.size == sizeof(i));
+      EXPECT(memcmp(reads[i].data.base, &i, sizeof(i)) == 0);
+    } else {
+      EXPECT(reads[i].error == world_error_no_such_key);
+    }
+  }
+
+  reads[n - 1].key.size = 0;
+  EXPECT(world_hashtable_get_many(&ht, reads, n) == world_error_invalid_argument);
+
+  world_hashtable_destroy(&ht);
+
+  world_allocator_destroy(&allocator);
+}
+
+struct _counter {
+  uint64_t value;
+  uint64_t limit;
+};
+
+static enum world_update _increment(void *ctx, const struct world_buffer *current, struct world_buffer *data)
+{
+  struct _counter *c = ctx;
+  c->value = 0;
+  if (current) {
+    memcpy(&c->value, current->base, sizeof(c->value));
+  }
+  if (c->value == c->limit) {
+    return world_update_delete;
+  }
+  c->value++;
+  data->base = &c->value;
+  data->size = sizeof(c->value);
+  return world_update_set;
+}
+
+static enum world_update _nothing(void *ctx, const struct world_buffer *current, struct world_buffer *data)
+{
+  (void)ctx;
+  (void)current;
+  (void)data;
+  return world_update_none;
+}
+
+#define N_UPDATERS 4
+#define N_UPDATES 10000
+
+struct _updater {
+  pthread_t thread;
+  struct world_hashtable *ht;
+};
+
+static void *_updater_main(void *arg)
+{
+  struct _updater *u = arg;
+  struct _counter c;
+  c.limit = UINT64_MAX;
+  for (size_t i = 0; i < N_UPDATES; i++) {
+    struct world_buffer key;
+    key.base = "counter";
+    key.size = strlen(key.base) + 1;
+    ASSERT(world_hashtable_update(u->ht, key, _increment, &c) == world_error_ok);
+  }
+  return NULL;
+}
+
+static void test_hashtable_update(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct world_hashtable ht;
+  world_hashtable_init(&ht, world_hash_function_xxh64, &seed, 0, 1.0f, &allocator);
+
+  struct world_buffer key, found;
+  key.base = "foo";
+  key.size = strlen(key.base) + 1;
+
+  // The counter is created, incremented, and then deleted at the limit.
+  struct _counter c;
+  c.limit = 2;
+  ASSERT(world_hashtable_update(&ht, key, _increment, &c) == world_error_ok);
+  ASSERT(world_hashtable_update(&ht, key, _increment, &c) == world_error_ok);
+  ASSERT(world_hashtable_get(&ht, key, &found) == world_error_ok);
+  EXPECT(found.size == sizeof(uint64_t) && *(const uint64_t *)found.base == 2);
+  ASSERT(world_hashtable_update(&ht, key, _nothing, NULL) == world_error_ok);
+  EXPECT(world_hashtable_log_greatest_sequence(&ht.log) == 2);
+  ASSERT(world_hashtable_update(&ht, key, _increment, &c) == world_error_ok);
+  EXPECT(world_hashtable_get(&ht, key, NULL) == world_error_no_such_key);
+  c.limit = 0;
+  EXPECT(world_hashtable_update(&ht, key, _increment, &c) == world_error_no_such_key);
+
+  // No increment is lost under concurrent updates.
+  struct _updater updaters[N_UPDATERS];
+  for (size_t i = 0; i < N_UPDATERS; i++) {
+    updaters[i].ht = &ht;
+    ASSERT(pthread_create(&updaters[i].thread, NULL, _updater_main, &updaters[i]) == 0);
+  }
+  for (size_t i = 0; i < N_UPDATERS; i++) {
+    ASSERT(pthread_join(updaters[i].thread, NULL) == 0);
+  }
+  key.base = "counter";
+  key.size = strlen(key.base) + 1;
+  ASSERT(world_hashtable_get(&ht, key, &found) == world_error_ok);
+  EXPECT(*(const uint64_t *)found.base == N_UPDATERS * N_UPDATES);
+
+  world_hashtable_destroy(&ht);
+
+  world_allocator_destroy(&allocator);
+}
+
+static void test_hashtable_pin(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct world_hashtable ht;
+  world_hashtable_init(&ht, world_hash_function_xxh64, &seed, 0, 1.0f, &allocator);
+
+  struct world_buffer key, data;
+  key.base = "foo";
+  key.size = strlen(key.base) + 1;
+  data.base = "Lorem ipsum";
+  data.size = strlen(data.base) + 1;
+  ASSERT(world_hashtable_set(&ht, key, data) == world_error_ok);
+
+  // A pinned data survives checkpoints after the key is deleted.
+  struct world_pin pin;
+  ASSERT(world_hashtable_get_pinned(&ht, key, &pin) == world_error_ok);
+  ASSERT(world_hashtable_delete(&ht, key) == world_error_ok);
+  world_hashtable_checkpoint(&ht, world_hashtable_log_greatest_sequence(&ht.log), NULL);
+  world_hashtable_checkpoint(&ht, world_hashtable_log_greatest_sequence(&ht.log), NULL);
+  EXPECT(world_circular_size(&ht.retired) > 0);
+  EXPECT(pin.data.size == data.size);
+  EXPECT(memcmp(pin.data.base, data.base, data.size) == 0);
+  world_hashtable_release(&ht, &pin);
+  world_hashtable_checkpoint(&ht, world_hashtable_log_greatest_sequence(&ht.log), NULL);
+  EXPECT(world_circular_size(&ht.retired) == 0);
+
+  EXPECT(world_hashtable_get_pinned(&ht, key, &pin) == world_error_no_such_key);
+
+  // Pins are limited.
+  ASSERT(world_hashtable_set(&ht, key, data) == world_error_ok);
+  struct world_pin pins[WORLD_MAX_PINS];
+  for (size_t i = 0; i < WORLD_MAX_PINS; i++) {
+    ASSERT(world_hashtable_get_pinned(&ht, key, &pins[i]) == world_error_ok);
+  }
+  EXPECT(world_hashtable_get_pinned(&ht, key, &pin) == world_error_busy);
+  EXPECT(world_hashtable_get(&ht, key, NULL) == world_error_ok);
+  for (size_t i = 0; i < WORLD_MAX_PINS; i++) {
+    world_hashtable_release(&ht, &pins[i]);
+  }
+  ASSERT(world_hashtable_get_pinned(&ht, key, &pin) == world_error_ok);
+  world_hashtable_release(&ht, &pin);
+
+  world_hashtable_destroy(&ht);
+
+  world_allocator_destroy(&allocator);
+}
+
+static void test_hashtable_write_batch(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct world_hashtable ht;
+  world_hashtable_init(&ht, world_hash_function_xxh64, &seed, 0, 1.0f, &allocator);
+
+  struct world_write writes[6];
+  memset(writes, 0, sizeof(writes));
+  writes[0].operation = world_operation_add;
+  writes[0].key.base = "foo";
+  writes[0].key.size = 4;
+  writes[0].data.base = "Lorem ipsum";
+  writes[0].data.size = 12;
+  writes[1] = writes[0];
+  writes[2].operation = world_operation_set;
+  writes[2].key.base = "bar";
+  writes[2].key.size = 4;
+  writes[2].data.base = "dolor sit amet";
+  writes[2].data.size = 15;
+  writes[3].operation = world_operation_replace;
+  writes[3].key.base = "baz";
+  writes[3].key.size = 4;
+  writes[3].data = writes[2].data;
+  writes[4].operation = world_operation_delete;
+  writes[4].key = writes[0].key;
+  writes[5].operation = world_operation_set;
+  writes[5].key = writes[3].key;
+  writes[5].data = writes[3].data;
+
+  // None of them is applied if any of them is invalid.
+  writes[5].key.size = 0;
+  ASSERT(world_hashtable_write_batch(&ht, writes, 6, NULL) == world_error_invalid_argument);
+  EXPECT(world_hashtable_log_greatest_sequence(&ht.log) == 0);
+  writes[5].key.size = 4;
+
+  ASSERT(world_hashtable_write_batch(&ht, writes, 6, NULL) == world_error_ok);
+  EXPECT(writes[0].error == world_error_ok);
+  EXPECT(writes[1].error == world_error_key_exists);
+  EXPECT(writes[2].error == world_error_ok);
+  EXPECT(writes[3].error == world_error_no_such_key);
+  EXPECT(writes[4].error == world_error_ok);
+  EXPECT(writes[5].error == world_error_ok);
+
+  // The successful ones are given consecutive sequence numbers.
+  world_sequence seq = 0;
+  struct world_hashtable_entry *cursor = world_hashtable_log_front(&ht.log);
+  while ((cursor = atomic_load(&cursor->log))) {
+    EXPECT(cursor->base.seq == ++seq);
+  }
+  EXPECT(seq == 4);
+
+  EXPECT(world_hashtable_get(&ht, writes[0].key, NULL) == world_error_no_such_key);
+  EXPECT(world_hashtable_get(&ht, writes[2].key, NULL) == world_error_ok);
+  EXPECT(world_hashtable_get(&ht, writes[3].key, NULL) == world_error_ok);
+  EXPECT(atomic_load(&ht.n_fresh_entries) == 2);
+
+  // Readers see the older versions until the whole batch is linked, which we
+  // pretend by holding the visible sequence back.
+  writes[0].operation = world_operation_set;
+  writes[1].operation = world_operation_set;
+  writes[1].key = writes[2].key;
+  writes[1].data = writes[0].data;
+  ASSERT(world_hashtable_write_batch(&ht, writes, 2, NULL) == world_error_ok);
+  atomic_store(&ht.visible, seq);
+  struct world_buffer found;
+  EXPECT(world_hashtable_get(&ht, writes[0].key, NULL) == world_error_no_such_key);
+  ASSERT(world_hashtable_get(&ht, writes[2].key, &found) == world_error_ok);
+  EXPECT(found.size == 15 && memcmp(found.base, "dolor sit amet", 15) == 0);
+  atomic_store(&ht.visible, seq + 2);
+  EXPECT(world_hashtable_get(&ht, writes[0].key, NULL) == world_error_ok);
+  ASSERT(world_hashtable_get(&ht, writes[2].key, &found) == world_error_ok);
+  EXPECT(found.size == 12 && memcmp(found.base, "Lorem ipsum", 12) == 0);
+
+  world_hashtable_destroy(&ht);
+
+  world_allocator_destroy(&allocator);
+}
+
+static void test_hashtable_lean(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct world_hashtable ht;
+  world_hashtable_init(&ht, world_hash_function_xxh64, &seed, 0, 1.0f, &allocator);
+  world_hashtable_enable_lean(&ht);
+
+  // A version is unlinked as soon as it is superseded, and nothing is logged.
+  for (uint32_t i = 0; i < 1000; i++) {
+    struct world_buffer key, data;
+    uint32_t k = i % 10;
+    key.base = &k;
+    key.size = sizeof(k);
+    data.base = &i;
+    data.size = sizeof(i);
+    ASSERT(world_hashtable_set(&ht, key, data) == world_error_ok);
+  }
+  EXPECT(world_hashtable_log_greatest_sequence(&ht.log) == 0);
+  EXPECT(world_vector_size(&ht.garbages) == 0);
+  EXPECT(world_circular_size(&ht.superseded) == 990);
+  for (uint32_t k = 0; k < 10; k++) {
+    struct world_buffer key, found;
+    key.base = &k;
+    key.size = sizeof(k);
+    ASSERT(world_hashtable_get(&ht, key, &found) == world_error_ok);
+    EXPECT(*(uint32_t *)found.base == 990 + k);
+    struct world_hashtable_entry *bucket = world_hashtable_bucket_find(&ht.bucket, world_hash(ht.hash_function, &k, sizeof(k), &ht.seed));
+    size_t n_versions = 0;
+    for (struct world_hashtable_entry *e = atomic_load(&bucket->base.next); e && !world_hashtable_entry_is_bucket(e); e = atomic_load(&e->base.next)) {
+      struct world_buffer k2 = world_hashtable_entry_key(e);
+      n_versions += k2.size == key.size && memcmp(k2.base, key.base, key.size) == 0;
+    }
+    EXPECT(n_versions == 1);
+  }
+
+  // A deleted key leaves no void entry behind, even within a batch that sets
+  // it again and deletes it once more.
+  uint32_t k = 3;
+  struct world_write writes[3];
+  memset(writes, 0, sizeof(writes));
+  writes[0].operation = world_operation_delete;
+  writes[0].key.base = &k;
+  writes[0].key.size = sizeof(k);
+  writes[1] = writes[0];
+  writes[1].operation = world_operation_set;
+  writes[1].data = writes[1].key;
+  writes[2] = writes[0];
+  struct world_hashtable_entry *linked[3];
+  ASSERT(world_hashtable_write_batch(&ht, writes, 3, linked) == world_error_ok);
+  EXPECT(linked[0] && linked[1] && linked[2]);
+  EXPECT(world_hashtable_get(&ht, writes[0].key, NULL) == world_error_no_such_key);
+  EXPECT(world_circular_size(&ht.superseded) == 994);
+  EXPECT(atomic_load(&ht.n_fresh_entries) == 9);
+
+  while (!world_hashtable_checkpoint(&ht, atomic_load(&ht.visible), NULL)) {
+  }
+  EXPECT(world_circular_size(&ht.superseded) == 0);
+  EXPECT(world_circular_size(&ht.retired) == 0);
+  EXPECT(world_hashtable_stale_bytes(&ht) == 0);
+
+  world_hashtable_destroy(&ht);
+
+  world_allocator_destroy(&allocator);
+}
+
+#define N_OVERWRITES 100000
+#define OVERWRITE_SIZE 64
+
+static void *_overwriter_main(void *arg)
+{
+  struct world_hashtable *ht = arg;
+  uint8_t value[OVERWRITE_SIZE];
+  struct world_write w;
+  memset(&w, 0, sizeof(w));
+  w.operation = world_operation_set;
+  w.key.base = "price";
+  w.key.size = 6;
+  w.data.base = value;
+  w.data.size = sizeof(value);
+  for (size_t i = 0; i < N_OVERWRITES; i++) {
+    memset(value, (int)(i % 256), sizeof(value));
+    ASSERT(world_hashtable_write_batch(ht, &w, 1, NULL) == world_error_ok);
+  }
+  return NULL;
+}
+
+#define N_BATCHES 10000
+
+static void *_batcher_main(void *arg)
+{
+  // Each batch adds a new key, and then overwrites a counter in place.
+  struct world_hashtable *ht = arg;
+  uint32_t i;
+  struct world_write w[2];
+  memset(w, 0, sizeof(w));
+  w[0].operation = world_operation_add;
+  w[0].key.base = &i;
+  w[0].key.size = sizeof(i);
+  w[0].data.base = "x";
+  w[0].data.size = 1;
+  w[1].operation = world_operation_set;
+  w[1].key.base = "counter";
+  w[1].key.size = 8;
+  w[1].data.base = &i;
+  w[1].data.size = sizeof(i);
+  for (i = 1; i <= N_BATCHES; i++) {
+    ASSERT(world_hashtable_write_batch(ht, w, 2, NULL) == world_error_ok);
+  }
+  return NULL;
+}
+
+static void test_hashtable_in_place(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct world_hashtable ht;
+  world_hashtable_init(&ht, world_hash_function_xxh64, &seed, 0, 1.0f, &allocator);
+  world_hashtable_enable_lean(&ht);
+  world_hashtable_enable_in_place(&ht);
+
+  // The data of the same size is overwritten in the same entry, while the data
+  // of another size gets a new one.
+  uint32_t values[3] = {1, 2, 3};
+  struct world_write writes[3];
+  memset(writes, 0, sizeof(writes));
+  for (size_t i = 0; i < 3; i++) {
+    writes[i].operation = world_operation_set;
+    writes[i].key.base = "foo";
+    writes[i].key.size = 4;
+    writes[i].data.base = &values[i];
+    writes[i].data.size = sizeof(values[i]);
+  }
+  struct world_hashtable_entry *linked[3];
+  ASSERT(world_hashtable_write_batch(&ht, writes, 1, linked) == world_error_ok);
+  struct world_hashtable_entry *entry = linked[0];
+  ASSERT(world_hashtable_write_batch(&ht, &writes[1], 1, linked) == world_error_ok);
+  EXPECT(linked[0] == entry);
+  EXPECT(world_circular_size(&ht.superseded) == 0);
+  uint32_t copied = 0;
+  size_t size = 0;
+  ASSERT(world_hashtable_get_copy(&ht, writes[0].key, &copied, sizeof(copied), &size) == world_error_ok);
+  EXPECT(size == sizeof(copied) && copied == 2);
+  writes[2].data.size = 2;
+  ASSERT(world_hashtable_write_batch(&ht, &writes[2], 1, linked) == world_error_ok);
+  EXPECT(linked[0] != entry);
+  EXPECT(world_circular_size(&ht.superseded) == 1);
+  ASSERT(world_hashtable_get_copy(&ht, writes[0].key, NULL, 0, &size) == world_error_ok);
+  EXPECT(size == 2);
+
+  // A version linked by a batch is superseded by the same batch rather than
+  // overwritten, so that it is not seen before the batch is.
+  writes[0].data.size = 2;
+  writes[1].data.size = 2;
+  ASSERT(world_hashtable_write_batch(&ht, writes, 2, linked) == world_error_ok);
+  EXPECT(linked[0] == linked[1]);
+  EXPECT(world_circular_size(&ht.superseded) == 1);
+  writes[0].data.size = 4;
+  writes[1].data.size = 4;
+  ASSERT(world_hashtable_write_batch(&ht, writes, 2, linked) == world_error_ok);
+  EXPECT(linked[0] != linked[1]);
+  EXPECT(world_circular_size(&ht.superseded) == 3);
+
+  // A copy is never torn by an overwrite in progress.
+  pthread_t overwriter;
+  ASSERT(pthread_create(&overwriter, NULL, _overwriter_main, &ht) == 0);
+  struct world_buffer key;
+  key.base = "price";
+  key.size = 6;
+  size_t n_torn = 0;
+  for (size_t i = 0; i < N_OVERWRITES; i++) {
+    uint8_t value[OVERWRITE_SIZE];
+    if (world_hashtable_get_copy(&ht, key, value, sizeof(value), &size) != world_error_ok) {
+      continue;
+    }
+    for (size_t j = 1; j < sizeof(value); j++) {
+      if (value[j] != value[0]) {
+        n_torn++;
+        break;
+      }
+    }
+  }
+  ASSERT(pthread_join(overwriter, NULL) == 0);
+  EXPECT(n_torn == 0);
+
+  // An overwrite may be seen before the other writes of its batch, but never
+  // after them.
+  uint32_t zero = 0;
+  struct world_buffer counter = {"counter", 8};
+  ASSERT(world_hashtable_set(&ht, counter, (struct world_buffer){&zero, sizeof(zero)}) == world_error_ok);
+  pthread_t batcher;
+  ASSERT(pthread_create(&batcher, NULL, _batcher_main, &ht) == 0);
+  size_t n_late = 0;
+  for (uint32_t i = 1; i <= N_BATCHES; i++) {
+    key.base = &i;
+    key.size = sizeof(i);
+    while (world_hashtable_get(&ht, key, NULL) != world_error_ok) {
+    }
+    ASSERT(world_hashtable_get_copy(&ht, counter, &copied, sizeof(copied), &size) == world_error_ok);
+    n_late += copied < i;
+  }
+  ASSERT(pthread_join(batcher, NULL) == 0);
+  EXPECT(n_late == 0);
+
+  world_hashtable_destroy(&ht);
+
+  world_allocator_destroy(&allocator);
+}
+
+static void test_hashtable_eviction(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct world_hashtable ht;
+  world_hashtable_init(&ht, world_hash_function_xxh64, &seed, 0, 1.0f, &allocator);
+  world_hashtable_enable_eviction(&ht);
+
+  const size_t n_keys = 1000, n_hot_keys = 10;
+  char payload[100];
+  memset(payload, 'x', sizeof(payload));
+  struct world_buffer key, data;
+  data.base = payload;
+  data.size = sizeof(payload);
+  for (uint32_t i = 0; i < n_keys; i++) {
+    key.base = &i;
+    key.size = sizeof(i);
+    ASSERT(world_hashtable_set(&ht, key, data) == world_error_ok);
+  }
+  size_t live = world_hashtable_live_bytes(&ht);
+  EXPECT(live >= n_keys * (sizeof(uint32_t) + sizeof(payload)));
+  EXPECT(world_hashtable_stale_bytes(&ht) == 0);
+
+  // Stale versions and void entries are accounted until they are reclaimed.
+  uint32_t i = 0;
+  key.base = &i;
+  key.size = sizeof(i);
+  ASSERT(world_hashtable_set(&ht, key, data) == world_error_ok);
+  EXPECT(world_hashtable_live_bytes(&ht) == live);
+  EXPECT(world_hashtable_stale_bytes(&ht) > 0);
+  // They do not count against the limit.
+  EXPECT(world_hashtable_evict(&ht, live, live) == 0);
+  world_hashtable_checkpoint(&ht, world_hashtable_log_greatest_sequence(&ht.log), NULL);
+  world_hashtable_checkpoint(&ht, world_hashtable_log_greatest_sequence(&ht.log), NULL);
+  EXPECT(world_hashtable_stale_bytes(&ht) == 0);
+
+  // Keys being read survive, while the others are evicted a few at a time in
+  // order to fit the dataset into half of the bytes. Evicted versions are stale
+  // until a checkpoint. Reads are sampled, so each key is read a few times in a
+  // row.
+  const size_t max_bytes = live / 2;
+  for (size_t round = 0; round < n_keys; round++) {
+    for (uint32_t j = 0; j < n_hot_keys * WORLD_HASHTABLE_REFERENCE_SAMPLING; j++) {
+      uint32_t k = j / WORLD_HASHTABLE_REFERENCE_SAMPLING;
+      key.base = &k;
+      EXPECT(world_hashtable_get(&ht, key, NULL) == world_error_ok);
+    }
+    world_hashtable_evict(&ht, max_bytes, live / 100);
+    world_hashtable_checkpoint(&ht, world_hashtable_log_greatest_sequence(&ht.log), NULL);
+    world_hashtable_checkpoint(&ht, world_hashtable_log_greatest_sequence(&ht.log), NULL);
+    if (world_hashtable_live_bytes(&ht) <= max_bytes) {
+      break;
+    }
+  }
+  EXPECT(world_hashtable_live_bytes(&ht) <= max_bytes);
+  size_t n_found = 0;
+  for (uint32_t j = 0; j < n_keys; j++) {
+    key.base = &j;
+    if (world_hashtable_get(&ht, key, NULL) == world_error_ok) {
+      n_found++;
+    } else {
+      EXPECT(j >= n_hot_keys);
+    }
+  }
+  EXPECT(n_hot_keys < n_found && n_found < n_keys);
+
+  world_hashtable_destroy(&ht);
+
+  world_allocator_destroy(&allocator);
+}
+
+static void test_hashtable_snapshot(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct world_hashtable ht;
+  world_hashtable_init(&ht, world_hash_function_xxh64, &seed, 0, 1.0f, &allocator);
+
+  // Each key has versions 1, 2 and 3, and a snapshot at the sequence 2 * N
+  // contains the versions 2.
+  const uint32_t n = 1000;
+  for (uint32_t version = 1; version <= 3; version++) {
+    for (uint32_t i = 0; i < n; i++) {
+      struct world_buffer key, data;
+      key.base = &i;
+      key.size = sizeof(i);
+      data.base = &version;
+      data.size = sizeof(version);
+      ASSERT(world_hashtable_set(&ht, key, data) == world_error_ok);
+    }
+  }
+
+  size_t count = 0;
+  struct world_hashtable_entry *cursor = world_hashtable_front(&ht);
+  struct world_hashtable_entry *entry = NULL;
+  while ((entry = world_hashtable_entry_advance(&cursor, NULL, 2 * n))) {
+    struct world_buffer data = world_hashtable_entry_data(entry);
+    EXPECT(data.size == sizeof(uint32_t) && *(const uint32_t *)data.base == 2);
+    count++;
+  }
+  EXPECT(count == n);
+
+  // The partitions cover all the keys exactly once.
+  const size_t n_partitions[] = {1, 3, WORLD_HASHTABLE_N_STRIPES};
+  for (size_t k = 0; k < sizeof(n_partitions) / sizeof(n_partitions[0]); k++) {
+    count = 0;
+    for (size_t i = 0; i < n_partitions[k]; i++) {
+      struct world_hashtable_entry *end;
+      world_hashtable_partition(&ht, i, n_partitions[k], &cursor, &end);
+      while ((entry = world_hashtable_advance(&ht, &cursor, end, 2 * n))) {
+        struct world_buffer data = world_hashtable_entry_data(entry);
+        EXPECT(data.size == sizeof(uint32_t) && *(const uint32_t *)data.base == 2);
+        count++;
+      }
+    }
+    EXPECT(count == n);
+  }
+
+  // An acquired sequence survives checkpoints.
+  world_sequence seq = world_hashtable_acquire_sequence(&ht);
+  EXPECT(seq == 3 * n);
+  for (uint32_t i = 0; i < n; i++) {
+    struct world_buffer key;
+    key.base = &i;
+    key.size = sizeof(i);
+    ASSERT(world_hashtable_delete(&ht, key) == world_error_ok);
+  }
+  world_hashtable_checkpoint(&ht, world_hashtable_log_greatest_sequence(&ht.log), NULL);
+  world_hashtable_checkpoint(&ht, world_hashtable_log_greatest_sequence(&ht.log), NULL);
+  count = 0;
+  cursor = world_hashtable_front(&ht);
+  while ((entry = world_hashtable_advance(&ht, &cursor, NULL, seq))) {
+    struct world_buffer data = world_hashtable_entry_data(entry);
+    EXPECT(data.size == sizeof(uint32_t) && *(const uint32_t *)data.base == 3);
+    count++;
+  }
+  EXPECT(count == n);
+  world_hashtable_release_sequence(&ht, seq);
+  world_hashtable_checkpoint(&ht, world_hashtable_log_greatest_sequence(&ht.log), NULL);
+  cursor = world_hashtable_front(&ht);
+  EXPECT(world_hashtable_advance(&ht, &cursor, NULL, world_hashtable_log_greatest_sequence(&ht.log)) == NULL);
+
+  world_hashtable_destroy(&ht);
+
+  world_allocator_destroy(&allocator);
+}
+
+#define N_CONCURRENT_KEYS 256
+#define N_CONCURRENT_READERS 4
+#define N_CONCURRENT_WRITES 100000
+
+struct _concurrent {
+  struct world_hashtable ht;
+  atomic_bool done;
+};
+
+static void *_concurrent_reader(void *arg)
+{
+  struct _concurrent *c = arg;
+  while (!atomic_load(&c->done)) {
+    for (uint32_t i = 0; i < N_CONCURRENT_KEYS; i++) {
+      struct world_buffer key, found;
+      key.base = &i;
+      key.size = sizeof(i);
+      if (world_hashtable_get(&c->ht, key, &found) != world_error_ok) {
+        continue;
+      }
+      // Every value of the key i starts with i, and then the value is repeated.
+      EXPECT(found.size % sizeof(uint32_t) == 0);
+      const uint32_t *words = found.base;
+      for (size_t j = 0; j < found.size / sizeof(uint32_t); j++) {
+        EXPECT(words[j] == i);
+      }
+    }
+  }
+  return NULL;
+}
+
+static void test_hashtable_concurrent_reads(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct _concurrent c;
+  world_hashtable_init(&c.ht, world_hash_function_xxh64, &seed, 0, 1.0f, &allocator);
+  atomic_init(&c.done, false);
+  struct world_circular garbages;
+  world_circular_init(&garbages, &allocator);
+
+  pthread_t readers[N_CONCURRENT_READERS];
+  for (size_t i = 0; i < N_CONCURRENT_READERS; i++) {
+    ASSERT(pthread_create(&readers[i], NULL, _concurrent_reader, &c) == 0);
+  }
+
+  uint32_t words[16];
+  for (uint32_t i = 0; i < N_CONCURRENT_WRITES; i++) {
+    uint32_t k = i % N_CONCURRENT_KEYS;
+    for (size_t j = 0; j < sizeof(words) / sizeof(*words); j++) {
+      words[j] = k;
+    }
+    struct world_buffer key, data;
+    key.base = &k;
+    key.size = sizeof(k);
+    data.base = words;
+    data.size = sizeof(*words) * (1 + i % 16);
+    if (i % 7 == 0) {
+      world_hashtable_delete(&c.ht, key);
+    } else {
+      ASSERT(world_hashtable_set(&c.ht, key, data) == world_error_ok);
+    }
+    // Readers may still look at data of reclaimed entries, so we keep them
+    // until the end.
+    world_hashtable_checkpoint(&c.ht, world_hashtable_log_greatest_sequence(&c.ht.log), &garbages);
+  }
+
+  atomic_store(&c.done, true);
+  for (size_t i = 0; i < N_CONCURRENT_READERS; i++) {
+    ASSERT(pthread_join(readers[i], NULL) == 0);
+  }
+
+  world_hashtable_destroy(&c.ht);
+  while (world_circular_size(&garbages) > 0) {
+    world_hashtable_entry_delete(*(void **)world_circular_front(&garbages, sizeof(void *)), &allocator);
+    world_circular_pop_front(&garbages);
+  }
+  world_circular_destroy(&garbages);
+}
+
+#define N_CONCURRENT_WRITERS 8
+#define N_CONCURRENT_WRITER_KEYS 4096
+
+struct _writer {
+  struct world_hashtable *ht;
+  uint32_t id;
+};
+
+static void *_concurrent_writer(void *arg)
+{
+  struct _writer *w = arg;
+  for (uint32_t i = 0; i < N_CONCURRENT_WRITER_KEYS; i++) {
+    uint32_t words[2] = {w->id, i};
+    struct world_buffer key, data;
+    key.base = words;
+    key.size = sizeof(words);
+    data.base = words;
+    data.size = sizeof(words);
+    EXPECT(world_hashtable_add(w->ht, key, data) == world_error_ok);
+    EXPECT(world_hashtable_replace(w->ht, key, data) == world_error_ok);
+    if (i % 3 == 0) {
+      EXPECT(world_hashtable_delete(w->ht, key) == world_error_ok);
+    }
+  }
+  return NULL;
+}
+
+static void test_hashtable_concurrent_writes(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct world_hashtable ht;
+  world_hashtable_init(&ht, world_hash_function_xxh64, &seed, 0, 1.0f, &allocator);
+
+  pthread_t threads[N_CONCURRENT_WRITERS];
+  struct _writer writers[N_CONCURRENT_WRITERS];
+  for (uint32_t i = 0; i < N_CONCURRENT_WRITERS; i++) {
+    writers[i].ht = &ht;
+    writers[i].id = i;
+    ASSERT(pthread_create(&threads[i], NULL, _concurrent_writer, &writers[i]) == 0);
+  }
+  for (size_t i = 0; i < N_CONCURRENT_WRITERS; i++) {
+    ASSERT(pthread_join(threads[i], NULL) == 0);
+  }
+
+  // The log should be a single sequence without any gaps.
+  world_sequence seq = 0;
+  struct world_hashtable_entry *cursor = world_hashtable_log_front(&ht.log);
+  while ((cursor = atomic_load(&cursor->log))) {
+    EXPECT(cursor->base.seq == ++seq);
+  }
+  EXPECT(seq == N_CONCURRENT_WRITERS * (N_CONCURRENT_WRITER_KEYS * 2 + (N_CONCURRENT_WRITER_KEYS + 2) / 3));
+
+  for (uint32_t id = 0; id < N_CONCURRENT_WRITERS; id++) {
+    for (uint32_t i = 0; i < N_CONCURRENT_WRITER_KEYS; i++) {
+      uint32_t words[2] = {id, i};
+      struct world_buffer key, found;
+      key.base = words;
+      key.size = sizeof(words);
+      if (i % 3 == 0) {
+        EXPECT(world_hashtable_get(&ht, key, &found) == world_error_no_such_key);
+      } else {
+        ASSERT(world_hashtable_get(&ht, key, &found) == world_error_ok);
+        EXPECT(found.size == sizeof(words));
+        EXPECT(memcmp(found.base, words, sizeof(words)) == 0);
+      }
+    }
+  }
+
+  world_hashtable_destroy(&ht);
+}
+
 int main(void)
 {
-  test_hashtable_manipulation();
+  test_hashtable_manipulation(world_hash_function_murmur1);
+  test_hashtable_manipulation(world_hash_function_xxh64);
+  test_hashtable_manipulation(world_hash_function_siphash);
+  test_hashtable_capacity();
+  test_hashtable_get_many();
+  test_hashtable_update();
+  test_hashtable_pin();
+  test_hashtable_write_batch();
+  test_hashtable_lean();
+  test_hashtable_in_place();
+  test_hashtable_eviction();
+  test_hashtable_snapshot();
+  test_hashtable_concurrent_reads();
+  test_hashtable_concurrent_writes();
   return TEST_STATUS;
 }
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "../../src/world_allocator.h"
+#include "../../src/world_hashtable.h"
+#include "../../src/world_hashtable_entry.h"
+#include "../../src/world_skiplist.h"
+#include "../helper.h"
+
+#define N_KEYS 1000
+#define N_WRITES 100000
+
+static const struct world_hash_seed seed = {0, 0};
+
+struct _index {
+  struct world_hashtable ht;
+  struct world_skiplist sl;
+};
+
+struct _collector {
+  char keys[N_KEYS][8];
+  size_t n;
+  size_t limit;
+  unsigned version;
+};
+
+static void _set(struct _index *index, unsigned i, unsigned version);
+static void _delete(struct _index *index, unsigned i);
+static bool _collect(void *ctx, struct world_buffer key, struct world_buffer data);
+
+static void test_skiplist_manipulation(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct _index index;
+  world_hashtable_init(&index.ht, world_hash_function_xxh64, &seed, 0, 1.0f, &allocator);
+  world_skiplist_init(&index.sl, &index.ht.epoch, &allocator);
+
+  // The keys are inserted in a scrambled order.
+  for (unsigned i = 0; i < N_KEYS; i++) {
+    _set(&index, i * 7 % N_KEYS, 1);
+  }
+
+  struct _collector c;
+  memset(&c, 0, sizeof(c));
+  c.limit = N_KEYS;
+  struct world_buffer lower = {"", 0};
+  world_skiplist_scan(&index.sl, lower, _collect, &c);
+  EXPECT(c.n == N_KEYS);
+  for (unsigned i = 0; i < c.n; i++) {
+    char expected[16];
+    snprintf(expected, sizeof(expected), "k%04u", i % N_KEYS);
+    EXPECT(memcmp(c.keys[i], expected, 5) == 0);
+  }
+
+  // The scan starts from the first key not less than the lower bound, and
+  // stops when the callback returns false.
+  memset(&c, 0, sizeof(c));
+  c.limit = 10;
+  lower.base = "k05";
+  lower.size = 3;
+  world_skiplist_scan(&index.sl, lower, _collect, &c);
+  EXPECT(c.n == 10);
+  EXPECT(memcmp(c.keys[0], "k0500", 5) == 0);
+  EXPECT(memcmp(c.keys[9], "k0509", 5) == 0);
+
+  // Deleted keys disappear, and overwritten keys have the new data.
+  for (unsigned i = 0; i < N_KEYS; i += 2) {
+    _delete(&index, i);
+  }
+  for (unsigned i = 1; i < N_KEYS; i += 2) {
+    _set(&index, i, 2);
+  }
+  memset(&c, 0, sizeof(c));
+  c.limit = N_KEYS;
+  c.version = 2;
+  lower.size = 0;
+  world_skiplist_scan(&index.sl, lower, _collect, &c);
+  EXPECT(c.n == N_KEYS / 2);
+  EXPECT(memcmp(c.keys[0], "k0001", 5) == 0);
+
+  // A node deleted while a reader is in the epoch is reclaimed by a later set.
+  size_t slot = world_epoch_enter(&index.ht.epoch);
+  _delete(&index, 1);
+  world_epoch_leave(&index.ht.epoch, slot);
+  EXPECT(world_circular_size(&index.sl.retired) == 1);
+  _set(&index, 3, 3);
+  EXPECT(world_circular_size(&index.sl.retired) == 0);
+
+  EXPECT(world_skiplist_compare((struct world_buffer){"ab", 2}, (struct world_buffer){"abc", 3}) < 0);
+  EXPECT(world_skiplist_compare((struct world_buffer){"b", 1}, (struct world_buffer){"abc", 3}) > 0);
+  EXPECT(world_skiplist_compare((struct world_buffer){"abc", 3}, (struct world_buffer){"abc", 3}) == 0);
+
+  world_skiplist_destroy(&index.sl);
+  world_hashtable_destroy(&index.ht);
+
+  world_allocator_destroy(&allocator);
+}
+
+struct _concurrent {
+  struct _index index;
+  atomic_bool done;
+};
+
+static bool _ordered(void *ctx, struct world_buffer key, struct world_buffer data)
+{
+  (void)data;
+  struct world_buffer *last = ctx;
+  EXPECT(world_skiplist_compare(*last, key) < 0);
+  *last = key;
+  return true;
+}
+
+static void *_concurrent_reader(void *arg)
+{
+  // Readers always see the keys in order, while they are set and deleted.
+  struct _concurrent *c = arg;
+  while (!atomic_load(&c->done)) {
+    struct world_buffer last = {"", 0};
+    struct world_buffer lower = {"", 0};
+    world_skiplist_scan(&c->index.sl, lower, _ordered, &last);
+  }
+  return NULL;
+}
+
+static void test_skiplist_concurrent_reads(void)
+{
+  struct world_allocator allocator;
+  world_allocator_init(&allocator);
+
+  struct _concurrent c;
+  world_hashtable_init(&c.index.ht, world_hash_function_xxh64, &seed, 0, 1.0f, &allocator);
+  world_skiplist_init(&c.index.sl, &c.index.ht.epoch, &allocator);
+  atomic_init(&c.done, false);
+
+  pthread_t reader;
+  ASSERT(pthread_create(&reader, NULL, _concurrent_reader, &c) == 0);
+  for (unsigned i = 0; i < N_WRITES; i++) {
+    unsigned k = i * 7 % N_KEYS;
+    if (i % 3 == 0) {
+      _delete(&c.index, k);
+    } else {
+      _set(&c.index, k, i);
+    }
+  }
+  atomic_store(&c.done, true);
+  ASSERT(pthread_join(reader, NULL) == 0);
+
+  world_skiplist_destroy(&c.index.sl);
+  world_hashtable_destroy(&c.index.ht);
+
+  world_allocator_destroy(&allocator);
+}
+
+int main(void)
+{
+  test_skiplist_manipulation();
+  test_skiplist_concurrent_reads();
+
+  return TEST_STATUS;
+}
+
+static void _set(struct _index *index, unsigned i, unsigned version)
+{
+  // The same as the replica applies a log.
+  char buf[16];
+  snprintf(buf, sizeof(buf), "k%04u", i);
+  struct world_buffer key = {buf, 5};
+  struct world_buffer data = {&version, sizeof(version)};
+  ASSERT(world_hashtable_set(&index->ht, key, data) == world_error_ok);
+  world_skiplist_set(&index->sl, world_hashtable_log(&index->ht));
+  world_hashtable_checkpoint(&index->ht, world_hashtable_log(&index->ht)->base.seq, NULL);
+}
+
+static void _delete(struct _index *index, unsigned i)
+{
+  char buf[16];
+  snprintf(buf, sizeof(buf), "k%04u", i);
+  struct world_buffer key = {buf, 5};
+  world_hashtable_delete(&index->ht, key);
+  world_skiplist_delete(&index->sl, key);
+  world_hashtable_checkpoint(&index->ht, world_hashtable_log(&index->ht)->base.seq, NULL);
+}
+
+static bool _collect(void *ctx, struct world_buffer key, struct world_buffer data)
+{
+  struct _collector *c = ctx;
+  if (c->n == c->limit) {
+    return false;
+  }
+  EXPECT(key.size == 5);
+  if (c->version) {
+    EXPECT(data.size == sizeof(unsigned) && memcmp(data.base, &c->version, sizeof(unsigned)) == 0);
+  }
+  memcpy(c->keys[c->n++], key.base, key.size);
+  return true;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2016 TAKAMORI Kaede <etheriqa@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "../../src/world_timer_wheel.h"
+#include "../helper.h"
+
+static size_t _count(struct world_timer *t);
+
+static void test_timer_wheel_expiry(void)
+{
+  // Each timer expires exactly on its deadline, including those cascaded from
+  // the upper levels and those beyond the span of the wheel.
+  const uint64_t now = 1000;
+  const uint64_t deadlines[] = {
+    0, 1000, 1001, 1023, 1024, 1025, 1087, 1088, 5095, 5096, 262144, 300000,
+    now + ((uint64_t)1 << 36) + 5,
+  };
+  const size_t n = sizeof(deadlines) / sizeof(deadlines[0]);
+  struct world_timer timers[sizeof(deadlines) / sizeof(deadlines[0])];
+
+  struct world_timer_wheel w;
+  world_timer_wheel_init(&w, now);
+  for (size_t i = 0; i < n; i++) {
+    timers[i].deadline = deadlines[i];
+    world_timer_wheel_schedule(&w, &timers[i]);
+  }
+  EXPECT(world_timer_wheel_size(&w) == n);
+
+  // Past deadlines expire on the next tick.
+  struct world_timer *expired = world_timer_wheel_advance(&w, now + 1);
+  EXPECT(_count(expired) == 3);
+
+  for (size_t i = 3; i < n - 1; i++) {
+    EXPECT(world_timer_wheel_advance(&w, deadlines[i] - 1) == NULL);
+    expired = world_timer_wheel_advance(&w, deadlines[i]);
+    EXPECT(expired == &timers[i] && !expired->next);
+  }
+
+  // A large step expires everything in between at once.
+  EXPECT(world_timer_wheel_size(&w) == 1);
+  EXPECT(world_timer_wheel_advance(&w, deadlines[n - 1] - 1) == NULL);
+  EXPECT(world_timer_wheel_advance(&w, deadlines[n - 1]) == &timers[n - 1]);
+  EXPECT(world_timer_wheel_size(&w) == 0);
+
+  // An empty wheel jumps to the time at once.
+  EXPECT(world_timer_wheel_advance(&w, (uint64_t)1 << 60) == NULL);
+  timers[0].deadline = ((uint64_t)1 << 60) + 64;
+  world_timer_wheel_schedule(&w, &timers[0]);
+  EXPECT(world_timer_wheel_advance(&w, ((uint64_t)1 << 60) + 64) == &timers[0]);
+
+  timers[0].deadline = ((uint64_t)1 << 60) + 100;
+  world_timer_wheel_schedule(&w, &timers[0]);
+  timers[1].deadline = ((uint64_t)1 << 61);
+  world_timer_wheel_schedule(&w, &timers[1]);
+  EXPECT(_count(world_timer_wheel_drain(&w)) == 2);
+  EXPECT(world_timer_wheel_size(&w) == 0);
+
+  // A past deadline is cascaded if the next tick crosses a boundary.
+  world_timer_wheel_init(&w, 4095);
+  timers[0].deadline = 0;
+  world_timer_wheel_schedule(&w, &timers[0]);
+  EXPECT(world_timer_wheel_advance(&w, 4096) == &timers[0]);
+}
+
+int main(void)
+{
+  test_timer_wheel_expiry();
+
+  return TEST_STATUS;
+}
+
+static size_t _count(struct world_timer *t)
+{
+  size_t n = 0;
+  for (; t; t = t->next) {
+    n++;
+  }
+  return n;
+}